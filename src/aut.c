@@ -0,0 +1,173 @@
+/*
+ *	Subgraph Isomorphism - Symmetry breaking
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "aut.h"
+#include "graph.h"
+#include "array.h"
+#include "util.h"
+#include <string.h>
+
+umask * F_LESS;
+
+/* Adjacency of F_GRAPH in form of bitmasks */
+static umask f_adj[MAX_F_VERTICES];
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: aut_extend
+ *---------------------------------------------------------------------------
+ * Tries to extend a partial automorphism of F_GRAPH by backtracking. Vertices
+ * are mapped in the given order, each of them to an unused vertex of the same
+ * degree with the same adjacency to already mapped vertices.
+ *
+ * Params:
+ *   order - order of vertices (already mapped ones first)
+ *   depth - number of already mapped vertices in the order
+ *   perm  - partial automorphism (-1 for unmapped vertices)
+ *   used  - bitmask of images of already mapped vertices
+ *
+ * Returns:
+ *   1 if the automorphism was completed (and stored in perm), 0 otherwise
+ */
+static int aut_extend (int * order, int depth, int * perm, umask used)
+{
+  if (depth == F_GRAPH->n_cnt) return 1;
+  int v = order[depth];
+  for (int w = 0; w < F_GRAPH->n_cnt; w++)
+  {
+    if (GET_BIT(used, w) || MASK_POP(f_adj[v]) != MASK_POP(f_adj[w])) continue;
+    int ok = 1;
+    for (int i = 0; i < depth && ok; i++)
+    {
+      if (!GET_BIT(f_adj[v], order[i]) != !GET_BIT(f_adj[w], perm[order[i]])) ok = 0;
+    }
+    if (!ok) continue;
+    perm[v] = w;
+    if (aut_extend(order, depth + 1, perm, SET_BIT(used, w))) return 1;
+  }
+  perm[v] = -1;
+  return 0;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: aut_exists
+ *---------------------------------------------------------------------------
+ * Checks whether an automorphism of F_GRAPH fixing given vertices and mapping
+ * vertex v to vertex w exists
+ *
+ * Params:
+ *   fixed - bitmask of fixed vertices
+ *   v     - vertex being mapped
+ *   w     - image of v
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int aut_exists (umask fixed, int v, int w)
+{
+  int order[MAX_F_VERTICES], perm[MAX_F_VERTICES], o_cnt = 0;
+  umask used = EMPTY_MASK, seen;
+  for (int i = 0; i < F_GRAPH->n_cnt; i++) perm[i] = -1;
+  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  {
+    if (GET_BIT(fixed, i))
+    {
+      order[o_cnt++] = i;
+      perm[i] = i;
+      used = SET_BIT(used, i);
+    }
+  }
+  if (GET_BIT(used, w) || MASK_POP(f_adj[v]) != MASK_POP(f_adj[w])) return 0;
+  if ((f_adj[v] & fixed) != (f_adj[w] & fixed)) return 0;
+  order[o_cnt++] = v;
+  perm[v] = w;
+  used = SET_BIT(used, w);
+  /* Remaining vertices in BFS order, so that they are adjacent to mapped ones early */
+  seen = SET_BIT(fixed, v);
+  for (int h = 0; o_cnt < F_GRAPH->n_cnt; h++)
+  {
+    if (h == o_cnt)
+    {
+      int x = 0;
+      while (GET_BIT(seen, x)) ++x;
+      order[o_cnt++] = x;
+      seen = SET_BIT(seen, x);
+    }
+    for (int x = 0; x < F_GRAPH->n_cnt; x++)
+    {
+      if (GET_BIT(f_adj[order[h]], x) && !GET_BIT(seen, x))
+      {
+        order[o_cnt++] = x;
+        seen = SET_BIT(seen, x);
+      }
+    }
+  }
+  return aut_extend(order, MASK_POP(fixed) + 1, perm, used);
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: aut_init
+ *-------------------------------------------------------------------------*/
+void aut_init (void)
+{
+  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  {
+    f_adj[i] = EMPTY_MASK;
+    FOR_ADJ(F_GRAPH->edges[i], node)
+    {
+      f_adj[i] = SET_BIT(f_adj[i], node->key);
+    }
+    FOR_ADJ_END;
+  }
+  ARR_ALLOC(F_LESS, F_GRAPH->n_cnt);
+  memset(F_LESS, 0, F_GRAPH->n_cnt * sizeof(*F_LESS));
+  umask fixed = EMPTY_MASK;
+  for (;;)
+  {
+    /* Vertex with the largest orbit under the stabilizer of fixed vertices */
+    int best = -1, best_cnt = 1;
+    umask best_orbit = EMPTY_MASK, covered = fixed;
+    for (int v = 0; v < F_GRAPH->n_cnt; v++)
+    {
+      if (GET_BIT(covered, v)) continue; /* Orbits are disjoint */
+      umask orbit = SET_BIT(EMPTY_MASK, v);
+      for (int w = v + 1; w < F_GRAPH->n_cnt; w++)
+      {
+        if (!GET_BIT(covered, w) && aut_exists(fixed, v, w)) orbit = SET_BIT(orbit, w);
+      }
+      covered |= orbit;
+      if (MASK_POP(orbit) > best_cnt)
+      {
+        best = v;
+        best_cnt = MASK_POP(orbit);
+        best_orbit = orbit;
+      }
+    }
+    if (best < 0) break;
+    F_LESS[best] |= UNSET_BIT(best_orbit, best);
+    fixed = SET_BIT(fixed, best);
+    DBG("SYMMETRY: %d lower than orbit of size %d", best, best_cnt);
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: aut_free
+ *-------------------------------------------------------------------------*/
+void aut_free (void)
+{
+  ARR_FREE(F_LESS);
+  F_LESS = NULL;
+}
@@ -0,0 +1,38 @@
+/*
+ *	Subgraph Isomorphism - Symmetry breaking
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __AUT_H__
+#define __AUT_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: aut_init
+ * -------------------------
+ * Derives symmetry-breaking constraints F_LESS from automorphisms of F_GRAPH
+ * (by Grochow and Kellis). A vertex with the largest orbit under the current
+ * stabilizer is required to have a lower image than all other vertices of its
+ * orbit, then it is fixed and the process is repeated until the stabilizer is
+ * trivial. Each set of automorphic mappings then has exactly one mapping
+ * satisfying all constraints.
+ */
+void aut_init (void);
+
+/* -------------------------
+ * Function: aut_free
+ * -------------------------
+ * Frees symmetry-breaking constraints F_LESS.
+ */
+void aut_free (void);
+
+#endif /* __AUT_H__ */
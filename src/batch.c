@@ -0,0 +1,276 @@
+/*
+ *	Subgraph Isomorphism - Batch of patterns
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "batch.h"
+#include "subiso.h"
+#include "tree_dec.h"
+#include "nice_tree_dec.h"
+#include "graph.h"
+#include "graph_result.h"
+#include "filter.h"
+#include "aut.h"
+#include "cost.h"
+#include "cache.h"
+#include "array.h"
+#include "tests.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <assert.h>
+
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+/* Pattern of a batch */
+typedef struct batch_pattern_struct
+{
+  SUBISO_PATTERN   p;
+  /* Pattern as loaded, canonical labels of its vertices (NULL if not computed)
+     and their labels in the searched pattern */
+  GRAPH          * f_in;
+  int            * canon;
+  int            * lab;
+  /* Decomposition of the first pattern of an isomorphism class (NULL for others) */
+  TREE_DEC       * td;
+} BATCH_PATTERN;
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: batch_iso
+ *---------------------------------------------------------------------------
+ * Checks whether a pattern is isomorphic to the first pattern of a class
+ * by their canonical labels
+ *
+ * Params:
+ *   b   - pattern
+ *   r   - first pattern of the class
+ *   lab - array to store the isomorphism to (vertices of b to those of r)
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int batch_iso (BATCH_PATTERN * b, BATCH_PATTERN * r, int * lab)
+{
+  int n = b->f_in->n_cnt, inv[MAX_F_VERTICES];
+  if (!r->td || !r->canon || r->f_in->n_cnt != n) return 0;
+  for (int v = 0; v < n; v++) inv[r->canon[v]] = v;
+  for (int v = 0; v < n; v++) lab[v] = inv[b->canon[v]];
+  for (int v = 0; v < n; v++)
+  {
+    if (b->f_in->edges[v]->hash_count != r->f_in->edges[lab[v]]->hash_count) return 0;
+    FOR_ADJ(b->f_in->edges[v], node)
+    {
+      if (!graph_is_adj(r->f_in, lab[v], lab[node->key])) return 0;
+    }
+    FOR_ADJ_END;
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: batch_prepare
+ *---------------------------------------------------------------------------
+ * Loads a pattern and prepares its search (as for a single pattern, see main).
+ * A pattern isomorphic to a preceding one is relabeled to it and takes its
+ * decomposition, so that both patterns share all their DP tables.
+ *
+ * Params:
+ *   name - name of the file of the pattern (copied to the pattern on success)
+ *   pat  - patterns of the batch (the last one is to be filled)
+ *
+ * Returns:
+ *   1 on success, 0 if the pattern cannot be searched
+ */
+static int batch_prepare (const char * name, BATCH_PATTERN * pat)
+{
+  BATCH_PATTERN * b = &pat[ARR_LEN(pat) - 1], * r = NULL;
+  SUBISO_PATTERN * p = &b->p;
+  b->td = NULL;
+  if (access(name, R_OK))
+  {
+    printf("Cannot read pattern %s\n", name);
+    return 0;
+  }
+  F_GRAPH = b->f_in = graph_load(name, MAX_F_VERTICES);
+  if (!F_GRAPH)
+  {
+    printf("Pattern %s has more than %d vertices, wider builds are made by 'make wide'\n", name, MAX_F_VERTICES);
+    return 0;
+  }
+  ARR_ALLOC(b->canon, F_GRAPH->n_cnt);
+  ARR_ALLOC(b->lab, F_GRAPH->n_cnt);
+  if (!cache_canon(b->canon))
+  {
+    ARR_FREE(b->canon);
+    b->canon = NULL;
+  }
+  for (int k = 0; b->canon && k < ARR_LEN(pat) - 1 && !r; k++) if (batch_iso(b, &pat[k], b->lab)) r = &pat[k];
+  if (!r) for (int i = 0; i < F_GRAPH->n_cnt; i++) b->lab[i] = i;
+  F_GRAPH = graph_relabel(b->f_in, b->lab);
+  graph_pre_f_ecc();
+  filter_init();
+  cost_init();
+  cache_init();
+  GRAPH * tmp_f = graph_clone(F_GRAPH);
+  TREE_DEC * ftd = cache_load();
+  if (!ftd && r)
+  {
+    aut_init();
+    ftd = (TREE_DEC *)xmalloc(sizeof(*ftd));
+    memcpy(ftd, r->td, sizeof(*ftd));
+  }
+  else if (!ftd)
+  {
+    aut_init();
+    srand(1); /* Initial state of a process, ties are broken as by a single run */
+    ftd = td_get(tmp_f);
+    cache_store(ftd);
+  }
+  p->name = xstrdup(name);
+  p->f = F_GRAPH;
+  p->cand = F_CAND;
+  p->ntd = ntd_get(ftd);
+  subiso_plan(p->ntd);
+#ifdef TESTING
+  assert(test_tree_dec(ftd) == TEST_OK);
+  assert(test_nice_tree_dec(p->ntd) == TEST_OK);
+#endif
+  /* Only candidates are needed by the search of a prepared pattern */
+  graph_free(tmp_f);
+  if (r) td_free(ftd);
+  else b->td = ftd;
+  aut_free();
+  ARR_FREE(F_ECC);
+  ARR_FREE(F_COMP);
+  F_ECC = F_COMP = NULL;
+  F_CAND = NULL;
+  F_GRAPH = NULL;
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: batch_group
+ *---------------------------------------------------------------------------
+ * Collects the group of patterns with the same number of vertices as a given
+ * one, unless a preceding pattern belongs to it
+ *
+ * Params:
+ *   pat     - patterns of the batch
+ *   k       - index of the pattern
+ *   rep_cnt - number of algorithm repetitions (negative for 3^n)
+ *   grp     - array to store the group to
+ *
+ * Returns:
+ *   Number of repetitions of the group, 0 if the group starts by a preceding pattern
+ */
+static int batch_group (BATCH_PATTERN * pat, int k, int rep_cnt, SUBISO_PATTERN *** grp)
+{
+  int n = pat[k].p.f->n_cnt;
+  for (int j = 0; j < k; j++) if (pat[j].p.f->n_cnt == n) return 0;
+  GARY_RESIZE(*grp, 0);
+  for (int j = k; j < ARR_LEN(pat); j++) if (pat[j].p.f->n_cnt == n) ARR_PUSH(*grp, &pat[j].p);
+  if (rep_cnt < 0)
+  {
+    rep_cnt = 1;
+    for (int i = 0; i < n && rep_cnt <= INT_MAX / 3; i++) rep_cnt *= 3;
+  }
+  return rep_cnt;
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: batch_run
+ *-------------------------------------------------------------------------*/
+void batch_run (const char * list, int rep_cnt)
+{
+  FILE * in_f = fopen(list, "r");
+  if (!in_f)
+  {
+    fprintf(stderr, "Cannot read pattern list %s\n", list);
+    force_exit();
+  }
+  char name[PATH_MAX];
+  BATCH_PATTERN * pat;
+  SUBISO_PATTERN ** grp;
+  ARR_INIT(pat);
+  ARR_INIT(grp);
+  while (fscanf(in_f, "%4095s", name) == 1)
+  {
+    GARY_PUSH_MULTI(pat, 1);
+    if (!batch_prepare(name, pat)) GARY_RESIZE(pat, ARR_LEN(pat) - 1);
+  }
+  fclose(in_f);
+
+  srand(SEED);
+  clock_t start = clock();
+  /* Groups of patterns with the same number of vertices (in order of their first appearance) */
+  for (int k = 0; k < ARR_LEN(pat); k++)
+  {
+    int rc = batch_group(pat, k, rep_cnt, &grp);
+    if (!rc) continue;
+    subiso_share(grp, ARR_LEN(grp));
+    subiso_run_batch(grp, ARR_LEN(grp), rc);
+  }
+  clock_t end = clock();
+#ifdef TESTING
+  for (int k = 0; k < ARR_LEN(pat); k++)
+  {
+    int rc = batch_group(pat, k, rep_cnt, &grp);
+    if (rc) assert(test_batch(grp, ARR_LEN(grp), rc) == TEST_OK);
+  }
+#endif
+
+  for (int k = 0; k < ARR_LEN(pat); k++)
+  {
+    SUBISO_PATTERN * p = &pat[k].p;
+    int * lab = pat[k].lab, * m;
+    ARR_ALLOC(m, p->f->n_cnt);
+    /* Results are mapped back to vertices of the pattern as loaded */
+    for (int i = 0; i < ARR_LEN(p->result); i++)
+    {
+      GRAPH_RESULT * gr = p->result[i];
+      for (int v = 0; v < p->f->n_cnt; v++) m[v] = gr->mapping[lab[v]];
+      memcpy(gr->mapping, m, p->f->n_cnt * sizeof(*m));
+      gr->g = pat[k].f_in;
+    }
+    ARR_FREE(m);
+    printf(">>> PATTERN %s <<<\n", p->name);
+    for (int i = 0; i < ARR_LEN(p->result) && (!RES_LIMIT || i < RES_LIMIT); i++) graph_result_print(p->result[i]);
+    printf(">>> UNIQUE subgraphs found after %d runs = %d <<<\n", p->rep_cnt, ARR_LEN(p->result));
+#ifdef TESTING
+    F_GRAPH = pat[k].f_in;
+    assert(test_results(p->result) == TEST_OK);
+#endif
+    graph_result_array_free(p->result);
+    ntd_free(p->ntd);
+    for (int u = 0; u < ARR_LEN(p->cand); u++) ARR_FREE(p->cand[u]);
+    ARR_FREE(p->cand);
+    graph_free(p->f);
+    graph_free(pat[k].f_in);
+    ARR_FREE(pat[k].canon);
+    ARR_FREE(pat[k].lab);
+    td_free(pat[k].td);
+    xfree(p->name);
+  }
+  printf(">> Time = %.6f for %d patterns <<\n", (end - start) / (double)CLOCKS_PER_SEC, ARR_LEN(pat));
+  F_GRAPH = NULL;
+  F_CAND = NULL;
+  ARR_FREE(pat);
+  ARR_FREE(grp);
+}
@@ -0,0 +1,35 @@
+/*
+ *	Subgraph Isomorphism - Batch of patterns
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: batch_run
+ * -------------------------
+ * Searches a batch of patterns in G_GRAPH and prints found subgraphs of each
+ * of them. Patterns with the same number of vertices are evaluated together
+ * under shared colourings, so that their equal DP tables are computed once
+ * (see subiso_share). Patterns that cannot be read or do not fit into umask
+ * are reported and skipped.
+ *
+ * Params:
+ *   list    - file with names of files of the patterns (separated by whitespace)
+ *   rep_cnt - number of algorithm repetitions (3^n for patterns with n vertices
+ *             if negative)
+ */
+void batch_run (const char * list, int rep_cnt);
+
+#endif /* __BATCH_H__ */
@@ -0,0 +1,437 @@
+/*
+ *	Subgraph Isomorphism - Plan cache
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "cache.h"
+#include "tree_dec.h"
+#include "graph.h"
+#include "array.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+/* Signatures of vertices in colour refinement (colour, then counts of neighbours of each colour) */
+static int c_sig[MAX_F_VERTICES][MAX_F_VERTICES + 1];
+static int c_sig_len;
+
+static inline int sig_lt (int x, int y)
+{
+  return memcmp(c_sig[x], c_sig[y], c_sig_len * sizeof(int)) < 0;
+}
+
+/* Libucw vertex sorter defines (by signatures) */
+#define ASORT_PREFIX(X) sigarr_##X
+#define ASORT_KEY_TYPE  int
+#define ASORT_LT(x, y)  sig_lt(x, y)
+#include <ucw/sorter/array-simple.h>
+
+const char * CACHE_DIR;
+
+/* Adjacency of F_GRAPH in form of bitmasks */
+static umask c_adj[MAX_F_VERTICES];
+/* Canonical form -- rows of the smallest permuted adjacency matrix found so far */
+static umask c_cert[MAX_F_VERTICES];
+/* Canonical labels of vertices of F_GRAPH and vertices of F_GRAPH of canonical labels */
+static int   c_lab[MAX_F_VERTICES], c_inv[MAX_F_VERTICES];
+static int   c_leaves;
+/* File of the plan of F_GRAPH (empty if the cache is not used) */
+static char  c_path[PATH_MAX];
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: fnv
+ *---------------------------------------------------------------------------
+ * Adds a value to a FNV-1a hash
+ *
+ * Params:
+ *   h - hash so far
+ *   x - added value
+ *
+ * Returns:
+ *   Updated hash
+ */
+static u64 fnv (u64 h, u64 x)
+{
+  for (int i = 0; i < 8; i++, x >>= 8) h = (h ^ (x & 0xff)) * 0x100000001b3ULL;
+  return h;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: refine
+ *---------------------------------------------------------------------------
+ * Refines colours of vertices of F_GRAPH, until vertices of the same colour
+ * have the same number of neighbours of each colour. Colours are renumbered
+ * by sorted signatures, so that the result does not depend on labels.
+ *
+ * Params:
+ *   col - colours of vertices (0 .. k-1), refined in place
+ *
+ * Returns:
+ *   Number of colours
+ */
+static int refine (int * col)
+{
+  int n = F_GRAPH->n_cnt, order[MAX_F_VERTICES], k = 0;
+  for (int v = 0; v < n; v++) k = MAX(k, col[v] + 1);
+  for (;;)
+  {
+    c_sig_len = k + 1;
+    for (int v = 0; v < n; v++)
+    {
+      memset(c_sig[v], 0, c_sig_len * sizeof(int));
+      c_sig[v][0] = col[v];
+      for (int w = 0; w < n; w++) if (GET_BIT(c_adj[v], w)) c_sig[v][col[w] + 1]++;
+      order[v] = v;
+    }
+    sigarr_sort(order, n);
+    int k_new = 0;
+    for (int i = 0; i < n; i++)
+    {
+      if (i && sig_lt(order[i - 1], order[i])) ++k_new;
+      col[order[i]] = k_new;
+    }
+    if (++k_new == k) return k;
+    k = k_new;
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: leaf
+ *---------------------------------------------------------------------------
+ * Keeps the labelling given by a discrete colouring, if its permuted adjacency
+ * matrix is lexicographically smaller than the best one so far
+ *
+ * Params:
+ *   col - colours of vertices (all distinct)
+ */
+static void leaf (int * col)
+{
+  int n = F_GRAPH->n_cnt, inv[MAX_F_VERTICES], cmp = 0;
+  umask row[MAX_F_VERTICES];
+  for (int v = 0; v < n; v++) inv[col[v]] = v;
+  for (int i = 0; i < n; i++)
+  {
+    row[i] = EMPTY_MASK;
+    for (int j = 0; j < n; j++) if (GET_BIT(c_adj[inv[i]], inv[j])) row[i] = SET_BIT(row[i], j);
+    if (!cmp && c_leaves) cmp = (row[i] < c_cert[i] ? -1 : row[i] > c_cert[i]);
+  }
+  if (c_leaves++ && cmp >= 0) return;
+  memcpy(c_cert, row, n * sizeof(*row));
+  memcpy(c_lab, col, n * sizeof(*col));
+  memcpy(c_inv, inv, n * sizeof(*inv));
+}
+
+/*---------------------------------------------------------------------------
+ * Function: search
+ *---------------------------------------------------------------------------
+ * Searches the tree of equitable colourings. Vertices of the first cell with
+ * more than one vertex are individualized one by one, a vertex having the same
+ * neighbours as an already individualized one (its twin) is skipped.
+ *
+ * Params:
+ *   col - colouring of the node (refined in place)
+ *
+ * Returns:
+ *   1 if the search fits into CACHE_CANON_LEAVES leaves, 0 otherwise
+ */
+static int search (int * col)
+{
+  int n = F_GRAPH->n_cnt, k = refine(col), cnt[MAX_F_VERTICES] = { 0 }, c = 0;
+  if (k == n)
+  {
+    leaf(col);
+    return c_leaves <= CACHE_CANON_LEAVES;
+  }
+  for (int v = 0; v < n; v++) cnt[col[v]]++;
+  while (cnt[c] == 1) ++c;
+  umask done = EMPTY_MASK;
+  for (int v = 0; v < n; v++)
+  {
+    if (col[v] != c) continue;
+    int twin = 0, sub[MAX_F_VERTICES];
+    for (int u = 0; u < n && !twin; u++)
+    {
+      if (GET_BIT(done, u) && UNSET_BIT(c_adj[u], v) == UNSET_BIT(c_adj[v], u)) twin = 1;
+    }
+    if (twin) continue;
+    done = SET_BIT(done, v);
+    for (int w = 0; w < n; w++) sub[w] = col[w] + (col[w] > c || (col[w] == c && w != v));
+    if (!search(sub)) return 0;
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: canon
+ *---------------------------------------------------------------------------
+ * Computes the canonical labeling of F_GRAPH (into c_lab) and its adjacency
+ * matrix (into c_cert)
+ *
+ * Returns:
+ *   1 if the search fits into CACHE_CANON_LEAVES leaves, 0 otherwise
+ */
+static int canon (void)
+{
+  int col[MAX_F_VERTICES] = { 0 };
+  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  {
+    c_adj[i] = EMPTY_MASK;
+    FOR_ADJ(F_GRAPH->edges[i], node)
+    {
+      c_adj[i] = SET_BIT(c_adj[i], node->key);
+    }
+    FOR_ADJ_END;
+  }
+  c_leaves = 0;
+  return search(col);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: g_hash
+ *---------------------------------------------------------------------------
+ * Computes a fingerprint of G_GRAPH (degrees and sums of neighbours of vertices)
+ *
+ * Returns:
+ *   Fingerprint of G_GRAPH
+ */
+static u64 g_hash (void)
+{
+  u64 h = fnv(0xcbf29ce484222325ULL, G_GRAPH->n_cnt);
+  for (int v = 0; v < G_GRAPH->n_cnt; v++)
+  {
+    u64 deg = 0, sum = 0;
+    FOR_ADJ(G_GRAPH->edges[v], node)
+    {
+      ++deg;
+      sum += node->key;
+    }
+    FOR_ADJ_END;
+    h = fnv(fnv(h, deg), sum);
+  }
+  return h;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: read_mask
+ *---------------------------------------------------------------------------
+ * Reads a list of canonical labels (a count followed by the labels) and
+ * relabels them to vertices of F_GRAPH
+ *
+ * Params:
+ *   in_f - read file
+ *   lim  - upper bound of labels
+ *   inv  - relabeling (NULL for identity)
+ *   res  - read set in form of bitmask
+ *
+ * Returns:
+ *   1 on success, 0 if the list is malformed
+ */
+static int read_mask (FILE * in_f, int lim, int * inv, umask * res)
+{
+  int cnt, x;
+  *res = EMPTY_MASK;
+  if (fscanf(in_f, "%d", &cnt) != 1 || cnt < 0 || cnt > lim) return 0;
+  while (cnt--)
+  {
+    if (fscanf(in_f, "%d", &x) != 1 || x < 0 || x >= lim) return 0;
+    *res = SET_BIT(*res, inv ? inv[x] : x);
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: write_mask
+ *---------------------------------------------------------------------------
+ * Writes a set as a list of labels (a count followed by the labels)
+ *
+ * Params:
+ *   out_f - written file
+ *   m     - written set in form of bitmask
+ *   lab   - relabeling (NULL for identity)
+ */
+static void write_mask (FILE * out_f, umask m, int * lab)
+{
+  int l[MAX_F_VERTICES], cnt = 0;
+  for (int i = 0; i < MAX_F_VERTICES; i++) if (GET_BIT(m, i)) l[cnt++] = lab ? lab[i] : i;
+  fprintf(out_f, "%d", cnt);
+  for (int i = 0; i < cnt; i++) fprintf(out_f, " %d", l[i]);
+  fprintf(out_f, "\n");
+}
+
+/*---------------------------------------------------------------------------
+ * Function: plan_valid
+ *---------------------------------------------------------------------------
+ * Checks whether a loaded plan is a plan of F_GRAPH -- bags of the tree
+ * decomposition form a tree, they cover all vertices and edges of F_GRAPH,
+ * bags containing a vertex are connected and the width is the stored one.
+ * Symmetry-breaking constraints have to be acyclic and relate only vertices
+ * of the same degree (which automorphic vertices have).
+ *
+ * Params:
+ *   td   - loaded tree decomposition
+ *   less - loaded symmetry-breaking constraints (see F_LESS)
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int plan_valid (TREE_DEC * td, umask * less)
+{
+  int n = F_GRAPH->n_cnt, b = td->b_cnt, e_cnt = 0, tw = 0;
+  umask all = EMPTY_MASK, left = FULL_MASK(n);
+  for (int i = 0; i < b; i++)
+  {
+    umask a = td->nodes[i].adj;
+    if (GET_BIT(a, i)) return 0;
+    for (umask T = a; T; T &= T - 1) if (!GET_BIT(td->nodes[MASK_CTZ(T)].adj, i)) return 0;
+    e_cnt += MASK_POP(a);
+    all |= td->nodes[i].bag;
+    tw = MAX(tw, MASK_POP(td->nodes[i].bag) - 1);
+  }
+  if (e_cnt != 2 * (b - 1) || all != FULL_MASK(n) || tw != td->tw) return 0;
+  /* Bags containing a vertex (all bags for v = -1, so the tree is connected) */
+  for (int v = -1; v < n; v++)
+  {
+    umask has = EMPTY_MASK, seen, front;
+    for (int i = 0; i < b; i++) if (v < 0 || GET_BIT(td->nodes[i].bag, v)) has = SET_BIT(has, i);
+    seen = front = has & -has;
+    while (front)
+    {
+      umask grow = EMPTY_MASK;
+      for (umask T = front; T; T &= T - 1) grow |= td->nodes[MASK_CTZ(T)].adj;
+      front = grow & has & ~seen;
+      seen |= front;
+    }
+    if (seen != has) return 0;
+  }
+  for (int v = 0; v < n; v++) for (umask T = c_adj[v]; T; T &= T - 1)
+  {
+    umask e = SET_BIT(SET_BIT(EMPTY_MASK, v), MASK_CTZ(T));
+    int ok = 0;
+    for (int i = 0; i < b && !ok; i++) ok = ((td->nodes[i].bag & e) == e);
+    if (!ok) return 0;
+  }
+  for (int v = 0; v < n; v++)
+  {
+    if (GET_BIT(less[v], v)) return 0;
+    for (umask T = less[v]; T; T &= T - 1) if (MASK_POP(c_adj[MASK_CTZ(T)]) != MASK_POP(c_adj[v])) return 0;
+  }
+  /* Vertices without a lower one among the remaining ones are removed one by one */
+  while (left)
+  {
+    int u = -1;
+    for (umask T = left; T && u < 0; T &= T - 1)
+    {
+      u = MASK_CTZ(T);
+      for (umask R = left; R && u >= 0; R &= R - 1) if (GET_BIT(less[MASK_CTZ(R)], u)) u = -1;
+    }
+    if (u < 0) return 0;
+    left = UNSET_BIT(left, u);
+  }
+  return 1;
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: cache_init
+ *-------------------------------------------------------------------------*/
+void cache_init (void)
+{
+  int n = F_GRAPH->n_cnt;
+  c_path[0] = 0;
+  if (!CACHE_DIR) return;
+  if (!canon())
+  {
+    DBG("CACHE: canonical form exceeds %d leaves", CACHE_CANON_LEAVES);
+    return;
+  }
+  u64 h = fnv(fnv(g_hash(), TD_BUDGET), n);
+  for (int i = 0; i < n; i++) for (int j = 0; j < n; j++) if (GET_BIT(c_cert[i], j)) h = fnv(h, (u64)i * n + j);
+  snprintf(c_path, sizeof(c_path), "%s/%016llx.plan", CACHE_DIR, (unsigned long long)h);
+  DBG("CACHE: %s (%d leaves)", c_path, c_leaves);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: cache_canon
+ *-------------------------------------------------------------------------*/
+int cache_canon (int * lab)
+{
+  if (!canon()) return 0;
+  memcpy(lab, c_lab, F_GRAPH->n_cnt * sizeof(*lab));
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: cache_load
+ *
+ * Description:
+ *   The canonical form stored in the file is compared with the one of
+ *   F_GRAPH, so that a collision of keys is not taken for a hit. A corrupt
+ *   or stale plan (see plan_valid) is a miss too
+ *-------------------------------------------------------------------------*/
+TREE_DEC * cache_load (void)
+{
+  int n = F_GRAPH->n_cnt, f_n, ok;
+  char magic[16];
+  umask m, less[MAX_F_VERTICES];
+  if (!c_path[0]) return NULL;
+  FILE * in_f = fopen(c_path, "r");
+  if (!in_f) return NULL;
+  TREE_DEC * td = (TREE_DEC *)xmalloc(sizeof(*td));
+  ok = fscanf(in_f, "%15s %d", magic, &f_n) == 2 && !strcmp(magic, "grs-plan") && f_n == n;
+  for (int i = 0; ok && i < n; i++) ok = read_mask(in_f, n, NULL, &m) && m == c_cert[i];
+  ok = ok && fscanf(in_f, "%d %d %d", &td->tw, &td->b_cnt, &td->root) == 3;
+  ok = ok && td->b_cnt > 0 && td->b_cnt <= n && td->root >= 0 && td->root < td->b_cnt;
+  for (int i = 0; ok && i < td->b_cnt; i++)
+  {
+    ok = read_mask(in_f, n, c_inv, &td->nodes[i].bag) && read_mask(in_f, td->b_cnt, NULL, &td->nodes[i].adj);
+  }
+  for (int i = 0; ok && i < n; i++) ok = read_mask(in_f, n, c_inv, &less[c_inv[i]]);
+  fclose(in_f);
+  if (!ok || !plan_valid(td, less))
+  {
+    DBG("CACHE: malformed plan %s", c_path);
+    td_free(td);
+    return NULL;
+  }
+  for (int i = 0; i < n; i++) td->g_adj[i] = c_adj[i];
+  ARR_ALLOC(F_LESS, n);
+  memcpy(F_LESS, less, n * sizeof(*less));
+  DBG("CACHE: plan loaded from %s", c_path);
+  return td;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: cache_store
+ *-------------------------------------------------------------------------*/
+void cache_store (TREE_DEC * td)
+{
+  int n = F_GRAPH->n_cnt;
+  char tmp[PATH_MAX + 32];
+  if (!c_path[0]) return;
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", c_path, (int)getpid());
+  FILE * out_f = fopen(tmp, "w");
+  if (!out_f) return;
+  fprintf(out_f, "grs-plan %d\n", n);
+  for (int i = 0; i < n; i++) write_mask(out_f, c_cert[i], NULL);
+  fprintf(out_f, "%d %d %d\n", td->tw, td->b_cnt, td->root);
+  for (int i = 0; i < td->b_cnt; i++)
+  {
+    write_mask(out_f, td->nodes[i].bag, c_lab);
+    write_mask(out_f, td->nodes[i].adj, NULL);
+  }
+  for (int i = 0; i < n; i++) write_mask(out_f, F_LESS[c_inv[i]], c_lab);
+  if (fclose(out_f) || rename(tmp, c_path)) unlink(tmp);
+}
@@ -0,0 +1,73 @@
+/*
+ *	Subgraph Isomorphism - Plan cache
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: cache_init
+ * -------------------------
+ * Computes the canonical form of F_GRAPH (by colour refinement and
+ * individualization of vertices, the lexicographically smallest adjacency
+ * matrix is taken) and the key of its plan in CACHE_DIR. Vertices of a cell
+ * having the same neighbours (twins) are individualized only once. Since
+ * decompositions are chosen by estimates depending on G_GRAPH (see cost_bag),
+ * the key also contains a fingerprint of G_GRAPH. If CACHE_DIR is not set
+ * or the search exceeds CACHE_CANON_LEAVES leaves, the cache is not used.
+ */
+void       cache_init  (void);
+
+/* -------------------------
+ * Function: cache_canon
+ * -------------------------
+ * Computes the canonical labeling of F_GRAPH (the same one cache_init uses),
+ * so that isomorphic patterns relabeled by it are identical.
+ *
+ * Params:
+ *   lab - array of n_cnt items for canonical labels of vertices of F_GRAPH
+ *
+ * Returns:
+ *   1 on success, 0 if the search exceeds CACHE_CANON_LEAVES leaves
+ */
+int        cache_canon (int * lab);
+
+/* -------------------------
+ * Function: cache_load
+ * -------------------------
+ * Loads the plan of F_GRAPH from the cache -- a tree decomposition (with its
+ * root) and symmetry-breaking constraints F_LESS, both relabeled from
+ * the canonical form to vertices of F_GRAPH.
+ *
+ * Returns:
+ *   Pointer to the newly created tree decomposition, or NULL if the plan
+ *   is not cached or the cached one is not a valid plan of F_GRAPH (F_LESS
+ *   is left untouched then)
+ */
+TREE_DEC * cache_load  (void);
+
+/* -------------------------
+ * Function: cache_store
+ * -------------------------
+ * Stores the plan of F_GRAPH (a tree decomposition and F_LESS) to the cache
+ * in canonical labels (CACHE_DIR has to exist, otherwise nothing is stored).
+ * The file is written under a temporary name and renamed, so concurrent runs
+ * never read a partial plan.
+ *
+ * Params:
+ *   td - tree decomposition of F_GRAPH
+ */
+void       cache_store (TREE_DEC * td);
+
+#endif /* __CACHE_H__ */
@@ -14,7 +14,7 @@
 
 /* Graph constants */
 #define MAX_G_VERTICES   1000000000 
-#define MAX_F_VERTICES   20 /* at least 2^(MAX_F_VERTICES + 2)B is needed for allocations */
+#define MAX_F_VERTICES   UMASK_BITS /* vertices (and colours) of F_GRAPH are bits of umask */
 
 /* DP constants*/
 #define INF            1000000014
@@ -31,14 +31,62 @@
 #define RES_READ       2
 #define RES_EOF        -1
 #define RES_OK         0
+#define RES_POOL_SIZE  64 /* maximal number of freed buffers kept for reuse */
+#define RES_POOL_MEM   (1 << 26) /* maximal total capacity of freed buffers kept for reuse (in bytes) */
+#define RES_ACCT_STEP  (1 << 16) /* granularity of memory budget accounting (in bytes) */
+#define RES_SPILL_WIN  (1 << 20) /* size of blocks read from/written to spilled buffers */
+#define RES_BLK_RECS   1024 /* maximal number of records in an encoded block */
+#define RES_BLK_VALS   (1 << 14) /* number of values after which a block is encoded */
+#define RES_RAND_RECS  64 /* maximal number of records in a block of buffers read by resbuf_seek */
+
+/* Parallel processing constants */
+#define PAR_CHUNK_RECS 16384 /* minimal number of records in a chunk processed by one thread */
+#define PAR_SPAWN_INTR 2     /* minimal number of introduce nodes in a subtree evaluated by another thread */
+#define PAR_HASH_RATIO 16    /* minimal ratio of sizes of join node's inputs for a hash join */
+
+/* Ball cache constants */
+#define BALL_CACHE_ENTS 4096      /* maximal number of cached balls (a power of 2) */
+#define BALL_CACHE_VALS (1 << 22) /* maximal total number of vertices in cached balls */
+
+/* Decomposition constants */
+#define TD_MAX_PERMS      256  /* maximal number of optimal el. orderings examined for a tree decomposition */
+#define TD_PAR_LAYER      4096 /* minimal number of subsets of a layer of the treewidth DP split among threads */
+#define TD_HEUR_RESTARTS  48   /* number of heuristic el. orderings (with random tie-breaking) examined */
+#define TD_EXACT_VERTICES 24   /* maximal number of vertices for the exact treewidth DP (2^n ints are needed) */
+#define TD_DEF_BUDGET     2000 /* default time budget of the exact treewidth DP in ms */
+
+/* Plan cache constants */
+#define CACHE_CANON_LEAVES 4096 /* maximal number of labellings examined for the canonical form of F_GRAPH */
+
+/* Query server constants */
+#define SRV_QUERY_LEN  4096 /* maximal length of a query line */
+#define SRV_MAX_ARGS   64   /* maximal number of arguments of a query */
+#define SRV_BACKLOG    64   /* maximal number of queries waiting for a worker */
+
+/* Batch constants */
+#define BATCH_SHARE_INTR 1 /* minimal number of introduce nodes in a subtree shared among patterns */
+#define SHARE_SORT_RECS  (1 << 16) /* number of records of a shared DP table sorted at once when its columns are reordered */
 
 /* Test constants */
 #define TEST_OK        0
 #define TEST_NOK       1
 
-/* Own data types */
+/* Own data types -- width of umask is chosen at compile time (see MASK in Makefile),
+   so that small patterns keep the 32-bit one */
+#ifndef UMASK_BITS
+  #define UMASK_BITS 32
+#endif
+#if UMASK_BITS == 32
 typedef u32 umask;
-#define EMPTY_MASK 0U
+#elif UMASK_BITS == 64
+typedef u64 umask;
+#elif UMASK_BITS == 128
+typedef unsigned __int128 umask;
+#else
+  #error "UMASK_BITS has to be 32, 64 or 128"
+#endif
+#define EMPTY_MASK ((umask)0)
+#define MASK_WORDS (UMASK_BITS / 32) /* number of u32 words of umask */
 
 /* Own structures */
 typedef struct tree_dec_node_struct      TREE_DEC_NODE;
@@ -48,7 +96,11 @@ typedef struct nice_tree_dec_struct      NICE_TREE_DEC;
 typedef struct graph_struct              GRAPH;
 typedef struct graph_result_struct       GRAPH_RESULT;
 typedef struct graph_result_array_struct GRAPH_RESULT_ARRAY;
+typedef struct graph_result_mem_struct   GRAPH_RESULT_MEM;
 typedef struct resbuf_struct             RESBUF;
+typedef struct sched_task_struct         SCHED_TASK;
+typedef struct subiso_plan_struct        SUBISO_PLAN;
+typedef struct subiso_pattern_struct     SUBISO_PATTERN;
 /* libucw struktures */
 typedef struct fastbuf                   FASTBUF;
 
@@ -58,6 +110,15 @@ extern GRAPH         * F_GRAPH;
 extern int             SEED;
 extern int           * COLOUR;
 extern int           * F_ECC;
+extern int           * F_COMP;
+extern u64          ** F_CAND;
+extern umask        * F_LESS;
+extern int             THR_CNT;
+extern u64             MEM_LIMIT; /* -m, memory accounted by resbuf (0 for unlimited) */
+extern int             SAMPLE_CNT;
+extern int             TD_BUDGET;
+extern const char    * CACHE_DIR;
+extern int             RES_LIMIT;
 
 /* Time and memory measurement */
 extern double          A_TIME;
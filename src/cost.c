@@ -0,0 +1,111 @@
+/*
+ *	Subgraph Isomorphism - Cost model
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "cost.h"
+#include "filter.h"
+#include "graph.h"
+#include "array.h"
+#include "util.h"
+
+/* Statistics of G_GRAPH -- number of vertices, mean and excess degree, density
+   and transitivity (probability that a path of length two is closed) */
+static double g_n, g_deg, g_exc, g_dens, g_trans;
+/* Adjacency of F_GRAPH in form of bitmasks and numbers of candidates of its vertices */
+static umask  f_adj[MAX_F_VERTICES];
+static double f_cand[MAX_F_VERTICES];
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: cost_g_init
+ *-------------------------------------------------------------------------*/
+void cost_g_init (void)
+{
+  int * deg = graph_deg(G_GRAPH), * tri = graph_tri(G_GRAPH);
+  double d1 = 0, d2 = 0, t = 0, paths = 0;
+  for (int i = 0; i < G_GRAPH->n_cnt; i++)
+  {
+    d1 += deg[i];
+    d2 += (double)deg[i] * deg[i];
+    t += tri[i];
+    paths += (double)deg[i] * (deg[i] - 1) / 2;
+  }
+  g_n = G_GRAPH->n_cnt;
+  g_deg = d1 / g_n;
+  g_exc = (d1 ? d2 / d1 - 1 : 0);
+  g_dens = (g_n > 1 ? g_deg / (g_n - 1) : 0);
+  g_trans = (paths ? t / paths : 0); /* Each triangle closes three paths and is counted at three vertices */
+  ARR_FREE(deg);
+  ARR_FREE(tri);
+  DBG("COST: n = %.0f, deg = %.2f, exc = %.2f, trans = %.4f", g_n, g_deg, g_exc, g_trans);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: cost_init
+ *-------------------------------------------------------------------------*/
+void cost_init (void)
+{
+  for (int u = 0; u < F_GRAPH->n_cnt; u++)
+  {
+    f_adj[u] = EMPTY_MASK;
+    FOR_ADJ(F_GRAPH->edges[u], node)
+    {
+      f_adj[u] = SET_BIT(f_adj[u], node->key);
+    }
+    FOR_ADJ_END;
+    f_cand[u] = 0;
+    for (int i = 0; i < ARR_LEN(F_CAND[u]); i++) f_cand[u] += __builtin_popcountll(F_CAND[u][i]);
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: cost_bag
+ *-------------------------------------------------------------------------*/
+double cost_bag (umask bag)
+{
+  double res = 1;
+  int k = 0;
+  for (umask rest = bag; rest; )
+  {
+    /* Component of the bag grown from its vertex with fewest candidates */
+    int root = MASK_CTZ(rest);
+    for (umask T = rest; T; T &= T - 1) if (f_cand[MASK_CTZ(T)] < f_cand[root]) root = MASK_CTZ(T);
+    umask comp = SET_BIT(EMPTY_MASK, root), front = comp;
+    int kc = 1;
+    res *= f_cand[root];
+    while (front)
+    {
+      umask next = EMPTY_MASK;
+      for (umask T = front; T; T &= T - 1)
+      {
+        int v = MASK_CTZ(T);
+        for (umask N = f_adj[v] & bag & ~comp & ~next; N; N &= N - 1)
+        {
+          int w = MASK_CTZ(N);
+          res *= (kc++ == 1 ? g_deg : g_exc) * f_cand[w] / g_n;
+          /* Other edges to the already grown part of the component */
+          for (umask E = f_adj[w] & (comp | next) & ~SET_BIT(EMPTY_MASK, v); E; E &= E - 1)
+          {
+            res *= ((f_adj[MASK_CTZ(E)] & f_adj[w] & (comp | next)) ? g_trans : g_dens);
+          }
+          next = SET_BIT(next, w);
+        }
+      }
+      comp |= next;
+      front = next;
+    }
+    k += kc;
+    rest &= ~comp;
+  }
+  /* Only colourful mappings are kept */
+  for (int i = 0; i < k; i++) res *= (double)(F_GRAPH->n_cnt - i) / F_GRAPH->n_cnt;
+  return res;
+}
@@ -0,0 +1,53 @@
+/*
+ *	Subgraph Isomorphism - Cost model
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __COST_H__
+#define __COST_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: cost_g_init
+ * -------------------------
+ * Collects statistics of G_GRAPH (number of vertices, the first two moments
+ * of degrees, density and transitivity) for estimates of sizes of DP tables.
+ */
+void   cost_g_init (void);
+
+/* -------------------------
+ * Function: cost_init
+ * -------------------------
+ * Collects numbers of candidates of vertices of F_GRAPH (see filter_init)
+ * for estimates of sizes of DP tables.
+ */
+void   cost_init (void);
+
+/* -------------------------
+ * Function: cost_bag
+ * -------------------------
+ * Estimates the number of records of a DP table of a node with a given bag,
+ * i.e. the expected number of colourful mappings of the subgraph of F_GRAPH
+ * induced by the bag. Each connected component starts at its vertex with
+ * fewest candidates, spanning tree edges are extended by the mean (first edge)
+ * or excess (following edges) degree of G_GRAPH, other edges are closed
+ * with probability given by transitivity (if they close a triangle) or density.
+ * 
+ * Params:
+ *   bag - bitmask of vertices of F_GRAPH
+ *
+ * Returns:
+ *   Estimated number of records
+ */
+double cost_bag  (umask bag);
+
+#endif /* __COST_H__ */
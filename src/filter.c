@@ -0,0 +1,218 @@
+/*
+ *	Subgraph Isomorphism - Candidate filters
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "filter.h"
+#include "graph.h"
+#include "array.h"
+#include "util.h"
+#include <string.h>
+
+/* Libucw int sorter defines */
+#define ASORT_PREFIX(X) intarr_##X
+#define ASORT_KEY_TYPE  int
+#include <ucw/sorter/array-simple.h>
+
+u64 ** F_CAND;
+
+/* Degrees, sorted degrees of neighbours and numbers of triangles of vertices of G_GRAPH */
+static int * deg_g, ** nd_g, * tri_g;
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: get_nbr_deg
+ *---------------------------------------------------------------------------
+ * Computes ascendingly sorted degrees of neighbours of all vertices of a graph
+ *
+ * Params:
+ *   g   - used graph
+ *   deg - degrees of vertices of g
+ *
+ * Returns:
+ *   Array of arrays of degrees of neighbours
+ */
+static int ** get_nbr_deg (GRAPH * g, int * deg)
+{
+  int ** nd;
+  ARR_ALLOC(nd, g->n_cnt);
+  for (int i = 0; i < g->n_cnt; i++)
+  {
+    ARR_ALLOC(nd[i], deg[i]);
+    int j = 0;
+    FOR_ADJ(g->edges[i], node)
+    {
+      nd[i][j++] = deg[node->key];
+    }
+    FOR_ADJ_END;
+    intarr_sort(nd[i], deg[i]);
+  }
+  return nd;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: nbr_deg_dominates
+ *---------------------------------------------------------------------------
+ * Checks whether the k-th largest degree of a neighbour of a vertex of G_GRAPH
+ * is at least the k-th largest one of a vertex of F_GRAPH for all k
+ *
+ * Params:
+ *   nd_g - sorted degrees of neighbours of the vertex of G_GRAPH
+ *   nd_f - sorted degrees of neighbours of the vertex of F_GRAPH
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int nbr_deg_dominates (int * nd_g, int * nd_f)
+{
+  int lg = ARR_LEN(nd_g), lf = ARR_LEN(nd_f);
+  if (lg < lf) return 0;
+  for (int k = 1; k <= lf; k++) if (nd_g[lg - k] < nd_f[lf - k]) return 0;
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: has_cand_nbr
+ *---------------------------------------------------------------------------
+ * Checks whether vertex v of G_GRAPH has a neighbour, which is a candidate
+ * for vertex w of F_GRAPH
+ *
+ * Params:
+ *   w - vertex of F_GRAPH
+ *   v - vertex of G_GRAPH
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int has_cand_nbr (int w, int v)
+{
+  FOR_ADJ(G_GRAPH->edges[v], node)
+  {
+    if (IS_CAND(w, node->key)) return 1;
+  }
+  FOR_ADJ_END;
+  return 0;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: arc_consistent
+ *---------------------------------------------------------------------------
+ * Checks whether every neighbour of vertex u of F_GRAPH has a candidate among
+ * neighbours of vertex v of G_GRAPH
+ *
+ * Params:
+ *   u - vertex of F_GRAPH
+ *   v - vertex of G_GRAPH
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int arc_consistent (int u, int v)
+{
+  FOR_ADJ(F_GRAPH->edges[u], node)
+  {
+    if (!has_cand_nbr(node->key, v)) return 0;
+  }
+  FOR_ADJ_END;
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: free_nbr_deg
+ *---------------------------------------------------------------------------
+ * Frees arrays computed by function 'get_nbr_deg'
+ *
+ * Params:
+ *   nd - array of arrays of degrees of neighbours
+ */
+static void free_nbr_deg (int ** nd)
+{
+  for (int i = 0; i < ARR_LEN(nd); i++) ARR_FREE(nd[i]);
+  ARR_FREE(nd);
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: filter_g_init
+ *-------------------------------------------------------------------------*/
+void filter_g_init (void)
+{
+  deg_g = graph_deg(G_GRAPH);
+  nd_g = get_nbr_deg(G_GRAPH, deg_g);
+  tri_g = graph_tri(G_GRAPH);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: filter_init
+ *-------------------------------------------------------------------------*/
+void filter_init (void)
+{
+  int * deg_f = graph_deg(F_GRAPH), ** nd_f = get_nbr_deg(F_GRAPH, deg_f), * tri_f = graph_tri(F_GRAPH);
+  int w_cnt = (G_GRAPH->n_cnt + 63) >> 6;
+
+  /* Local filters */
+  ARR_ALLOC(F_CAND, F_GRAPH->n_cnt);
+  for (int u = 0; u < F_GRAPH->n_cnt; u++)
+  {
+    ARR_ALLOC(F_CAND[u], w_cnt);
+    memset(F_CAND[u], 0, w_cnt * sizeof(**F_CAND));
+    for (int v = 0; v < G_GRAPH->n_cnt; v++)
+    {
+      if (deg_g[v] < deg_f[u] || tri_g[v] < tri_f[u] || !nbr_deg_dominates(nd_g[v], nd_f[u])) continue;
+      F_CAND[u][v >> 6] |= 1ULL << (v & 63);
+    }
+  }
+  /* Arc consistency refinement */
+  for (int changed = 1; changed; )
+  {
+    changed = 0;
+    for (int u = 0; u < F_GRAPH->n_cnt; u++)
+    {
+      for (int v = 0; v < G_GRAPH->n_cnt; v++)
+      {
+        if (IS_CAND(u, v) && !arc_consistent(u, v))
+        {
+          F_CAND[u][v >> 6] &= ~(1ULL << (v & 63));
+          changed = 1;
+        }
+      }
+    }
+  }
+#ifdef LOCAL_DEBUG
+  int total = 0;
+  for (int u = 0; u < F_GRAPH->n_cnt; u++) for (int i = 0; i < w_cnt; i++) total += __builtin_popcountll(F_CAND[u][i]);
+  DBG("CANDIDATES = %d of %d", total, F_GRAPH->n_cnt * G_GRAPH->n_cnt);
+#endif
+
+  ARR_FREE(deg_f);
+  free_nbr_deg(nd_f);
+  ARR_FREE(tri_f);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: filter_free
+ *-------------------------------------------------------------------------*/
+void filter_free (void)
+{
+  if (deg_g)
+  {
+    ARR_FREE(deg_g);
+    free_nbr_deg(nd_g);
+    ARR_FREE(tri_g);
+    deg_g = NULL;
+  }
+  if (!F_CAND) return;
+  for (int u = 0; u < ARR_LEN(F_CAND); u++) ARR_FREE(F_CAND[u]);
+  ARR_FREE(F_CAND);
+  F_CAND = NULL;
+}
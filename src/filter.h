@@ -0,0 +1,61 @@
+/*
+ *	Subgraph Isomorphism - Candidate filters
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Macro: IS_CAND
+ * -------------------------
+ * Checks whether vertex v of G_GRAPH is a candidate for vertex u of F_GRAPH
+ *
+ * Params:
+ *   u - vertex of F_GRAPH
+ *   v - vertex of G_GRAPH
+ */
+#define IS_CAND(u, v) ((F_CAND[(u)][(v) >> 6] >> ((v) & 63)) & 1)
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: filter_g_init
+ * -------------------------
+ * Computes properties of vertices of G_GRAPH used by filter_init (degrees,
+ * sorted degrees of neighbours and numbers of triangles). They depend only
+ * on G_GRAPH, so they are shared by all patterns searched in it.
+ */
+void filter_g_init (void);
+
+/* -------------------------
+ * Function: filter_init
+ * -------------------------
+ * Computes candidate bitmaps F_CAND of all vertices of F_GRAPH. Vertex v of
+ * G_GRAPH stays a candidate for vertex u of F_GRAPH if it has at least
+ * the degree, the sorted degrees of neighbours and the number of triangles
+ * of u, and if every neighbour of u has a candidate among neighbours
+ * of v (arc consistency, refined until no candidate is removed).
+ */
+void filter_init (void);
+
+/* -------------------------
+ * Function: filter_free
+ * -------------------------
+ * Frees candidate bitmaps F_CAND and properties of vertices of G_GRAPH.
+ */
+void filter_free (void);
+
+#endif /* __FILTER_H__ */
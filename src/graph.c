@@ -17,6 +17,7 @@
 GRAPH * G_GRAPH;
 GRAPH * F_GRAPH;
 int   * F_ECC;
+int   * F_COMP;
 
 
 /****************************************************************************
@@ -33,7 +34,8 @@ GRAPH * graph_load (const char * f_name, int max_v)
   fscanf(in_f, "%d", &(tmp->n_cnt));
   if (tmp->n_cnt > max_v)
   {
-    graph_free(tmp);
+    fclose(in_f);
+    xfree(tmp);
     return NULL;
   }
   /* Load adjacency lists from input file */
@@ -56,20 +58,41 @@ GRAPH * graph_load (const char * f_name, int max_v)
 }
 
 /*---------------------------------------------------------------------------
- * Function: graph_clone
+ * Function: graph_init
  *-------------------------------------------------------------------------*/ 
-GRAPH * graph_clone (GRAPH * g)
+GRAPH * graph_init (int n_cnt)
 {
   GRAPH * tmp = (GRAPH *)xmalloc(sizeof(*tmp));
-  tmp->n_cnt = g->n_cnt;
+  tmp->n_cnt = n_cnt;
   ARR_ALLOC(tmp->edges, tmp->n_cnt);
   for (int i = 0; i < tmp->n_cnt; i++) 
   {
     tmp->edges[i] = (ADJ_TABLE *)xmalloc(sizeof(**tmp->edges));
     table_adj_init(tmp->edges[i]);
+  }
+  return tmp;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: graph_clone
+ *-------------------------------------------------------------------------*/ 
+GRAPH * graph_clone (GRAPH * g)
+{
+  return graph_relabel(g, NULL);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: graph_relabel
+ *-------------------------------------------------------------------------*/ 
+GRAPH * graph_relabel (GRAPH * g, int * lab)
+{
+  GRAPH * tmp = graph_init(g->n_cnt);
+  for (int i = 0; i < tmp->n_cnt; i++) 
+  {
     FOR_ADJ(g->edges[i], node)
     {
-      table_adj_new(tmp->edges[i], node->key);
+      if (lab) table_adj_new(tmp->edges[lab[i]], lab[node->key]);
+      else table_adj_new(tmp->edges[i], node->key);
     }
     FOR_ADJ_END;
   }
@@ -108,6 +131,64 @@ int graph_is_adj (GRAPH * g, int from, int to)
   return 1;
 }
 
+/*---------------------------------------------------------------------------
+ * Function: graph_deg
+ *-------------------------------------------------------------------------*/
+int * graph_deg (GRAPH * g)
+{
+  int * deg;
+  ARR_ALLOC(deg, g->n_cnt);
+  for (int i = 0; i < g->n_cnt; i++)
+  {
+    deg[i] = 0;
+    FOR_ADJ(g->edges[i], node)
+    {
+      ++deg[i];
+    }
+    FOR_ADJ_END;
+  }
+  return deg;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: graph_tri
+ *-------------------------------------------------------------------------*/
+int * graph_tri (GRAPH * g)
+{
+  int * tri, * mark;
+  ARR_ALLOC(tri, g->n_cnt);
+  ARR_ALLOC(mark, g->n_cnt);
+  memset(tri, 0, g->n_cnt * sizeof(*tri));
+  for (int i = 0; i < g->n_cnt; i++) mark[i] = -1;
+  for (int v = 0; v < g->n_cnt; v++)
+  {
+    FOR_ADJ(g->edges[v], node)
+    {
+      mark[node->key] = v;
+    }
+    FOR_ADJ_END;
+    FOR_ADJ(g->edges[v], node1)
+    {
+      int w = node1->key;
+      if (w <= v) continue;
+      FOR_ADJ(g->edges[w], node2)
+      {
+        int x = node2->key;
+        if (x > w && mark[x] == v)
+        {
+          ++tri[v];
+          ++tri[w];
+          ++tri[x];
+        }
+      }
+      FOR_ADJ_END;
+    }
+    FOR_ADJ_END;
+  }
+  ARR_FREE(mark);
+  return tri;
+}
+
 /*---------------------------------------------------------------------------
  * Function: graph_pre_f_ecc
  *-------------------------------------------------------------------------*/ 
@@ -116,6 +197,7 @@ void graph_pre_f_ecc (void)
   int * q, qh, qt, * d;
   
   ARR_ALLOC(F_ECC, F_GRAPH->n_cnt);
+  ARR_ALLOC(F_COMP, F_GRAPH->n_cnt);
   ARR_ALLOC(q, F_GRAPH->n_cnt);
   ARR_ALLOC(d, F_GRAPH->n_cnt);
   for (int i = 0; i < ARR_LEN(F_ECC); i++) F_ECC[i] = 0;
@@ -141,6 +223,8 @@ void graph_pre_f_ecc (void)
       FOR_ADJ_END;
     }
     for (int j = 0; j < F_GRAPH->n_cnt; j++) F_ECC[i] = MAX(F_ECC[i], d[j]);
+    /* Component is identified by its lowest vertex */
+    for (F_COMP[i] = 0; d[F_COMP[i]] < 0; F_COMP[i]++);
   }
   
   ARR_FREE(q);
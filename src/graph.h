@@ -67,6 +67,19 @@ struct graph_struct
  */
 GRAPH * graph_load   (const char * fname, int maxv);
 
+/* -------------------------
+ * Function: graph_init
+ * -------------------------
+ * Creates a graph without edges.
+ * 
+ * Params:
+ *   n_cnt - number of vertices
+ *
+ * Returns:
+ *   Pointer to the newly created graph
+ */
+GRAPH * graph_init   (int n_cnt);
+
 /* -------------------------
  * Function: graph_clone
  * -------------------------
@@ -80,6 +93,20 @@ GRAPH * graph_load   (const char * fname, int maxv);
  */
 GRAPH * graph_clone  (GRAPH * g);
 
+/* -------------------------
+ * Function: graph_relabel
+ * -------------------------
+ * Creates a copy of the given graph with relabeled vertices
+ * 
+ * Params:
+ *   g   - graph to be copied
+ *   lab - new labels of vertices (NULL for a plain copy)
+ *
+ * Returns:
+ *   Pointer to the new graph
+ */
+GRAPH * graph_relabel (GRAPH * g, int * lab);
+
 /* -------------------------
  * Function: graph_free
  * -------------------------
@@ -117,10 +144,38 @@ void    graph_add_edge (GRAPH * g, int from, int to);
  */
 int     graph_is_adj (GRAPH * g, int from, int to);
 
+/* -------------------------
+ * Function: graph_deg
+ * -------------------------
+ * Computes degrees of all vertices of a graph
+ * 
+ * Params:
+ *   g    - pointer to the corresponding graph
+ *
+ * Returns:
+ *   Array of degrees
+ */
+int *   graph_deg (GRAPH * g);
+
+/* -------------------------
+ * Function: graph_tri
+ * -------------------------
+ * Computes numbers of triangles containing individual vertices of a graph.
+ * Each triangle is found once -- from its lowest vertex over its middle one.
+ * 
+ * Params:
+ *   g    - pointer to the corresponding graph
+ *
+ * Returns:
+ *   Array of numbers of triangles
+ */
+int *   graph_tri (GRAPH * g);
+
 /* -------------------------
  * Function: graph_pre_ecc
  * -------------------------
- * Precomputes eccentricity of all vertices in F_GRAPH
+ * Precomputes eccentricity (within its component) and connected component
+ * of all vertices in F_GRAPH
  * 
  */
 void    graph_pre_f_ecc (void);
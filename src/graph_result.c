@@ -75,6 +75,13 @@ GRESULT_TABLE * result_mem;
 /* Sort buffer for uniquing results */
 int           * sort_buf;
 
+/* Detached global memory (see graph_result_glmemory_save) */
+struct graph_result_mem_struct
+{
+  GRESULT_TABLE * result_mem;
+  int           * sort_buf;
+};
+
 /* Libucw sorter defines */
 #define ASORT_PREFIX(X) intarr_##X
 #define ASORT_KEY_TYPE  int
@@ -112,17 +119,22 @@ void graph_result_glmemory_init (GRAPH * g)
  *-------------------------------------------------------------------------*/
 void graph_result_glmemory_add (GRAPH_RESULT ** gra)
 {
-  for (int i = 0; i < ARR_LEN(gra); i++)
-  {
-    memcpy(sort_buf, gra[i]->mapping, gra[i]->g->n_cnt * sizeof(*gra[i]->mapping));
-    intarr_sort(sort_buf, ARR_LEN(sort_buf));
-    gresult_table_node * node = table_gresult_lookup(result_mem, sort_buf);
-    if (!node->val) node->val = gra[i];
-    else graph_result_free(gra[i]);
-  }
+  for (int i = 0; i < ARR_LEN(gra); i++) graph_result_glmemory_push(gra[i]);
   ARR_FREE(gra);
 }
 
+/*---------------------------------------------------------------------------
+ * Function: graph_result_glmemory_push
+ *-------------------------------------------------------------------------*/
+void graph_result_glmemory_push (GRAPH_RESULT * gr)
+{
+  memcpy(sort_buf, gr->mapping, gr->g->n_cnt * sizeof(*gr->mapping));
+  intarr_sort(sort_buf, ARR_LEN(sort_buf));
+  gresult_table_node * node = table_gresult_lookup(result_mem, sort_buf);
+  if (!node->val) node->val = gr;
+  else graph_result_free(gr);
+}
+
 /*---------------------------------------------------------------------------
  * Function: graph_result_glmemory_reconstruct
  *-------------------------------------------------------------------------*/
@@ -150,6 +162,29 @@ int graph_result_glmemory_size (void)
   return result_mem->hash_count;
 }
 
+/*---------------------------------------------------------------------------
+ * Function: graph_result_glmemory_save
+ *-------------------------------------------------------------------------*/
+GRAPH_RESULT_MEM * graph_result_glmemory_save (void)
+{
+  GRAPH_RESULT_MEM * mem = (GRAPH_RESULT_MEM *)xmalloc(sizeof(*mem));
+  mem->result_mem = result_mem;
+  mem->sort_buf = sort_buf;
+  result_mem = NULL;
+  sort_buf = NULL;
+  return mem;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: graph_result_glmemory_restore
+ *-------------------------------------------------------------------------*/
+void graph_result_glmemory_restore (GRAPH_RESULT_MEM * mem)
+{
+  result_mem = mem->result_mem;
+  sort_buf = mem->sort_buf;
+  xfree(mem);
+}
+
 /*---------------------------------------------------------------------------
  * Function: graph_result_free 
  *-------------------------------------------------------------------------*/ 
@@ -66,6 +66,17 @@ void             graph_result_glmemory_init (GRAPH * g);
  */
 void            graph_result_glmemory_add (GRAPH_RESULT ** gra);
 
+/* -------------------------
+ * Function: graph_result_glmemory_push
+ * -------------------------
+ * Puts a single graph result into global results memory unless a result with
+ * the same vertices is already there (then it is freed)
+ * 
+ * Params:
+ *   gr - graph result
+ */
+void            graph_result_glmemory_push (GRAPH_RESULT * gr);
+
 /* -------------------------
  * Function: graph_result_glmemory_reconstruct
  * -------------------------
@@ -94,6 +105,28 @@ GRAPH_RESULT ** graph_result_glmemory_reconstruct (void);
 
 int             graph_result_glmemory_size (void);
 
+/* -------------------------
+ * Function: graph_result_glmemory_save
+ * -------------------------
+ * Detaches global memory, so that another one can be initialized (e.g. for
+ * another pattern of a batch)
+ * 
+ * Returns:
+ *   Detached global memory
+ */
+GRAPH_RESULT_MEM * graph_result_glmemory_save (void);
+
+/* -------------------------
+ * Function: graph_result_glmemory_restore
+ * -------------------------
+ * Makes a detached global memory global again (the current one has to be
+ * detached or reconstructed before)
+ * 
+ * Params:
+ *   mem - memory returned by graph_result_glmemory_save
+ */
+void            graph_result_glmemory_restore (GRAPH_RESULT_MEM * mem);
+
 /* -------------------------
  * Function: graph_result_free 
  * -------------------------
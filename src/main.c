@@ -12,44 +12,157 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <unistd.h>
+#include <limits.h>
 #include "common.h"
 #include "tree_dec.h"
 #include "nice_tree_dec.h"
 #include "util.h"
+#include "filter.h"
+#include "aut.h"
+#include "cost.h"
+#include "cache.h"
+#include "server.h"
+#include "batch.h"
 #include "graph.h"
 #include "graph_result.h"
 #include "subiso.h"
 #include "resbuf.h"
 #include "array.h"
 #include "tests.h"
+#include "sched.h"
 #include <ucw/fastbuf.h>
 #include <ucw/varint.h>
 
 int      SEED;
+int   THR_CNT;
+u64 MEM_LIMIT;
+int SAMPLE_CNT;
+int TD_BUDGET = TD_DEF_BUDGET;
+int RES_LIMIT;
 double A_TIME;
 
-int main (int argc, char * argv [])
+/* Socket and number of workers of the query server (see server_run) */
+static char * srv_path;
+static int    srv_workers = 1;
+/* File with names of patterns of a batch (see batch_run) */
+static char * batch_list;
+
+/*---------------------------------------------------------------------------
+ * Function: exec_wide
+ *---------------------------------------------------------------------------
+ * Runs the program again by a build with wider masks (grs64, grs128 next
+ * to this binary, see MASK in Makefile), since the pattern does not fit.
+ *
+ * Params:
+ *   argv - arguments of the program
+ */
+static void exec_wide (char * argv [])
 {
-  int rep_cnt = -1;
-  SEED = time(NULL);
-  
-  if (argc < 3)
+  char path[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 8);
+  if (len > 0)
   {
-    fprintf(stderr, "Usage: ./grs <graph_big> <graph_pattern> [seed] [iteration count]\n");
-    force_exit();
+    path[len] = 0;
+    char * base = strrchr(path, '/') + 1;
+    for (int bits = 2 * UMASK_BITS; bits <= 128; bits *= 2)
+    {
+      sprintf(base, "grs%d", bits);
+      execv(path, argv); /* Returns only if there is no such build */
+    }
+  }
+  fprintf(stderr, "Pattern has more than %d vertices, wider builds are made by 'make wide'\n", MAX_F_VERTICES);
+  force_exit();
+}
+
+/*---------------------------------------------------------------------------
+ * Function: parse_opts
+ *---------------------------------------------------------------------------
+ * Parses options of the program (or of a query of the server)
+ *
+ * Params:
+ *   argc - number of arguments
+ *   argv - arguments (argv[0] is the program name)
+ *
+ * Returns:
+ *   1 on success, 0 if an unknown option was given
+ */
+static int parse_opts (int argc, char * argv [])
+{
+  int ok = 1, opt;
+  optind = 0; /* Full reinitialization of getopt, queries are parsed repeatedly */
+  while ((opt = getopt(argc, argv, "t:m:s:d:c:l:S:w:b:")) >= 0)
+  {
+    switch (opt)
+    {
+      case 't':
+        THR_CNT = atoi(optarg);
+        break;
+      case 'm':
+        MEM_LIMIT = (u64)atoi(optarg) << 20;
+        break;
+      case 's':
+        SAMPLE_CNT = atoi(optarg);
+        break;
+      case 'd':
+        TD_BUDGET = atoi(optarg);
+        break;
+      case 'c':
+        CACHE_DIR = optarg;
+        break;
+      case 'l':
+        RES_LIMIT = atoi(optarg);
+        break;
+      case 'S':
+        srv_path = optarg;
+        break;
+      case 'w':
+        srv_workers = atoi(optarg);
+        break;
+      case 'b':
+        batch_list = optarg;
+        break;
+      default:
+        ok = 0;
+        break;
+    }
   }
-  if (argc >= 4)
+  return ok;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: run_query
+ *---------------------------------------------------------------------------
+ * Searches F_GRAPH in G_GRAPH and prints found subgraphs
+ *
+ * Params:
+ *   argc - number of arguments
+ *   argv - arguments <graph_pattern> [seed] [iteration count]
+ */
+static void run_query (int argc, char * argv [])
+{
+  int rep_cnt = -1;
+  if (argc >= 2)
   {
-    SEED = atoi(argv[3]);
-    if (argc >= 5) rep_cnt = atoi(argv[4]);
+    SEED = atoi(argv[1]);
+    if (argc >= 3) rep_cnt = atoi(argv[2]);
   }
-  
-  G_GRAPH = graph_load(argv[1], MAX_G_VERTICES);
-  F_GRAPH = graph_load(argv[2], MAX_F_VERTICES);
+
+  sched_init(THR_CNT);
   graph_pre_f_ecc();
+  filter_init();
+  cost_init();
+  cache_init();
   GRAPH * tmp_f = graph_clone(F_GRAPH);
-  TREE_DEC * ftd = td_get(tmp_f);
+  TREE_DEC * ftd = cache_load();
+  if (!ftd)
+  {
+    aut_init();
+    ftd = td_get(tmp_f);
+    cache_store(ftd);
+  }
   NICE_TREE_DEC * nftd = ntd_get(ftd);
+  subiso_plan(nftd);
 
 #ifdef LOCAL_DEBUG
   DBG_PRINT("%s\n", "Graph G:");
@@ -64,13 +177,13 @@ int main (int argc, char * argv [])
   if (rep_cnt < 0)
   {
     rep_cnt = 1;
-    for (int i = 0; i < F_GRAPH->n_cnt; i++) rep_cnt *= 3; 
+    for (int i = 0; i < F_GRAPH->n_cnt && rep_cnt <= INT_MAX / 3; i++) rep_cnt *= 3; 
   }
   
   clock_t start = clock();
-  GRAPH_RESULT ** result = subiso_run(nftd, rep_cnt);
+  GRAPH_RESULT ** result = subiso_run(nftd, &rep_cnt);
   clock_t end = clock();
-  for (int i = 0; i < ARR_LEN(result); i++) graph_result_print(result[i]);
+  for (int i = 0; i < ARR_LEN(result) && (!RES_LIMIT || i < RES_LIMIT); i++) graph_result_print(result[i]);
   printf(">>> UNIQUE subgraphs found after %d runs = %d <<<\n", rep_cnt, ARR_LEN(result));
   printf(">> Time = %.6f, avg time per iteration = %.6f<<\n", (end - start) / (double)CLOCKS_PER_SEC, A_TIME / (rep_cnt * (double)CLOCKS_PER_SEC));
   
@@ -78,12 +191,104 @@ int main (int argc, char * argv [])
   assert(test_tree_dec(ftd) == TEST_OK);
   assert(test_nice_tree_dec(nftd) == TEST_OK);
   assert(test_results(result) == TEST_OK);
+  assert(test_resbuf() == TEST_OK);
+  assert(test_batch_perm() == TEST_OK);
+  assert(test_iter() == TEST_OK);
+  assert(test_aut() == TEST_OK);
+  assert(test_fuse() == TEST_OK);
+  assert(test_tree_width() == TEST_OK);
+  assert(test_sample() == TEST_OK);
 #endif
   
   graph_free(tmp_f);
   td_free(ftd);
   ntd_free(nftd);
   graph_result_array_free(result);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: serve_query
+ *---------------------------------------------------------------------------
+ * Answers a query of the server -- options of the program (without those
+ * given to the server, which are kept) followed by <graph_pattern> [seed]
+ * [iteration count]
+ *
+ * Params:
+ *   argc - number of arguments
+ *   argv - arguments (argv[0] is the program name)
+ */
+static void serve_query (int argc, char * argv [])
+{
+  SEED = time(NULL);
+  if (!parse_opts(argc, argv) || argc - optind < 1)
+  {
+    printf("Usage: [-t threads] [-m memory budget in MB] [-s samples per iteration] [-d decomposition time budget in ms] [-c plan cache directory] [-l result limit] <graph_pattern> [seed] [iteration count]\n");
+    return;
+  }
+  argc -= optind;
+  argv += optind;
+  if (access(argv[0], R_OK))
+  {
+    printf("Cannot read pattern %s\n", argv[0]);
+    return;
+  }
+  F_GRAPH = graph_load(argv[0], MAX_F_VERTICES);
+  if (!F_GRAPH)
+  {
+    printf("Pattern has more than %d vertices, it is answered by a server of a wider build (see 'make wide')\n", MAX_F_VERTICES);
+    return;
+  }
+  run_query(argc, argv);
+}
+
+int main (int argc, char * argv [])
+{
+  char ** args = argv;
+  SEED = time(NULL);
+  THR_CNT = sysconf(_SC_NPROCESSORS_ONLN);
+  
+  int ok = parse_opts(argc, argv);
+  argc -= optind;
+  argv += optind;
+  if (!ok || argc < (srv_path || batch_list ? 1 : 2))
+  {
+    fprintf(stderr, "Usage: ./grs [-t threads] [-m memory budget in MB] [-s samples per iteration] [-d decomposition time budget in ms] [-c plan cache directory] [-l result limit] <graph_big> <graph_pattern> [seed] [iteration count]\n");
+    fprintf(stderr, "       ./grs -S socket [-w concurrent queries] [options as above] <graph_big>\n");
+    fprintf(stderr, "       ./grs -b pattern list [options as above] <graph_big> [seed] [iteration count]\n");
+    fprintf(stderr, "The memory budget bounds tables of results (moved to temporary files beyond it), their indices,\n"
+                    "decoded records of reconstruction and hash joins, not the working set of a single group of records.\n");
+    force_exit();
+  }
+  
+  if (srv_path)
+  {
+    G_GRAPH = graph_load(argv[0], MAX_G_VERTICES);
+    filter_g_init();
+    cost_g_init();
+    server_run(srv_path, srv_workers, serve_query);
+  }
+  if (batch_list)
+  {
+    int rep_cnt = -1;
+    if (argc >= 2)
+    {
+      SEED = atoi(argv[1]);
+      if (argc >= 3) rep_cnt = atoi(argv[2]);
+    }
+    G_GRAPH = graph_load(argv[0], MAX_G_VERTICES);
+    filter_g_init();
+    cost_g_init();
+    sched_init(THR_CNT);
+    batch_run(batch_list, rep_cnt);
+    free_all();
+    return 0;
+  }
+  F_GRAPH = graph_load(argv[1], MAX_F_VERTICES);
+  if (!F_GRAPH) exec_wide(args);
+  G_GRAPH = graph_load(argv[0], MAX_G_VERTICES);
+  filter_g_init();
+  cost_g_init();
+  run_query(argc - 1, argv + 1);
   free_all();
   
   return 0;
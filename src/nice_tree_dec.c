@@ -13,6 +13,7 @@
 #include "graph.h"
 #include "array.h"
 #include "resbuf.h"
+#include "cost.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -64,6 +65,10 @@ static int ntd_preprocess (NICE_TREE_DEC * ntd, int x, int prev)
 {
   ntd->nodes[x].idx = x;
   ntd->nodes[x].rbuf = NULL;
+  ntd->nodes[x].plan = NULL;
+  ntd->nodes[x].share = NULL;
+  ntd->nodes[x].share_perm = NULL;
+  ntd->nodes[x].shared = 0;
   /* Auxilary children array */
   int * adj_ch;
   ARR_INIT(adj_ch);
@@ -71,19 +76,37 @@ static int ntd_preprocess (NICE_TREE_DEC * ntd, int x, int prev)
   {
     if (ntd->nodes[x].adj[i] != prev) ARR_PUSH(adj_ch, ntd->nodes[x].adj[i]);
   }
-  /* Precomputation of maximal number of join nodes in subtrees */
-  int maxjc, curjc, mpos;
-  maxjc = 0;
+  /* Precomputation of maximal number of join nodes in subtrees (the child with
+     more of them goes first unless the estimated peak memory decides otherwise) */
+  int maxjc, curjc, mpos, inc;
+  maxjc = inc = 0;
   mpos = -1;
   for (int i = 0; i < ARR_LEN(adj_ch); i++)
   {
     curjc = ntd_preprocess(ntd, adj_ch[i], x);
+    inc += ntd->nodes[adj_ch[i]].in_cnt;
     if (curjc >= maxjc)
     {
       maxjc = curjc;
       mpos = i;
     }
   }
+  if (ntd->nodes[x].type == INTRODUCE_NODE) ++inc;
+  ntd->nodes[x].in_cnt = inc;
+  /* Estimated sizes of tables -- the output of a node is built while its children's are held */
+  NICE_TREE_DEC_NODE * ch = ntd->nodes;
+  double est = ntd->nodes[x].est = cost_bag(ntd->nodes[x].bag);
+  if (!ARR_LEN(adj_ch)) ntd->nodes[x].peak = est;
+  else if (ARR_LEN(adj_ch) == 1) ntd->nodes[x].peak = MAX(ch[adj_ch[0]].peak, ch[adj_ch[0]].est + est);
+  else
+  {
+    /* The child evaluated first holds its output while the other one is evaluated */
+    int a = adj_ch[0], b = adj_ch[1];
+    double p_ab = MAX(MAX(ch[a].peak, ch[a].est + ch[b].peak), ch[a].est + ch[b].est + est);
+    double p_ba = MAX(MAX(ch[b].peak, ch[b].est + ch[a].peak), ch[a].est + ch[b].est + est);
+    if (p_ab != p_ba) mpos = (p_ba < p_ab);
+    ntd->nodes[x].peak = MIN(p_ab, p_ba);
+  }
   /* Creating of array with bag content from a bag content bitmask */
   ARR_INIT(ntd->nodes[x].bag_cont);
   for (int i = 0; i < MAX_F_VERTICES; i++)
@@ -109,6 +132,11 @@ static int ntd_preprocess (NICE_TREE_DEC * ntd, int x, int prev)
   else ntd->nodes[x].chng_vertex = ntd->nodes[x].chng_index = -1;
   /* Precomputation of pointers to parent/children */
   ntd->nodes[x].parent = (prev >= 0 ? &(ntd->nodes[prev]) : NULL);
+  /* Only children of forget nodes are read during reconstruction */
+  ntd->nodes[x].keep_rbuf = (prev >= 0 && ntd->nodes[prev].type == FORGET_NODE);
+  /* Chains of unary nodes are fused up to a node read by a join/forget node (or the root) */
+  ntd->nodes[x].fused = (prev >= 0 && ntd->nodes[prev].type == INTRODUCE_NODE &&
+                         (ntd->nodes[x].type == INTRODUCE_NODE || ntd->nodes[x].type == FORGET_NODE));
   ntd->nodes[x].child_1 = ntd->nodes[x].child_2 = NULL;
   if (ntd->nodes[x].type != LEAF_NODE) ntd->nodes[x].child_1 = &(ntd->nodes[adj_ch[0]]);
   if (ntd->nodes[x].type == JOIN_NODE)
@@ -122,6 +150,7 @@ static int ntd_preprocess (NICE_TREE_DEC * ntd, int x, int prev)
     }
   }
   ARR_FREE(adj_ch);
+  ntd->nodes[x].jn_cnt = maxjc;
   return maxjc;
 }
 
@@ -129,14 +158,16 @@ static int ntd_preprocess (NICE_TREE_DEC * ntd, int x, int prev)
  * Function: ntd_connect
  * -------------------------
  * Connects two ntd nodes with different bag contents by adding new
- * (introduce/forget) nodes.
+ * (introduce/forget) nodes. Bottom-up, vertices are forgotten first and then
+ * introduced in the order given by 'td_intro_order'.
  * 
  * Params:
+ *   td   - corresponding tree decomposition
  *   ntd  - corresponding nice tree decomposition
  *   from - first node
  *   to   - second node
  */
-static void ntd_connect (NICE_TREE_DEC * ntd, int from, int to)
+static void ntd_connect (TREE_DEC * td, NICE_TREE_DEC * ntd, int from, int to)
 {
   umask TS = 0, CS = ntd->nodes[from].bag;
   if (to >= 0) TS = ntd->nodes[to].bag;
@@ -144,12 +175,23 @@ static void ntd_connect (NICE_TREE_DEC * ntd, int from, int to)
   int last_node;
   umask last_bag, new_bag;
   int * new_arr;
+  int order[MAX_F_VERTICES], steps[2 * MAX_F_VERTICES], s_cnt = 0;
+  
+  /* Nodes are added top-down, i.e. in the reversed order. Disjoint bags (of
+     chained components of a disconnected graph) overlap in the first introduced
+     vertex, so that no bag is empty. */
+  int o_cnt = MASK_POP(CS & ~TS), o_first = (o_cnt && TS && !(CS & TS));
+  td_intro_order(td, CS & TS, CS & ~TS, order);
+  for (int i = o_cnt - 1; i >= o_first; i--) steps[s_cnt++] = order[i];
+  for (int i = 0; i < MAX_F_VERTICES; i++) if (GET_BIT(TS, i) && !GET_BIT(CS, i)) steps[s_cnt++] = i;
+  if (o_first) steps[s_cnt++] = order[0];
   
   last_node = from;
   last_bag = ntd->nodes[from].bag;
   
-  for (int i = 0; i < MAX_F_VERTICES; i++)
+  for (int j = 0; j < s_cnt; j++)
   {
+    int i = steps[j];
     if (GET_BIT(CS, i) && !GET_BIT(TS, i)) 
     {
       new_bag = UNSET_BIT(last_bag, i);
@@ -223,7 +265,7 @@ static void td_dfs (TREE_DEC * td, int x, int prev, NICE_TREE_DEC * ntd)
   
   if (nbg_cnt <= 1) /* Introduce/forget node - handled in ntd_connect */
   {
-    ntd_connect(ntd, x, nbg_cnt ? nbg : -1);
+    ntd_connect(td, ntd, x, nbg_cnt ? nbg : -1);
     if (nbg_cnt) td_dfs(td, nbg, x, ntd);
   }
   else /* Join node - creates full bin.tree with all adjacent nodes in leaves */
@@ -243,7 +285,7 @@ static void td_dfs (TREE_DEC * td, int x, int prev, NICE_TREE_DEC * ntd)
         {
           ARR_INIT(new_arr);
           q[q1_tail++] = tmp_node = add_nice_tree_dec_node(ntd, ntd->nodes[x].bag, new_arr, LEAF_NODE);
-          ntd_connect(ntd, tmp_node, i);
+          ntd_connect(td, ntd, tmp_node, i);
         }
       }
     }
@@ -325,11 +367,13 @@ NICE_TREE_DEC * ntd_get (TREE_DEC * td)
     add_nice_tree_dec_node(tmp, td->nodes[i].bag, new_arr, LEAF_NODE);
   }
   /* Construction */
-  td_dfs(td, 0, -1, tmp);
-  /* Dummy root forget node with an empty bag */
+  td_dfs(td, td->root, -1, tmp);
+  /* Dummy root forget node with an empty bag (over a chain of forget nodes) */
   ARR_INIT(new_arr);
-  ARR_PUSH(new_arr, 0);
-  tmp->root = add_nice_tree_dec_node(tmp, 0U, new_arr, FORGET_NODE);
+  tmp->root = add_nice_tree_dec_node(tmp, EMPTY_MASK, new_arr, FORGET_NODE);
+  ntd_connect(td, tmp, tmp->root, td->root);
+  /* Overlapping disjoint bags (see 'ntd_connect') may widen a decomposition of width 0 */
+  for (int i = 0; i < tmp->b_cnt; i++) tmp->tw = MAX(tmp->tw, MASK_POP(tmp->nodes[i].bag) - 1);
   /* Preprocessing of ntd for its later usage in algorithm */
   ntd_preprocess(tmp, tmp->root, -1);
   return tmp;
@@ -346,6 +390,8 @@ void ntd_free (NICE_TREE_DEC * ntd)
     ARR_FREE(ntd->nodes[i].adj);
     ARR_FREE(ntd->nodes[i].bag_cont);
     resbuf_free(ntd->nodes[i].rbuf);
+    xfree(ntd->nodes[i].plan);
+    ARR_FREE(ntd->nodes[i].share_perm);
   }
   ARR_FREE(ntd->nodes);
   xfree(ntd); 
@@ -378,6 +424,14 @@ void ntd_print_node (NICE_TREE_DEC_NODE * node)
   fprintf(stderr,"%p\n", node->child_1);
   fprintf(stderr,"Pre_CH2:");
   fprintf(stderr,"%p\n", node->child_2);
+  fprintf(stderr,"Pre_JN_CNT:");
+  fprintf(stderr,"%d\n", node->jn_cnt);
+  fprintf(stderr,"Pre_IN_CNT:");
+  fprintf(stderr,"%d\n", node->in_cnt);
+  fprintf(stderr,"Pre_KEEP_RBUF:");
+  fprintf(stderr,"%d\n", node->keep_rbuf);
+  fprintf(stderr,"Pre_FUSED:");
+  fprintf(stderr,"%d\n", node->fused);
 }
 
 /*---------------------------------------------------------------------------
@@ -44,8 +44,33 @@ struct nice_tree_dec_node_struct
   NICE_TREE_DEC_NODE * child_1;
   /* Pointer to the second child to be processed during the main algorithm */
   NICE_TREE_DEC_NODE * child_2;
+  /* Maximal number of join nodes on a path from this node to a leaf */
+  int                  jn_cnt;
+  /* Number of introduce nodes in this node's subtree */
+  int                  in_cnt;
+  /* Estimated number of records of this node (see cost_bag) and peak number
+     of records held at once while evaluating its subtree */
+  double               est, peak;
   /* Buffer containing DP results after bottom-up run of the main algorithm*/
   RESBUF *             rbuf;
+  /* Set if rbuf is needed after the bottom-up run (by reconstruction), otherwise
+     it is released as soon as the parent node consumes it */
+  int                  keep_rbuf;
+  /* Set if records of this introduce/forget node are passed directly to the parent
+     (introduce) node during the main algorithm, so rbuf is never filled */
+  int                  fused;
+  /* Precompiled plan of an introduce node (see subiso_plan) */
+  SUBISO_PLAN *        plan;
+  /* Node of a preceding pattern of a batch with the same DP table (see subiso_share),
+     whose buffer is read instead of evaluating this node's subtree */
+  NICE_TREE_DEC_NODE * share;
+  /* Positions in the bag of share of vertices of the bag (NULL if the table of share
+     is read as it is), records of share are then reordered, filtered and sorted
+     to rbuf when read */
+  int *                share_perm;
+  /* Set if rbuf is read by following patterns of a batch, so it is kept until
+     the end of the iteration */
+  int                  shared;
 };
 
 /* Structure representing a nice tree decomposition */
@@ -59,6 +84,9 @@ struct nice_tree_dec_struct
   int                  root;
   /* Array of ntd nodes */
   NICE_TREE_DEC_NODE * nodes;
+  /* Symmetry-breaking constraints (see F_LESS) between vertices without a common
+     bag, which are not checked by introduce nodes but by subiso_iter_next */
+  umask                less[MAX_F_VERTICES];
 };
 
 /****************************************************************************
@@ -18,57 +18,437 @@
 #include "stdlib.h"
 #include "array.h"
 #include "util.h"
+#include "svb.h"
 #include <ucw/fastbuf.h>
-#include <ucw/varint.h>
-#include <ucw/ff-binary.h>
+#include <pthread.h>
+
+/* Header of an encoded block */
+typedef struct
+{
+  u32 nrec; /* number of records */
+  u32 mlen; /* length of mappings */
+  u32 nval; /* number of encoded values */
+  u32 plen; /* length of encoded values (in bytes) */
+  u32 cpop; /* size of all color sets + 1 if stored as ranks, 0 if stored as masks */
+  u32 plcp; /* common prefix of the first record with the last one of the previous block
+               (RES_LCP_UNKNOWN if it is not known, e.g. after resbuf_append) */
+  u32 first; /* first element of the mapping of the first record (0 if mappings are empty) */
+} RES_BLK_HDR;
+
+#define RES_LCP_UNKNOWN (~0U)
+
+/* Binomial coefficients C(n, k) for n, k <= number of bits of umask */
+static umask           binom[UMASK_BITS + 1][UMASK_BITS + 1];
+static pthread_once_t  binom_once = PTHREAD_ONCE_INIT;
+
+/* Pool of growing buffers released by resbuf_free, their total capacity */
+static FASTBUF      ** pool;
+static u64             pool_mem;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Bytes held by in-memory buffers (including pooled ones) and accounted by
+   resbuf_mem_reserve and resbuf_mem_charge (compared against MEM_LIMIT) */
+static u64             mem_used;
 
 /****************************************************************************
  * STATIC FUNCTIONS
  ***************************************************************************/
 
 /* -------------------------
- * Function: encode_num
+ * Function: zigzag
+ * -------------------------
+ * Maps a signed difference to an unsigned number (small magnitudes to small
+ * numbers).
+ *
+ * Params:
+ *   x - difference of two numbers
+ */
+static inline u32 zigzag (u32 x)
+{
+  return (x << 1) ^ (u32)((int)x >> 31);
+}
+
+/* -------------------------
+ * Function: unzigzag
+ * -------------------------
+ * Inverse of zigzag.
+ *
+ * Params:
+ *   x - number returned by zigzag
+ */
+static inline u32 unzigzag (u32 x)
+{
+  return (x >> 1) ^ -(x & 1);
+}
+
+/* -------------------------
+ * Function: col_zigzag
+ * -------------------------
+ * Zigzag of a difference of two color sets (see zigzag).
+ *
+ * Params:
+ *   x - difference of two color sets
+ */
+static inline umask col_zigzag (umask x)
+{
+  return (x << 1) ^ -(x >> (UMASK_BITS - 1));
+}
+
+/* -------------------------
+ * Function: col_unzigzag
+ * -------------------------
+ * Inverse of col_zigzag.
+ *
+ * Params:
+ *   x - number returned by col_zigzag
+ */
+static inline umask col_unzigzag (umask x)
+{
+  return (x >> 1) ^ -(x & 1);
+}
+
+/* -------------------------
+ * Function: col_load
+ * -------------------------
+ * Reads a color set (or its rank) stored in a block as MASK_WORDS u32 values.
+ *
+ * Params:
+ *   p - first value of the color set
+ */
+static inline umask col_load (const u32 * p)
+{
+  umask c;
+  memcpy(&c, p, sizeof(c));
+  return c;
+}
+
+/* -------------------------
+ * Function: col_store
  * -------------------------
- * Stores a number to buffer in var. len. code along with delta compr.
+ * Stores a color set (or its rank) to a block as MASK_WORDS u32 values.
+ *
+ * Params:
+ *   p - first value of the color set
+ *   c - color set
+ */
+static inline void col_store (u32 * p, umask c)
+{
+  memcpy(p, &c, sizeof(c));
+}
+
+/* -------------------------
+ * Function: binom_init
+ * -------------------------
+ * Precomputes Pascal's triangle of binomial coefficients.
+ */
+static void binom_init (void)
+{
+  for (int n = 0; n <= UMASK_BITS; n++)
+  {
+    binom[n][0] = 1;
+    for (int k = 1; k <= n; k++) binom[n][k] = binom[n - 1][k - 1] + (k < n ? binom[n - 1][k] : 0);
+  }
+}
+
+/* -------------------------
+ * Function: col_rank
+ * -------------------------
+ * Returns rank of a color set among all sets of the same size in the
+ * combinatorial number system (sum of C(c_i, i) for colors c_1 < ... < c_s).
+ * For sets of the same size, ranks are ordered as the masks are.
+ *
+ * Params:
+ *   c - color set
+ */
+static inline umask col_rank (umask c)
+{
+  umask r = 0;
+  for (int i = 1; c; i++)
+  {
+    r += binom[MASK_CTZ(c)][i];
+    c &= c - 1;
+  }
+  return r;
+}
+
+/* -------------------------
+ * Function: col_unrank
+ * -------------------------
+ * Inverse of col_rank.
+ *
+ * Params:
+ *   r - rank of a color set
+ *   s - size of the color set
+ */
+static inline umask col_unrank (umask r, int s)
+{
+  umask c = EMPTY_MASK;
+  int n = UMASK_BITS - 1;
+  for (int i = s; i > 0; i--)
+  {
+    while (binom[n][i] > r) n--;
+    r -= binom[n][i];
+    c = SET_BIT(c, n);
+    n--;
+  }
+  return c;
+}
+
+/* -------------------------
+ * Function: mem_release
+ * -------------------------
+ * Removes all bytes of an in-memory buffer from the memory budget.
  *
  * Params:
  *   rb - pointer to the corresponding result buffer
- *   x  - number to be stored  
  */
-static void encode_num (RESBUF * rb, u32 x)
+static void mem_release (RESBUF * rb)
 {
-  u32 len, diff;
-  byte tmp_buf[10];
+  __sync_sub_and_fetch(&mem_used, rb->mem);
+  rb->mem = rb->mem_pend = 0;
+}
+
+/* -------------------------
+ * Function: resbuf_spill
+ * -------------------------
+ * Moves content of an in-memory buffer in the write state to a temporary
+ * file, which is used for all further blocks. The file is accessed by
+ * large aligned blocks with read-ahead.
+ *
+ * Params:
+ *   rb - pointer to the corresponding result buffer
+ */
+static void resbuf_spill (RESBUF * rb)
+{
+  struct fb_params par = {
+    .type = FB_DIRECT,
+    .buffer_size = RES_SPILL_WIN,
+    .read_ahead = 2,
+    .write_back = 2,
+  };
+  byte * data;
+  u32 len = fbgrow_get_buf(rb->buf, &data);
+  FASTBUF * fb = bopen_tmp_file(&par);
+  bwrite(fb, data, len);
+  bclose(rb->buf); /* Memory is released instead of being pooled */
+  rb->buf = fb;
+  rb->spilled = 1;
+  mem_release(rb);
+  DBG_BUF("SPILL %u B", len);
+}
+
+static int pool_drop (void);
+
+/* -------------------------
+ * Function: mem_account
+ * -------------------------
+ * Accounts bytes written to an in-memory buffer and moves the buffer
+ * to a temporary file once the memory budget is exceeded.
+ *
+ * Params:
+ *   rb  - pointer to the corresponding result buffer
+ *   len - number of bytes written
+ */
+static void mem_account (RESBUF * rb, u64 len)
+{
+  if (rb->spilled) return;
+  rb->mem_pend += len;
+  if (rb->mem_pend < RES_ACCT_STEP) return;
+  u64 used = __sync_add_and_fetch(&mem_used, rb->mem_pend);
+  rb->mem += rb->mem_pend;
+  rb->mem_pend = 0;
+  /* Pooled buffers are dropped before the buffer is moved to a file */
+  if (MEM_LIMIT && used > MEM_LIMIT && (!pool_drop() || mem_used > MEM_LIMIT)) resbuf_spill(rb);
+}
+
+/* -------------------------
+ * Function: block_flush
+ * -------------------------
+ * Encodes collected records and writes them as a block. Values are reordered
+ * to columns -- lengths of common prefixes with the previous record, map[0]
+ * of records not sharing it, map[1] of records not sharing it, ..., numbers
+ * of colors and finally all colors. Thus a prefix shared by a group of records
+ * is stored only once (front coding). Map columns and first colors of records
+ * are stored as differences from the previous record, other colors as
+ * differences from the previous color of the same record. If all color sets
+ * of the block have the same size (which holds for all records of a single
+ * NTD node), their ranks are stored instead of masks. Each color set takes
+ * MASK_WORDS values, whose upper ones are mostly zero after the differencing.
+ *
+ * Params:
+ *   rb - pointer to the corresponding result buffer
+ */
+static void block_flush (RESBUF * rb)
+{
+  u32 n = rb->nrec, m = rb->mlen, nval = ARR_LEN(rb->blk);
+  u32 * rec, * prev = NULL, * lcp, * out;
+  umask first = EMPTY_MASK;
+  RES_BLK_HDR hdr = { n, m, 0, 0, 0, RES_LCP_UNKNOWN, m ? rb->blk[0] : 0 };
+  
+  if (!n || rb->state != RES_WRITE) return;
+  pthread_once(&binom_once, binom_init);
+  if (ARR_LEN(rb->last) == m) /* Last mapping of the previous block */
+  {
+    for (hdr.plcp = 0; hdr.plcp < m && rb->blk[hdr.plcp] == rb->last[hdr.plcp]; ) hdr.plcp++;
+  }
+  int pop = -1;
+  rec = rb->blk;
+  for (u32 r = 0; r < n && pop != -2; r++)
+  {
+    for (u32 i = 0; i < rec[m]; i++)
+    {
+      int p = MASK_POP(col_load(rec + m + 1 + i * MASK_WORDS));
+      if (pop == -1) pop = p;
+      else if (pop != p) pop = -2;
+    }
+    rec += m + 1 + rec[m] * MASK_WORDS;
+  }
+  if (pop >= 0) hdr.cpop = pop + 1;
+  if (hdr.cpop)
+  {
+    rec = rb->blk;
+    for (u32 r = 0; r < n; r++)
+    {
+      u32 * c = rec + m + 1;
+      for (u32 i = 0; i < rec[m]; i++, c += MASK_WORDS) col_store(c, col_rank(col_load(c)));
+      rec += m + 1 + rec[m] * MASK_WORDS;
+    }
+  }
+  
+  /* Lengths of common prefixes with the previous record */
+  GARY_RESIZE(rb->aux, n + nval);
+  lcp = rb->aux;
+  out = rb->aux + n;
+  rec = rb->blk;
+  for (u32 r = 0; r < n; r++)
+  {
+    u32 l = 0;
+    if (prev) while (l < m && rec[l] == prev[l]) l++;
+    lcp[r] = l;
+    prev = rec;
+    rec += m + 1 + rec[m] * MASK_WORDS;
+  }
+  GARY_RESIZE(rb->last, m);
+  memcpy(rb->last, prev, m * sizeof(*prev));
+  /* Suffixes of mappings (following the common prefix) by columns */
+  for (u32 j = 0; j < m; j++)
+  {
+    u32 x = 0;
+    rec = rb->blk;
+    for (u32 r = 0; r < n; r++)
+    {
+      if (lcp[r] <= j) *out++ = zigzag(rec[j] - x);
+      x = rec[j];
+      rec += m + 1 + rec[m] * MASK_WORDS;
+    }
+  }
+  rec = rb->blk;
+  for (u32 r = 0; r < n; r++)
+  {
+    *out++ = rec[m];
+    rec += m + 1 + rec[m] * MASK_WORDS;
+  }
+  rec = rb->blk;
+  for (u32 r = 0; r < n; r++)
+  {
+    u32 clen = rec[m];
+    umask c, p = first;
+    for (u32 i = 0; i < clen; i++, out += MASK_WORDS)
+    {
+      c = col_load(rec + m + 1 + i * MASK_WORDS);
+      col_store(out, col_zigzag(c - p));
+      if (!i) first = c;
+      p = c;
+    }
+    rec += m + 1 + clen * MASK_WORDS;
+  }
+  nval = hdr.nval = out - rb->aux;
   
-  diff = x - rb->last;
-  len = varint_put(tmp_buf, diff);
-  bwrite(rb->buf, tmp_buf, len);
-  rb->last = x;
+  GARY_RESIZE(rb->enc, sizeof(hdr) + svb_max_len(nval));
+  hdr.plen = svb_encode(rb->aux, nval, rb->enc + sizeof(hdr));
+  memcpy(rb->enc, &hdr, sizeof(hdr));
+  bwrite(rb->buf, rb->enc, sizeof(hdr) + hdr.plen);
+  DBG_BUF("BLOCK %u records, %u values, %u B", n, nval, hdr.plen);
   
-  DBG_BUF("ENC %u", x);
+  rb->nrec = 0;
+  GARY_RESIZE(rb->blk, 0);
+  mem_account(rb, sizeof(hdr) + hdr.plen);
 }
 
 /* -------------------------
- * Function: decode_num
+ * Function: block_load
  * -------------------------
- * Retrieves a number from a buffer
+ * Reads the following block and decodes its columns to rb->blk (lengths
+ * of common prefixes are left in rb->aux).
  *
  * Params:
  *   rb - pointer to the corresponding result buffer
  *
  * Returns:
- *   The actual number stored in rb
+ *   0 if there is no more block, 1 otherwise
  */
-static u32 decode_num (RESBUF * rb)
+static int block_load (RESBUF * rb)
 {
-  u32 x;
+  RES_BLK_HDR hdr;
+  const byte * data;
+  
+  if (rb->nrec) /* Keep the last mapping for the common prefix of the first record */
+  {
+    GARY_RESIZE(rb->last, rb->mlen);
+    for (u32 j = 0; j < rb->mlen; j++) rb->last[j] = rb->blk[j * rb->nrec + rb->nrec - 1];
+  }
+  if (rb->spilled)
+  {
+    rb->bpos = btell(rb->buf);
+    if (bread(rb->buf, &hdr, sizeof(hdr)) < sizeof(hdr)) return 0;
+    GARY_RESIZE(rb->enc, hdr.plen);
+    bread(rb->buf, rb->enc, hdr.plen);
+    data = rb->enc;
+  }
+  else
+  {
+    if (rb->rptr >= rb->rend) return 0;
+    rb->bpos = rb->rptr - rb->rbeg;
+    memcpy(&hdr, rb->rptr, sizeof(hdr));
+    data = rb->rptr + sizeof(hdr); /* Padding of the block allows decoding in place */
+    rb->rptr += sizeof(hdr) + hdr.plen;
+  }
   
-  rb->buf->bptr = (byte *)varint_get32(rb->buf->bptr, &x);
-  x += rb->last;
-  rb->last = x;
+  u32 n = hdr.nrec, m = hdr.mlen, msum = 0;
+  pthread_once(&binom_once, binom_init);
+  GARY_RESIZE(rb->aux, hdr.nval);
+  svb_decode(data, hdr.nval, rb->aux);
+  u32 * lcp = rb->aux, * in = rb->aux + n;
+  for (u32 r = 0; r < n; r++) msum += m - lcp[r];
+  u32 rest = hdr.nval - n - msum; /* numbers of colors and values of colors */
+  GARY_RESIZE(rb->blk, m * n + rest);
+  for (u32 j = 0; j < m; j++)
+  {
+    u32 * c = rb->blk + j * n, x = 0;
+    for (u32 r = 0; r < n; r++)
+    {
+      if (lcp[r] <= j) x += unzigzag(*in++);
+      c[r] = x;
+    }
+  }
+  memcpy(rb->blk + m * n, in, rest * sizeof(u32));
+  u32 * col = rb->blk + (m + 1) * n;
+  umask first = EMPTY_MASK, c = EMPTY_MASK;
+  for (u32 r = 0; r < n; r++)
+  {
+    u32 clen = rb->blk[m * n + r];
+    for (u32 i = 0; i < clen; i++, col += MASK_WORDS)
+    {
+      c = (i ? c : first) + col_unzigzag(col_load(col));
+      if (!i) first = c;
+      col_store(col, hdr.cpop ? col_unrank(c, hdr.cpop - 1) : c);
+    }
+  }
   
-  DBG_BUF("DEC %u", x);
-  return x;
+  rb->nrec = n;
+  rb->mlen = m;
+  rb->rec = 0;
+  rb->coff = (m + 1) * n;
+  return 1;
 }
 
 /* -------------------------
@@ -82,7 +462,7 @@ static u32 decode_num (RESBUF * rb)
  *   col   - list of colors
  *   clen  - number of colors
  */
-void print_buf (u32 * map, int mlen, u32 * col, int clen)
+void print_buf (u32 * map, int mlen, umask * col, int clen)
 {
 #ifdef LOCAL_DEBUG_BUF  
   DBG_BUF("LEN map = %d", mlen);
@@ -92,6 +472,74 @@ void print_buf (u32 * map, int mlen, u32 * col, int clen)
 #endif  
 }
 
+/* -------------------------
+ * Function: pool_get
+ * -------------------------
+ * Retrieves a growing buffer from the pool, or creates a new one if the pool
+ * is empty. Capacity of a pooled buffer leaves the memory budget, its content
+ * is accounted again when written.
+ *
+ * Returns:
+ *   Pointer to the growing buffer
+ */
+static FASTBUF * pool_get (void)
+{
+  FASTBUF * fb = NULL;
+  pthread_mutex_lock(&pool_lock);
+  if (pool && ARR_LEN(pool))
+  {
+    fb = *ARR_POP(pool);
+    pool_mem -= fb->bufend - fb->buffer;
+    __sync_sub_and_fetch(&mem_used, fb->bufend - fb->buffer);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return fb ? fb : fbgrow_create(1);
+}
+
+/* -------------------------
+ * Function: pool_put
+ * -------------------------
+ * Returns a growing buffer to the pool. Capacity of pooled buffers is accounted
+ * in the memory budget, so the buffer is closed if the pool is already full
+ * (RES_POOL_SIZE, RES_POOL_MEM) or the budget would be exceeded.
+ *
+ * Params:
+ *   fb - growing buffer to be returned
+ */
+static void pool_put (FASTBUF * fb)
+{
+  u64 cap = fb->bufend - fb->buffer;
+  pthread_mutex_lock(&pool_lock);
+  if (!pool) ARR_INIT(pool);
+  if (ARR_LEN(pool) < RES_POOL_SIZE && pool_mem + cap <= RES_POOL_MEM && resbuf_mem_reserve(cap))
+  {
+    ARR_PUSH(pool, fb);
+    pool_mem += cap;
+    fb = NULL;
+  }
+  pthread_mutex_unlock(&pool_lock);
+  if (fb) bclose(fb);
+}
+
+/* -------------------------
+ * Function: pool_drop
+ * -------------------------
+ * Closes all buffers of the pool and releases their memory.
+ *
+ * Returns:
+ *   0 if the pool was empty, 1 otherwise
+ */
+static int pool_drop (void)
+{
+  int cnt = 0;
+  pthread_mutex_lock(&pool_lock);
+  for (; pool && ARR_LEN(pool); cnt++) bclose(*ARR_POP(pool));
+  __sync_sub_and_fetch(&mem_used, pool_mem);
+  pool_mem = 0;
+  pthread_mutex_unlock(&pool_lock);
+  return cnt > 0;
+}
+
 /****************************************************************************
  * INTERFACE FUNCTIONS
  ***************************************************************************/
@@ -102,8 +550,20 @@ void print_buf (u32 * map, int mlen, u32 * col, int clen)
 RESBUF * resbuf_init (void)
 {
   RESBUF * tmp = (RESBUF *)xmalloc(sizeof(*tmp));
-  tmp->buf = fbgrow_create(1);
-  tmp->last = 0;
+  tmp->buf = pool_get();
+  tmp->state = 0;
+  tmp->spilled = 0;
+  tmp->mem = tmp->mem_pend = 0;
+  ARR_INIT(tmp->blk);
+  ARR_INIT(tmp->aux);
+  ARR_INIT(tmp->enc);
+  ARR_INIT(tmp->last);
+  tmp->lcp = 0;
+  tmp->cnt = 0;
+  tmp->nrec = tmp->mlen = tmp->rec = tmp->coff = 0;
+  tmp->blk_recs = RES_BLK_RECS;
+  tmp->rbeg = tmp->rptr = tmp->rend = NULL;
+  tmp->bpos = 0;
   resbuf_chng_state(tmp, RES_WRITE);
   return tmp;
 }
@@ -114,24 +574,64 @@ RESBUF * resbuf_init (void)
 void resbuf_free (RESBUF * rb)
 {
   if (!rb) return;
-  bclose(rb->buf);
+  if (!rb->buf) ; /* Range of another buffer */
+  else if (rb->spilled) bclose(rb->buf);
+  else
+  {
+    mem_release(rb);
+    fbgrow_reset(rb->buf);
+    pool_put(rb->buf);
+  }
+  ARR_FREE(rb->blk);
+  ARR_FREE(rb->aux);
+  ARR_FREE(rb->enc);
+  ARR_FREE(rb->last);
   free(rb);
 }
 
+/*---------------------------------------------------------------------------
+ * Function: resbuf_pool_free
+ *-------------------------------------------------------------------------*/
+void resbuf_pool_free (void)
+{
+  if (!pool) return;
+  pool_drop();
+  ARR_FREE(pool);
+  pool = NULL;
+}
+
 /*---------------------------------------------------------------------------
  * Function: resbuf_chng_state
  *-------------------------------------------------------------------------*/
 void resbuf_chng_state (RESBUF * rb, int state)
 {
-  rb->last = 0;
+  block_flush(rb);
   rb->state = state;
+  rb->nrec = rb->rec = rb->lcp = 0;
+  GARY_RESIZE(rb->blk, 0);
+  GARY_RESIZE(rb->last, 0);
   switch (state)
   {
     case RES_WRITE:
+      if (rb->spilled) /* Start again in memory */
+      {
+        bclose(rb->buf);
+        rb->buf = pool_get();
+        rb->spilled = 0;
+      }
+      mem_release(rb);
       fbgrow_reset(rb->buf);
+      rb->cnt = 0;
       break;
     case RES_READ:
-      fbgrow_rewind(rb->buf);
+      if (rb->spilled) brewind(rb->buf);
+      else if (!rb->buf) rb->rptr = rb->rbeg; /* Range of another buffer */
+      else
+      {
+        fbgrow_rewind(rb->buf);
+        rb->rend = rb->buf->bstop;
+        rb->rbeg = rb->rptr = rb->buf->bptr;
+      }
       break;
     default:
       break;
@@ -141,37 +641,221 @@ void resbuf_chng_state (RESBUF * rb, int state)
 /*---------------------------------------------------------------------------
  * Function: resbuf_push
  *-------------------------------------------------------------------------*/
-void resbuf_push (RESBUF * rb, u32 * map, int mlen, u32 * col, int clen)
+void resbuf_push (RESBUF * rb, u32 * map, int mlen, umask * col, int clen)
 {
   DBG_BUF("RESBUF_PUSH");
 #ifdef LOCAL_DEBUG_BUF  
   print_buf(map, mlen, col, clen);
 #endif  
-  DBG_BUF("ENC map");
-  for (u32 i = 0; i < mlen; i++) encode_num(rb, map[i]);
-  DBG_BUF("ENC clen");
-  encode_num(rb, clen);
-  DBG_BUF("ENC col");
-  for (u32 i = 0; i < clen; i++) encode_num(rb, col[i]);
-  DBG_BUF("-----------");
+  u32 * rec = GARY_PUSH_MULTI(rb->blk, mlen + 1 + clen * MASK_WORDS);
+  memcpy(rec, map, mlen * sizeof(u32));
+  rec[mlen] = clen;
+  memcpy(rec + mlen + 1, col, clen * sizeof(umask));
+  rb->mlen = mlen;
+  ++rb->cnt;
+  if (++rb->nrec >= rb->blk_recs || ARR_LEN(rb->blk) >= RES_BLK_VALS) block_flush(rb);
 }
 
 /*---------------------------------------------------------------------------
  * Function: resbuf_read
  *-------------------------------------------------------------------------*/
-int resbuf_read (RESBUF * rb, u32 * map, int mlen, u32 * col, int * clen)
+int resbuf_read (RESBUF * rb, u32 * map, int mlen, umask ** col, int * clen)
 {
-  if (beof(rb->buf)) return RES_EOF;
+  if (rb->rec == rb->nrec && !block_load(rb)) return RES_EOF;
   DBG_BUF("RESBUF_READ");
-  DBG_BUF("DEC map");
-  for (u32 i = 0; i < mlen; i++) map[i] = decode_num(rb);
-  DBG_BUF("DEC clen");
-  *clen = decode_num(rb);
-  DBG_BUF("DEC col");
-  for (u32 i = 0; i < *clen; i++) col[i] = decode_num(rb);
-  DBG_BUF("-----------");
+  u32 n = rb->nrec, r = rb->rec++;
+  for (u32 j = 0; j < mlen; j++) map[j] = rb->blk[j * n + r];
+  *clen = rb->blk[mlen * n + r];
+  if (ARR_LEN(*col) < *clen) GARY_RESIZE(*col, *clen);
+  memcpy(*col, rb->blk + rb->coff, *clen * sizeof(umask));
+  rb->coff += *clen * MASK_WORDS;
+  if (r) rb->lcp = rb->aux[r];
+  else
+  {
+    rb->lcp = 0;
+    if (ARR_LEN(rb->last)) while (rb->lcp < mlen && map[rb->lcp] == rb->last[rb->lcp]) rb->lcp++;
+  }
 #ifdef LOCAL_DEBUG_BUF
-  print_buf(map, mlen, col, *clen);
+  print_buf(map, mlen, *col, *clen);
 #endif
   return RES_OK;
 }
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_lcp
+ *-------------------------------------------------------------------------*/
+u32 resbuf_lcp (RESBUF * rb)
+{
+  return rb->lcp;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_blk_recs
+ *-------------------------------------------------------------------------*/
+void resbuf_blk_recs (RESBUF * rb, u32 recs)
+{
+  rb->blk_recs = recs;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_tell
+ *-------------------------------------------------------------------------*/
+u64 resbuf_tell (RESBUF * rb)
+{
+  return rb->bpos;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_seek
+ *-------------------------------------------------------------------------*/
+void resbuf_seek (RESBUF * rb, u64 pos)
+{
+  rb->nrec = rb->rec = rb->lcp = 0;
+  GARY_RESIZE(rb->last, 0); /* The first record of a block has no common prefix */
+  if (rb->spilled) bsetpos(rb->buf, pos);
+  else rb->rptr = rb->rbeg + pos;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_cnt
+ *-------------------------------------------------------------------------*/
+u64 resbuf_cnt (RESBUF * rb)
+{
+  return rb->cnt;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_append
+ *
+ * Description:
+ *   Blocks do not depend on each other, so after both buffers flush their
+ *   collected records, encoded blocks of src are copied as they are.
+ *-------------------------------------------------------------------------*/
+void resbuf_append (RESBUF * dst, RESBUF * src)
+{
+  byte * data;
+  u64 len = 0;
+  
+  block_flush(dst);
+  block_flush(src);
+  if (src->spilled)
+  {
+    u32 l;
+    brewind(src->buf);
+    GARY_RESIZE(src->enc, RES_SPILL_WIN);
+    while ((l = bread(src->buf, src->enc, RES_SPILL_WIN)))
+    {
+      bwrite(dst->buf, src->enc, l);
+      len += l;
+    }
+  }
+  else
+  {
+    len = fbgrow_get_buf(src->buf, &data);
+    bwrite(dst->buf, data, len);
+  }
+  if (src->cnt) /* The last record of src follows blocks pushed to dst later */
+  {
+    GARY_RESIZE(dst->last, ARR_LEN(src->last));
+    memcpy(dst->last, src->last, ARR_LEN(src->last) * sizeof(*src->last));
+  }
+  dst->cnt += src->cnt;
+  mem_account(dst, len);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_blk_next
+ *-------------------------------------------------------------------------*/
+int resbuf_blk_next (RESBUF * rb, u64 * pos, u32 * nrec, u32 * plcp, u32 * first)
+{
+  RES_BLK_HDR hdr;
+  if (rb->spilled)
+  {
+    bsetpos(rb->buf, *pos);
+    if (bread(rb->buf, &hdr, sizeof(hdr)) < sizeof(hdr)) return 0;
+  }
+  else
+  {
+    if (rb->rbeg + *pos >= rb->rend) return 0;
+    memcpy(&hdr, rb->rbeg + *pos, sizeof(hdr));
+  }
+  *pos += sizeof(hdr) + hdr.plen;
+  *nrec = hdr.nrec;
+  *plcp = hdr.plcp;
+  *first = hdr.first;
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_range
+ *
+ * Description:
+ *   A range of an in-memory buffer is read in place (the buffer has no FASTBUF
+ *   of its own then), a range of a spilled one is copied to memory.
+ *-------------------------------------------------------------------------*/
+RESBUF * resbuf_range (RESBUF * src, u64 beg, u64 end, u64 cnt)
+{
+  RESBUF * rb;
+  if (src->spilled)
+  {
+    rb = resbuf_init();
+    GARY_RESIZE(src->enc, MIN(end - beg, RES_SPILL_WIN));
+    bsetpos(src->buf, beg);
+    for (u64 l, pos = beg; pos < end; pos += l)
+    {
+      l = bread(src->buf, src->enc, MIN(end - pos, RES_SPILL_WIN));
+      bwrite(rb->buf, src->enc, l);
+    }
+    mem_account(rb, end - beg);
+  }
+  else
+  {
+    rb = (RESBUF *)xmalloc(sizeof(*rb));
+    rb->buf = NULL;
+    rb->spilled = 0;
+    rb->mem = rb->mem_pend = 0;
+    ARR_INIT(rb->blk);
+    ARR_INIT(rb->aux);
+    ARR_INIT(rb->enc);
+    ARR_INIT(rb->last);
+    rb->state = RES_READ;
+    rb->nrec = 0;
+    rb->blk_recs = RES_BLK_RECS;
+    rb->bpos = 0;
+    rb->rbeg = src->rbeg + beg;
+    rb->rend = src->rbeg + end;
+  }
+  resbuf_chng_state(rb, RES_READ);
+  rb->cnt = cnt;
+  return rb;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_mem_reserve
+ *-------------------------------------------------------------------------*/
+int resbuf_mem_reserve (u64 len)
+{
+  u64 used = __sync_add_and_fetch(&mem_used, len);
+  if (MEM_LIMIT && used > MEM_LIMIT)
+  {
+    __sync_sub_and_fetch(&mem_used, len);
+    return 0;
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_mem_charge
+ *-------------------------------------------------------------------------*/
+void resbuf_mem_charge (u64 len)
+{
+  __sync_add_and_fetch(&mem_used, len);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: resbuf_mem_release
+ *-------------------------------------------------------------------------*/
+void resbuf_mem_release (u64 len)
+{
+  __sync_sub_and_fetch(&mem_used, len);
+}
@@ -19,8 +19,31 @@
 struct resbuf_struct
 {
   FASTBUF * buf;
-  u32       last;
   int       state;
+  /* Set once the buffer has been moved to a temporary file */
+  int       spilled;
+  /* Bytes of the in-memory buffer accounted in the memory budget / not accounted yet */
+  u64       mem, mem_pend;
+  /* Block being written (records one after another) or read (decoded columns) */
+  u32     * blk;
+  /* Transformed values of a block being encoded / common prefix lengths of a block read */
+  u32     * aux;
+  /* Last mapping of the previous block read */
+  u32     * last;
+  /* Length of the common prefix of the last record read with the preceding one */
+  u32       lcp;
+  /* Records in blk, length of mappings, next record to read, offset of its colors */
+  u32       nrec, mlen, rec, coff;
+  /* Maximal number of records of a block */
+  u32       blk_recs;
+  /* Encoded block being written, or a block read from a spilled buffer */
+  byte    * enc;
+  /* In-memory buffer being read and its unread part */
+  byte    * rbeg, * rptr, * rend;
+  /* Offset of the block read last (see resbuf_tell) */
+  u64       bpos;
+  /* Number of records written */
+  u64       cnt;
 };
 
 /****************************************************************************
@@ -30,7 +53,8 @@ struct resbuf_struct
  /* -------------------------
  * Function: resbuf_init
  * -------------------------
- * Creates a new result buffer.
+ * Creates a new result buffer. Memory of previously freed buffers is reused
+ * if possible.
  * 
  * Returns:
  *   Pointer to the newly created result buffer.
@@ -40,7 +64,8 @@ RESBUF * resbuf_init       (void);
 /* -------------------------
  * Function: resbuf_free
  * -------------------------
- * Deallocates the memory needed by a result buffer. 
+ * Deallocates the memory needed by a result buffer. The underlying growing
+ * buffer is kept in a pool for later usage by resbuf_init.
  * 
  * Params:
  *   rb - pointer to the result buffer to be freed
@@ -61,7 +86,15 @@ void     resbuf_chng_state (RESBUF * rb, int state);
 /* -------------------------
  * Function: resbuf_push
  * -------------------------
- * Pushes a mapping record into the result buffer
+ * Pushes a mapping record into the result buffer. Records are collected
+ * to blocks, which are stored column by column -- a prefix shared with
+ * the previous record is stored only by its length, the rest of each column
+ * of mappings and the first colors are delta coded against the previous
+ * record, colors of a record against each other, all packed by Stream VByte.
+ * Color sets of the same size are stored as their ranks (combinatorial number
+ * system) instead of masks. If in-memory buffers exceed the memory budget
+ * (MEM_LIMIT), the buffer is moved
+ * to a temporary file and the following blocks are written there.
  * 
  * Params:
  *   rb    - pointer to the corresponding result buffer
@@ -70,7 +103,7 @@ void     resbuf_chng_state (RESBUF * rb, int state);
  *   col   - list of colors to be stored
  *   clen  - number of colors to be stored
  */
-void     resbuf_push       (RESBUF * rb, u32 * map, int mlen, u32 * col, int clen);
+void     resbuf_push       (RESBUF * rb, u32 * map, int mlen, umask * col, int clen);
 
 /* -------------------------
  * Function: resbuf_read
@@ -81,13 +114,175 @@ void     resbuf_push       (RESBUF * rb, u32 * map, int mlen, u32 * col, int cle
  *   rb    - pointer to the corresponding result buffer
  *   map   - an array tuple to store the read mapping to
  *   mlen  - length of the mapping to be retrieved
- *   col   - array to store the read color sets to
+ *   col   - growing array to store the read color sets to (grown to hold them)
  *   clen  - number of color sets read
  *
  * Returns:
  *   Either RES_OK if there was a record, or RES_EOF if there is no more record
  *   stored in the result buffer.
  */
-int      resbuf_read       (RESBUF * rb, u32 * map, int mlen, u32 * col, int * clen);
+int      resbuf_read       (RESBUF * rb, u32 * map, int mlen, umask ** col, int * clen);
+
+/* -------------------------
+ * Function: resbuf_lcp
+ * -------------------------
+ * Returns length of the common prefix of the mapping returned by the last
+ * resbuf_read and the mapping preceding it, which allows iterating over
+ * groups of records sharing a prefix without comparing the mappings.
+ * 
+ * Params:
+ *   rb - pointer to the corresponding result buffer
+ *
+ * Returns:
+ *   Length of the common prefix (0 for the first record)
+ */
+u32      resbuf_lcp        (RESBUF * rb);
+
+/* -------------------------
+ * Function: resbuf_blk_recs
+ * -------------------------
+ * Sets the maximal number of records of blocks written to the result buffer
+ * (RES_BLK_RECS by default). Smaller blocks are compressed worse, but they are
+ * decoded faster when reading restarts at random blocks (see resbuf_seek).
+ * 
+ * Params:
+ *   rb   - pointer to the corresponding result buffer (in the write state)
+ *   recs - maximal number of records (at most RES_BLK_RECS)
+ */
+void     resbuf_blk_recs   (RESBUF * rb, u32 recs);
+
+/* -------------------------
+ * Function: resbuf_tell
+ * -------------------------
+ * Returns offset of the block containing the record returned by the last
+ * resbuf_read. Blocks are decoded independently of each other, so reading
+ * can be restarted there by resbuf_seek.
+ * 
+ * Params:
+ *   rb - pointer to the corresponding result buffer (in the read state)
+ *
+ * Returns:
+ *   Offset of the block
+ */
+u64      resbuf_tell       (RESBUF * rb);
+
+/* -------------------------
+ * Function: resbuf_seek
+ * -------------------------
+ * Moves reading to a block, so the next resbuf_read returns its first record.
+ * A spilled buffer is read from its temporary file.
+ * 
+ * Params:
+ *   rb  - pointer to the corresponding result buffer (in the read state)
+ *   pos - offset of the block returned by resbuf_tell
+ */
+void     resbuf_seek       (RESBUF * rb, u64 pos);
+
+/* -------------------------
+ * Function: resbuf_blk_next
+ * -------------------------
+ * Reads only the header of a block, so blocks can be split among threads
+ * without decoding them (see resbuf_range).
+ * 
+ * Params:
+ *   rb    - pointer to the corresponding result buffer (in the read state)
+ *   pos   - offset of the block (0 for the first one), moved to the next block
+ *   nrec  - number of records of the block
+ *   plcp  - length of the common prefix of the first record of the block with
+ *           the preceding record, or more than any length if it is not known
+ *   first - first element of the mapping of the first record of the block
+ *
+ * Returns:
+ *   0 if there is no block at pos, 1 otherwise
+ */
+int      resbuf_blk_next   (RESBUF * rb, u64 * pos, u32 * nrec, u32 * plcp, u32 * first);
+
+/* -------------------------
+ * Function: resbuf_range
+ * -------------------------
+ * Creates a buffer in the read state holding blocks of another buffer between
+ * two offsets. Blocks of an in-memory buffer are not copied, so several threads
+ * can read their ranges at once; the source buffer must not be changed or
+ * freed until the range is freed. The first record read has no common prefix.
+ * 
+ * Params:
+ *   src - result buffer the blocks are taken from (in the read state)
+ *   beg - offset of the first block (see resbuf_blk_next)
+ *   end - offset following the last block
+ *   cnt - number of records of the blocks
+ *
+ * Returns:
+ *   Pointer to the new result buffer, to be freed by resbuf_free
+ */
+RESBUF * resbuf_range      (RESBUF * src, u64 beg, u64 end, u64 cnt);
+
+/* -------------------------
+ * Function: resbuf_cnt
+ * -------------------------
+ * Returns number of records stored in the result buffer.
+ * 
+ * Params:
+ *   rb - pointer to the corresponding result buffer
+ *
+ * Returns:
+ *   Number of records
+ */
+u64      resbuf_cnt        (RESBUF * rb);
+
+/* -------------------------
+ * Function: resbuf_append
+ * -------------------------
+ * Appends all records of one result buffer to the end of another one.
+ * Both buffers have to be in the write state.
+ * 
+ * Params:
+ *   dst - result buffer the records are appended to
+ *   src - result buffer the records are taken from
+ */
+void     resbuf_append     (RESBUF * dst, RESBUF * src);
+
+/* -------------------------
+ * Function: resbuf_mem_reserve
+ * -------------------------
+ * Reserves memory used besides result buffers (e.g. decoded records) in the
+ * memory budget shared with in-memory buffers (MEM_LIMIT).
+ * 
+ * Params:
+ *   len - number of bytes to be reserved
+ *
+ * Returns:
+ *   1 if the bytes were reserved, 0 if they would exceed the budget
+ */
+int      resbuf_mem_reserve (u64 len);
+
+/* -------------------------
+ * Function: resbuf_mem_charge
+ * -------------------------
+ * Accounts memory which cannot be given up on demand (e.g. indices of records)
+ * in the memory budget even if it is exceeded, so that in-memory buffers are
+ * moved to temporary files sooner.
+ * 
+ * Params:
+ *   len - number of bytes to be accounted
+ */
+void     resbuf_mem_charge (u64 len);
+
+/* -------------------------
+ * Function: resbuf_mem_release
+ * -------------------------
+ * Returns bytes reserved by resbuf_mem_reserve or resbuf_mem_charge to the
+ * memory budget.
+ * 
+ * Params:
+ *   len - number of bytes to be released
+ */
+void     resbuf_mem_release (u64 len);
+
+/* -------------------------
+ * Function: resbuf_pool_free
+ * -------------------------
+ * Deallocates all buffers kept in the pool of freed buffers.
+ */
+void     resbuf_pool_free  (void);
 
 #endif /* __RESBUF_H__ */
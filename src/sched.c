@@ -0,0 +1,239 @@
+/*
+ *	Subgraph Isomorphism - Task scheduler
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "sched.h"
+#include "array.h"
+#include <pthread.h>
+
+/* Double-ended queue of tasks owned by a single worker thread */
+typedef struct
+{
+  pthread_mutex_t lock;
+  /* Oldest task (taken by thieves) */
+  SCHED_TASK    * head;
+  /* Newest task (taken by the owner) */
+  SCHED_TASK    * tail;
+} SCHED_DEQUE;
+
+/* Worker threads (NULL if the scheduler runs single-threaded) */
+static pthread_t     * workers;
+/* Deques of workers, deque #0 belongs to threads outside of the scheduler */
+static SCHED_DEQUE   * deques;
+/* Number of tasks waiting in all deques */
+static int             q_cnt;
+/* Set when workers are to be stopped */
+static int             q_stop;
+/* Lock and condition for sleeping threads (signalled when a task is queued or finished) */
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  s_cond = PTHREAD_COND_INITIALIZER;
+/* Deque of the current thread */
+static __thread int    w_id;
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: sched_pop
+ * -------------------------
+ * Removes the newest task from the given deque.
+ *
+ * Params:
+ *   d - deque of the current thread
+ *
+ * Returns:
+ *   The task or NULL if the deque is empty
+ */
+static SCHED_TASK * sched_pop (SCHED_DEQUE * d)
+{
+  pthread_mutex_lock(&d->lock);
+  SCHED_TASK * t = d->tail;
+  if (t)
+  {
+    d->tail = t->prev;
+    if (d->tail) d->tail->next = NULL;
+    else d->head = NULL;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return t;
+}
+
+/* -------------------------
+ * Function: sched_steal
+ * -------------------------
+ * Removes the oldest task from a deque of another thread.
+ *
+ * Params:
+ *   d - deque of another thread
+ *
+ * Returns:
+ *   The task or NULL if the deque is empty
+ */
+static SCHED_TASK * sched_steal (SCHED_DEQUE * d)
+{
+  pthread_mutex_lock(&d->lock);
+  SCHED_TASK * t = d->head;
+  if (t)
+  {
+    d->head = t->next;
+    if (d->head) d->head->prev = NULL;
+    else d->tail = NULL;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return t;
+}
+
+/* -------------------------
+ * Function: sched_find
+ * -------------------------
+ * Finds a task to be run by the current thread -- the newest task of its own
+ * deque is preferred, tasks of other threads are stolen otherwise.
+ *
+ * Returns:
+ *   The task or NULL if there is no queued task
+ */
+static SCHED_TASK * sched_find (void)
+{
+  int d_cnt = ARR_LEN(deques);
+  SCHED_TASK * t = sched_pop(&deques[w_id]);
+  for (int i = 1; !t && i < d_cnt; i++) t = sched_steal(&deques[(w_id + i) % d_cnt]);
+  if (t) __sync_fetch_and_sub(&q_cnt, 1);
+  return t;
+}
+
+/* -------------------------
+ * Function: sched_exec
+ * -------------------------
+ * Runs the given task and marks it as done.
+ *
+ * Params:
+ *   t - task to be run
+ */
+static void sched_exec (SCHED_TASK * t)
+{
+  t->run(t->arg);
+  pthread_mutex_lock(&s_lock);
+  t->done = 1;
+  pthread_cond_broadcast(&s_cond);
+  pthread_mutex_unlock(&s_lock);
+}
+
+/* -------------------------
+ * Function: sched_worker
+ * -------------------------
+ * Main loop of a worker thread.
+ *
+ * Params:
+ *   arg - index of the worker's deque
+ */
+static void * sched_worker (void * arg)
+{
+  w_id = (int)(long)arg;
+  while (1)
+  {
+    SCHED_TASK * t = sched_find();
+    if (t)
+    {
+      sched_exec(t);
+      continue;
+    }
+    pthread_mutex_lock(&s_lock);
+    while (q_cnt <= 0 && !q_stop) pthread_cond_wait(&s_cond, &s_lock);
+    int stop = q_cnt <= 0 && q_stop;
+    pthread_mutex_unlock(&s_lock);
+    if (stop) break;
+  }
+  return NULL;
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: sched_init
+ *-------------------------------------------------------------------------*/
+void sched_init (int thr_cnt)
+{
+  if (workers || thr_cnt <= 1) return;
+  q_stop = q_cnt = 0;
+  ARR_ALLOC(deques, thr_cnt);
+  for (int i = 0; i < thr_cnt; i++)
+  {
+    pthread_mutex_init(&deques[i].lock, NULL);
+    deques[i].head = deques[i].tail = NULL;
+  }
+  ARR_ALLOC(workers, thr_cnt - 1);
+  for (int i = 0; i < ARR_LEN(workers); i++)
+  {
+    if (pthread_create(&workers[i], NULL, sched_worker, (void *)(long)(i + 1))) die("Cannot create worker thread");
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: sched_free
+ *-------------------------------------------------------------------------*/
+void sched_free (void)
+{
+  if (!workers) return;
+  pthread_mutex_lock(&s_lock);
+  q_stop = 1;
+  pthread_cond_broadcast(&s_cond);
+  pthread_mutex_unlock(&s_lock);
+  for (int i = 0; i < ARR_LEN(workers); i++) pthread_join(workers[i], NULL);
+  for (int i = 0; i < ARR_LEN(deques); i++) pthread_mutex_destroy(&deques[i].lock);
+  ARR_FREE(workers);
+  ARR_FREE(deques);
+  workers = NULL;
+  deques = NULL;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: sched_spawn
+ *-------------------------------------------------------------------------*/
+void sched_spawn (SCHED_TASK * t)
+{
+  t->done = 0;
+  t->next = t->prev = NULL;
+  if (!workers)
+  {
+    t->run(t->arg);
+    t->done = 1;
+    return;
+  }
+  SCHED_DEQUE * d = &deques[w_id];
+  pthread_mutex_lock(&d->lock);
+  t->prev = d->tail;
+  if (d->tail) d->tail->next = t;
+  else d->head = t;
+  d->tail = t;
+  pthread_mutex_unlock(&d->lock);
+  pthread_mutex_lock(&s_lock);
+  __sync_fetch_and_add(&q_cnt, 1);
+  pthread_cond_broadcast(&s_cond);
+  pthread_mutex_unlock(&s_lock);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: sched_wait
+ *-------------------------------------------------------------------------*/
+void sched_wait (SCHED_TASK * t)
+{
+  if (!workers) return;
+  while (1)
+  {
+    pthread_mutex_lock(&s_lock);
+    while (!t->done && q_cnt <= 0) pthread_cond_wait(&s_cond, &s_lock);
+    int done = t->done;
+    pthread_mutex_unlock(&s_lock);
+    if (done) break;
+    SCHED_TASK * x = sched_find();
+    if (x) sched_exec(x);
+  }
+}
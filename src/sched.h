@@ -0,0 +1,77 @@
+/*
+ *	Subgraph Isomorphism - Task scheduler
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+/* Structure representing a single task for worker threads */
+struct sched_task_struct
+{
+  /* Function to be run by the task */
+  void         (* run)(void * arg);
+  /* Argument passed to the function */
+  void          * arg;
+  /* Set to 1 once the task has been finished */
+  int             done;
+  /* Neighbouring tasks in the deque of a worker */
+  SCHED_TASK    * next, * prev;
+};
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: sched_init
+ * -------------------------
+ * Starts worker threads of the scheduler. Calling thread is counted as one
+ * of the workers, so thr_cnt - 1 threads are actually created.
+ * 
+ * Params:
+ *   thr_cnt - total number of threads to be used
+ */
+void sched_init  (int thr_cnt);
+
+/* -------------------------
+ * Function: sched_free
+ * -------------------------
+ * Stops all worker threads of the scheduler.
+ */
+void sched_free  (void);
+
+/* -------------------------
+ * Function: sched_spawn
+ * -------------------------
+ * Submits a task to the deque of the calling thread; idle worker threads
+ * steal it from there. If there are no worker threads, the task is run
+ * immediately by the calling thread.
+ * 
+ * Params:
+ *   t - task to be run (its 'run' and 'arg' fields have to be set)
+ */
+void sched_spawn (SCHED_TASK * t);
+
+/* -------------------------
+ * Function: sched_wait
+ * -------------------------
+ * Waits until the given task is finished. Calling thread runs its own or
+ * stolen tasks in the meantime.
+ * 
+ * Params:
+ *   t - previously spawned task
+ */
+void sched_wait  (SCHED_TASK * t);
+
+#endif /* __SCHED_H__ */
@@ -0,0 +1,96 @@
+/*
+ *	Subgraph Isomorphism - Query server
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "server.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: server_answer
+ *---------------------------------------------------------------------------
+ * Reads a query from a connection, splits it to arguments and answers it
+ * with output redirected to the connection
+ *
+ * Params:
+ *   conn  - connected socket
+ *   query - function answering the query
+ */
+static void server_answer (int conn, SERVER_QUERY query)
+{
+  char line[SRV_QUERY_LEN], * argv[SRV_MAX_ARGS + 1];
+  int len = 0, argc = 0;
+  for (ssize_t r; len < SRV_QUERY_LEN - 1 && !memchr(line, '\n', len); len += r)
+  {
+    if ((r = read(conn, line + len, SRV_QUERY_LEN - 1 - len)) <= 0) break;
+  }
+  line[len] = 0;
+  argv[argc++] = "grs";
+  for (char * tok = strtok(line, " \t\r\n"); tok && argc < SRV_MAX_ARGS; tok = strtok(NULL, " \t\r\n")) argv[argc++] = tok;
+  argv[argc] = NULL;
+  dup2(conn, STDOUT_FILENO);
+  dup2(conn, STDERR_FILENO);
+  close(conn);
+  query(argc, argv);
+  fflush(stdout);
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: server_run
+ *-------------------------------------------------------------------------*/
+void server_run (const char * path, int workers, SERVER_QUERY query)
+{
+  struct sockaddr_un addr;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0), active = 0;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "Socket path %s is too long\n", path);
+    force_exit();
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, SRV_BACKLOG))
+  {
+    perror(path);
+    force_exit();
+  }
+  fprintf(stderr, "Listening on %s\n", path);
+  for (;;)
+  {
+    /* Finished queries are reaped, the server waits for one if all workers are busy */
+    while (active > 0 && waitpid(-1, NULL, active >= workers ? 0 : WNOHANG) > 0) --active;
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0) continue;
+    fflush(NULL); /* Nothing buffered is written twice */
+    pid_t pid = fork();
+    if (!pid)
+    {
+      close(sock);
+      server_answer(conn, query);
+      _exit(0);
+    }
+    if (pid > 0) ++active;
+    close(conn);
+  }
+}
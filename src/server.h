@@ -0,0 +1,43 @@
+/*
+ *	Subgraph Isomorphism - Query server
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "common.h"
+
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+/* Function answering a query given by its arguments (argv[0] is the program name) */
+typedef void (* SERVER_QUERY) (int argc, char * argv []);
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: server_run
+ * -------------------------
+ * Accepts queries on a Unix domain socket, until the process is killed.
+ * A query is a single line of arguments separated by whitespace. Each one is
+ * answered by a forked process, which shares G_GRAPH (and everything computed
+ * from it before) with the server, and whose standard output and error output
+ * are sent back to the client as they are written. At most 'workers' queries
+ * are answered at a time, others wait in the queue of the socket.
+ *
+ * Params:
+ *   path    - path of the socket (an existing file is replaced)
+ *   workers - maximal number of concurrently answered queries
+ *   query   - function answering a query
+ */
+void server_run (const char * path, int workers, SERVER_QUERY query);
+
+#endif /* __SERVER_H__ */
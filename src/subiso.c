@@ -14,9 +14,70 @@
 #include "graph.h"
 #include "graph_result.h"
 #include "util.h"
+#include "sched.h"
+#include "filter.h"
 #include "stdlib.h"
 #include "string.h"
 #include "stdio.h"
+#include <pthread.h>
+
+/* Node of a pattern of a batch with the hash of its DP table (see subiso_share) */
+typedef struct
+{
+  u64                  h;
+  int                  pat;
+  NICE_TREE_DEC_NODE * x;
+} SHARE_ENT;
+
+/* Libucw sorter defines (for nodes of patterns of a batch by hashes) */
+#define ASORT_PREFIX(X) sharearr_##X
+#define ASORT_KEY_TYPE  SHARE_ENT
+#define ASORT_LT(a, b)  ((a).h < (b).h || ((a).h == (b).h && (a).pat < (b).pat))
+#include <ucw/sorter/array-simple.h>
+
+/* Record of a shared DP table with reordered columns (see share_read) */
+typedef struct
+{
+  u32 * map;
+  u32   mlen, rec;
+} SHARE_REC;
+
+/* -------------------------
+ * Function: share_rec_lt
+ * -------------------------
+ * Compares reordered records by their mappings (lexicographically).
+ *
+ * Params:
+ *   a - first record
+ *   b - second record
+ *
+ * Returns:
+ *   Non-zero if a goes first
+ */
+static inline int share_rec_lt (SHARE_REC * a, SHARE_REC * b)
+{
+  for (u32 i = 0; i < a->mlen; i++)
+  {
+    if (a->map[i] != b->map[i]) return a->map[i] < b->map[i];
+  }
+  return a->rec < b->rec;
+}
+
+/* Libucw sorter defines (for reordered records of a shared DP table) */
+#define ASORT_PREFIX(X) sharerec_##X
+#define ASORT_KEY_TYPE  SHARE_REC
+#define ASORT_LT(a, b)  share_rec_lt(&(a), &(b))
+#include <ucw/sorter/array-simple.h>
+
+/* Sorted run of reordered records of a shared DP table and its current record
+   (see share_read) */
+typedef struct
+{
+  RESBUF * rb;
+  u32    * map;
+  umask  * col;
+  int      clen;
+} SHARE_RUN;
 
 /* Map comparison defines */
 #define MAP_EQUAL    0
@@ -26,8 +87,8 @@
 /* Libucw rb-tree defines (for sorting during introduce/forget node) */
 typedef struct
 {
-  u32 * key;
-  u32 * val;
+  u32   * key;
+  umask * val;
 } subiso_tree_node;
 
 typedef struct rbtree_subiso_tree SUBISO_TREE;
@@ -116,9 +177,9 @@ typedef struct table_pair_table PAIR_TABLE;
      rbtree_subiso_cleanup(tree); \
   })
 
-/* Libucw u32 sorter defines */
-#define ASORT_PREFIX(X) u32arr_##X
-#define ASORT_KEY_TYPE  u32
+/* Libucw umask sorter defines */
+#define ASORT_PREFIX(X) maskarr_##X
+#define ASORT_KEY_TYPE  umask
 #include <ucw/sorter/array-simple.h>
 
 /* Libucw int sorter defines */
@@ -143,8 +204,216 @@ typedef struct table_pair_table PAIR_TABLE;
            ARR_FREE(col_old_2);   \
         })                        \
 
+/* Operator processing records of an introduce/forget node one by one */
+typedef struct subiso_op_struct SUBISO_OP;
+struct subiso_op_struct
+{
+  NICE_TREE_DEC_NODE * x;
+  /* Operator of the parent node the outgoing records are passed to (NULL if stored to out) */
+  SUBISO_OP          * next;
+  RESBUF             * out;
+  /* Outgoing records of the current prefix group (by suffix) */
+  SUBISO_TREE        * ft;
+  u32                * map_new, * suffix;
+  umask              * col_new;
+  u32                  mlen_old, mlen_new, prefix_len, suffix_len;
+  /* Last record passed to next (valid if has_last is set) */
+  u32                * last;
+  int                  has_last;
+  /* Auxiliary structures of introduce nodes (candidates, touched vertices, counters
+     of neighbours, distances) and their size charged to the memory budget */
+  int                * s, * q;
+  byte               * cnt;
+  PAIR_TABLE         * pair_mem;
+  u64                  mem;
+  /* Records of the current prefix group of forget nodes -- suffixes, colours, offsets
+     of colours of records (with the end), starts of sorted runs of records */
+  u32                * g_suf, * g_coff, * g_run;
+  umask              * g_col;
+  /* Heap of runs being merged (with positions of runs) and merged colour lists */
+  u32                * heap, * cur;
+  umask              * acc, * tmp;
+};
+
+/* Records of a join node's child indexed by their mappings (open addressing) */
+typedef struct
+{
+  u32     mlen;
+  /* Mappings, colours and offsets of colours of records (with the end) */
+  u32   * map, * coff;
+  umask * col;
+  /* Indices of records + 1 (0 for an empty slot) */
+  u32 * slot;
+  u32   mask;
+  /* Bytes accounted in the memory budget */
+  u64   mem;
+} JOIN_HASH;
+
+/* Decoded block of records of a forget node's child */
+typedef struct
+{
+  /* Mappings, colours and offsets of colours of records (with the end) */
+  u32   * map, * coff;
+  umask * col;
+  /* Bytes reserved in the memory budget (0 if the block is not cached) */
+  u64     mem;
+} RECON_BLOCK;
+
+/* Record and colour set of a child level extending a union of colours of the bag
+   of its parent level and of previous child levels (see sample_combine) */
+typedef struct
+{
+  /* Union with the colour set, the extended union */
+  umask  uni, prev;
+  /* Record and colour set (indices in the whole table of the child level) */
+  u64    rec, set;
+  /* Cumulative weight of items with the same union up to this one */
+  double cum;
+} SAMPLE_ITEM;
+
+/* Libucw sorter defines (for items of a step of sample_combine by unions) */
+#define ASORT_PREFIX(X) sampleitem_##X
+#define ASORT_KEY_TYPE  SAMPLE_ITEM
+#define ASORT_LT(a, b)  ((a).uni < (b).uni)
+#include <ucw/sorter/array-simple.h>
+
+/* Records of a forget node's child indexed by images of vertices of the bag other
+   than the forgotten one (key). Records are rewritten sorted by their keys with
+   the forgotten vertex at the end, so they stay compressed (and possibly spilled).
+   Decoded blocks are cached while they fit into the memory budget */
+typedef struct
+{
+  /* Forget node, length of mappings, position of the forgotten vertex in the child's bag */
+  NICE_TREE_DEC_NODE * x;
+  u32      mlen, pos;
+  /* Sorted records (NULL until the level is reached, see recon_table_index) */
+  RESBUF * rb;
+  /* Offsets of blocks in rb, indices of their first records and colour sets (with
+     the end), keys of their first records */
+  u64    * boff, * brec, * bcol;
+  u32    * bkey;
+  /* Decoded blocks (NULL if not decoded), cached ones in order of decoding
+     (cyclic queue of capacity of the number of blocks) */
+  RECON_BLOCK ** dec;
+  u32    * queue;
+  u32      q_head, q_len;
+  /* Block being read (-1 if none) and its records */
+  u32      blk;
+  u32    * map, * coff;
+  umask  * col;
+  /* Numbers of colourful embeddings of the child's subtree for individual colour
+     sets of records (only when sampling, see sample_count) */
+  double * num;
+  /* Items of child levels for each record and child level sorted by unions, and
+     their offsets (with the end) -- only when sampling, see sample_combine */
+  SAMPLE_ITEM * item;
+  u64         * ioff;
+  /* Bytes of the index, numbers and items accounted in the memory budget */
+  u64      mem;
+} RECON_TABLE;
+
+/* Prefix group of records of a forget node's child being sorted by keys (see recon_group_flush) */
+typedef struct
+{
+  u32     mlen, pos;
+  /* Mappings (with the forgotten vertex at the end), colours and offsets of colours
+     of records (with the end) */
+  u32   * map, * coff;
+  umask * col;
+  /* Starts of runs of records with the same forgotten vertex (with the end),
+     heap of runs, current records of runs */
+  u32   * run, * heap, * cur;
+} RECON_GROUP;
+
+/* Depth-first iterator over embeddings -- one level per forget node */
+typedef struct
+{
+  /* Forget nodes in order of reconstruction (parents first), their tables */
+  NICE_TREE_DEC_NODE ** fn;
+  RECON_TABLE        ** tab;
+  /* Level of the nearest forget ancestor of each level (-1 for the root) */
+  int                 * up;
+  /* Current block and its record + 1 of each level (0 if the level was not
+     entered yet), colours used above each level */
+  u32                 * blk, * cur;
+  umask               * used;
+  /* Level to be advanced, assignment being built, key buffer */
+  int                   depth;
+  int                 * mapping;
+  u32                 * key;
+  /* Vertices whose images have to be higher (less) or lower (more) than the image
+     of each vertex by constraints without a common bag (see NICE_TREE_DEC) */
+  umask                 less[MAX_F_VERTICES], more[MAX_F_VERTICES];
+} SUBISO_ITER;
+
+/* Receiver of embeddings found by subiso_collect (returns 0 to stop the collection) */
+typedef int (* SUBISO_SINK) (int * mapping, void * arg);
+
+/* Embeddings collected to an array (see sink_array) */
+typedef struct
+{
+  GRAPH_RESULT ** res;
+  /* Maximal number of embeddings (0 for no limit) */
+  int             cnt;
+} SINK_ARRAY;
+
+/* State of sampling embeddings (see subiso_sample) */
+typedef struct
+{
+  SUBISO_ITER * it;
+  /* Child levels of each level */
+  int        ** ch;
+  /* Items of the step being combined, unions of the previous step and their weights */
+  SAMPLE_ITEM * step;
+  umask       * uni;
+  double      * w;
+} SUBISO_SAMPLER;
+
+/* Operators of a chain of nodes kept for chunks of the chain -- one chain of
+   operators for each thread running a chunk at the same time */
+typedef struct
+{
+  pthread_mutex_t      lock;
+  NICE_TREE_DEC_NODE * x, * b;
+  /* Chains (their bottom operators) not used by any chunk */
+  SUBISO_OP         ** idle;
+} SUBISO_CHAINS;
+
+/* Chunk of input records processed by a single worker thread */
+typedef struct
+{
+  SCHED_TASK           task;
+  /* Chain of nodes processing the chunk (top and bottom node), or a join node */
+  NICE_TREE_DEC_NODE * x, * b;
+  /* Operators of the chain (NULL for a join node) */
+  SUBISO_CHAINS      * chains;
+  RESBUF             * r_old;
+  /* Input of a merge join from child node #2 */
+  RESBUF             * r_old_2;
+  /* Hash table of a hash join */
+  JOIN_HASH          * ht;
+  RESBUF             * r_new;
+} SUBISO_CHUNK;
+
+/* BFS ball of G_GRAPH cached for introduce nodes of PLAN_BALL (see cand_ball) */
+typedef struct
+{
+  u32   anchor, radius;
+  /* Sorted vertices of the ball (NULL for an unused entry) */
+  int * verts;
+  /* Next entry in the bucket + 1 (0 for the last one), clock reference bit */
+  int   next, ref;
+} BALL_ENTRY;
+
 int * COLOUR;
 
+/* Ball cache shared by all threads (and iterations), its buckets (entry + 1, 0 if
+   empty), number of ever used entries, clock hand and total number of cached vertices */
+static BALL_ENTRY      ball_ent[BALL_CACHE_ENTS];
+static int             ball_head[BALL_CACHE_ENTS];
+static int             ball_used, ball_hand, ball_vals;
+static pthread_mutex_t ball_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /****************************************************************************
  * STATIC FUNCTIONS
  ***************************************************************************/
@@ -252,9 +521,9 @@ static int map_compare (u32 * map_1, u32 * map_2)
  * Returns:
  *   Number of unique elements
  */
-static u32 col_uniq (u32 * col)
+static u32 col_uniq (umask * col)
 {
-  u32arr_sort(col, ARR_LEN(col));
+  maskarr_sort(col, ARR_LEN(col));
   u32 wi;
   wi = 0;
   for (int ri = 0; ri < ARR_LEN(col); ri++)
@@ -280,13 +549,15 @@ static void subiso_leaf (NICE_TREE_DEC_NODE * x, RESBUF * r_new)
   ntd_print_node(x);
 #endif
 
-  u32 * map_new, * col_new;
+  u32 * map_new;
+  umask * col_new;
 
   ARR_ALLOC(map_new, 1);
   ARR_ALLOC(col_new, 1);
   
   for (int i = 0; i < G_GRAPH->n_cnt; i++)
   {
+    if (!IS_CAND(x->bag_cont[0], i)) continue;
     map_new[0] = i;
     col_new[0] = SET_BIT(EMPTY_MASK, COLOUR[i]);
     resbuf_push(r_new, map_new, 1, col_new, 1);
@@ -297,540 +568,3111 @@ static void subiso_leaf (NICE_TREE_DEC_NODE * x, RESBUF * r_new)
 
 
 /* -------------------------
- * Function: subiso_introduce
+ * Function: subiso_op_init
  * -------------------------
- * Handles main algorithm mapping in introduce nodes.
+ * Creates an operator processing records of an introduce/forget node.
  *
  * Params:
- *   x     - current leaf node being processed
- *   r_old - buffer storing ingoing information from child node
- *   r_new - buffer to store outgoing information to
+ *   x    - introduce/forget node
+ *   next - operator of the parent node the outgoing records are passed to,
+ *          or NULL if they are stored (to the buffer given by subiso_chain_run)
+ *
+ * Returns:
+ *   Pointer to the newly created operator
  */
-static void subiso_introduce (NICE_TREE_DEC_NODE * x, RESBUF * r_old, RESBUF * r_new)
+static SUBISO_OP * subiso_op_init (NICE_TREE_DEC_NODE * x, SUBISO_OP * next)
 {
-#ifdef LOCAL_DEBUG
-  DBG("~~~~~~~~~ I ~~~~~~~~~");
-  ntd_print_node(x);
-#endif
-
-  u32 * map_old, * map_new, * col_old, * col_new, * prefix, * prefix_prev, * suffix;
-  u32 mlen_old, mlen_new, clen_old, clen_new, prefix_len, suffix_len;
-  int * s, *q, s_cnt, u, f_ind_deg, qt, qh;
-  
-  PAIR_TABLE * pair_mem;
-  SUBISO_TREE * ft;
-
-  mlen_new = ARR_LEN(x->bag_cont);
-  mlen_old = mlen_new - 1;
-  ARR_ALLOC(map_new, mlen_new);
-  ARR_ALLOC(map_old, mlen_old);
-  ARR_ALLOC(col_new, 1 << F_GRAPH->n_cnt);
-  ARR_ALLOC(col_old, 1 << F_GRAPH->n_cnt);
-  ARR_ALLOC(s, G_GRAPH->n_cnt);
-  ARR_ALLOC(q, G_GRAPH->n_cnt);
-  pair_mem = (PAIR_TABLE *)xmalloc(sizeof(*pair_mem));
-
-  prefix_len = x->chng_index;
-  ARR_ALLOC(prefix, prefix_len + 1);
-  ARR_ALLOC(prefix_prev, prefix_len + 1);
-  for (int i = 0; i < prefix_len + 1; i++) prefix[i] = prefix_prev[i] = INF;
-  suffix_len = mlen_new - prefix_len;
-  ARR_ALLOC(suffix, suffix_len);
-  ft = (SUBISO_TREE * )xmalloc(sizeof(*ft));
-  rbtree_subiso_init(ft);
-  u = x->bag_cont[x->chng_index];
-  while (resbuf_read(r_old, map_old, mlen_old, col_old, &clen_old) != RES_EOF)
-  {
-    if (prefix_len) memcpy(prefix, map_old, prefix_len * sizeof(*prefix));
-    if (map_compare(prefix, prefix_prev) != MAP_EQUAL) /* New prefix -> push results of the last one */
-    {
-      FOR_SUBISO(ft, node)
-      {
-        clen_new = col_uniq(node->val);
-        if (clen_new)
-        {
-          memcpy(map_new + prefix_len, node->key, suffix_len * sizeof(*node->key));
-          resbuf_push(r_new, map_new, mlen_new, node->val, clen_new);
-        }
-      }
-      FOR_SUBISO_END;
-      FREE_SUBISO_TREE(ft);
-      rbtree_subiso_init(ft);
-      if (prefix_len) memcpy(map_new, prefix, prefix_len * sizeof(*prefix));
-    }
-    if (suffix_len - 1) memcpy(suffix + 1, map_old + prefix_len, (suffix_len - 1) * sizeof(*map_old)); /* suffix_len is always >= 1 */
-    /* Try all assigments */
-    memcpy(map_new + prefix_len, suffix, suffix_len * sizeof(*suffix));
-    s_cnt = 0;
-    int f_ind_deg = 0;
-    for (int i = 0; i < mlen_new; i++) /* Find degree of u in F[V_x]*/
-    {
-      if (i != x->chng_index && graph_is_adj(F_GRAPH, u, x->bag_cont[i])) ++f_ind_deg;
-    }
-    
-    if (f_ind_deg > 0) /* Map opt #1 */
-    {
-      pair_table_node * node;
-      table_pair_init(pair_mem);
-      int req = 0; /* Number of neighbors required so far */
-      for (int i = 0; i < mlen_new; i++) 
-      {
-        if (i != x->chng_index && graph_is_adj(F_GRAPH, u, x->bag_cont[i]))
-        {
-          int phi_w = map_new[i];
-          FOR_ADJ(G_GRAPH->edges[phi_w], neigh)
-          {
-            int w = neigh->key;
-            node = table_pair_find(pair_mem, w);
-            if (!node && !req) 
-            {
-              node = table_pair_new(pair_mem, w);
-              node->val = 0;
-            }
-            if (node) ++node->val;
-          }
-          FOR_ADJ_END;
-          ++req; 
-        }
-      }
-      FOR_PAIR(pair_mem, px)
-      {
-        if (px->val == f_ind_deg) s[s_cnt++] = px->key;
-      }
-      FOR_PAIR_END;
-      table_pair_cleanup(pair_mem);
-    }
-    else /* Map opt #2 */
-    {
-      int min_ecc = F_GRAPH->n_cnt;
-      int min_vi = 0;
-      for (int i = 0; i < mlen_new; i++) 
-      {
-        if (i != x->chng_index)
-        {
-          if (F_ECC[x->bag_cont[i]] < min_ecc)
-          {
-            min_ecc = F_ECC[x->bag_cont[i]];
-            min_vi = i;
-          }
-        }
-      }
-      
-      pair_table_node * node;
-      table_pair_init(pair_mem);
-      qt = qh = 0;
-      q[qh++] = map_new[min_vi];
-      node = table_pair_new(pair_mem, map_new[min_vi]);
-      node->val = 0;
-      while (qt < qh)
-      {
-        int x = q[qt++];
-        s[s_cnt++] = x;
-        node = table_pair_find(pair_mem, x);
-        int cd = node->val;
-        if (cd >= min_ecc) continue;
-        FOR_ADJ(G_GRAPH->edges[x], neigh)
-        {
-          int y = neigh->key;
-          node = table_pair_find(pair_mem, y);
-          if (!node)
-          {
-            node = table_pair_new(pair_mem, y);
-            node->val = cd + 1;
-            q[qh++] = y;
-          }
-        }
-        FOR_ADJ_END;
-      }
-      table_pair_cleanup(pair_mem);
-    }
-    
-    for (int i = 0; i < s_cnt; i++)
+  SUBISO_OP * o = (SUBISO_OP *)xmalloc(sizeof(*o));
+  o->x = x;
+  o->next = next;
+  o->out = NULL;
+  o->has_last = 0;
+  o->mlen_new = ARR_LEN(x->bag_cont);
+  o->mlen_old = ARR_LEN(x->child_1->bag_cont);
+  o->prefix_len = x->chng_index;
+  o->suffix_len = o->mlen_new - o->prefix_len;
+  ARR_ALLOC(o->map_new, o->mlen_new);
+  ARR_ALLOC(o->last, o->mlen_new);
+  o->col_new = NULL;
+  o->s = o->q = NULL;
+  o->cnt = NULL;
+  o->pair_mem = NULL;
+  o->mem = 0;
+  o->suffix = o->g_suf = o->g_coff = o->g_run = o->heap = o->cur = NULL;
+  o->g_col = o->acc = o->tmp = NULL;
+  o->ft = NULL;
+  if (x->type == INTRODUCE_NODE)
+  {
+    ARR_ALLOC(o->suffix, o->suffix_len);
+    ARR_INIT(o->col_new);
+    /* Candidates are all vertices for PLAN_ANY, arrays of others grow with degrees/balls */
+    if (x->plan->strategy != PLAN_ANY) ARR_INIT(o->s);
+    if (x->plan->strategy == PLAN_NEIGH)
     {
-      *suffix = map_new[x->chng_index] = s[i];
-      clen_new = 0;
-      for (int j = 0; j < clen_old; j++)
-      {
-        if (NODE_CONSISTENT(s[i], col_old[j])) col_new[clen_new++] = SET_BIT(col_old[j], COLOUR[s[i]]);
-      }
-      if (clen_new)
-      {
-        subiso_tree_node * t_node = rbtree_subiso_lookup(ft, suffix);
-        for (int j = 0; j < clen_new; j++) ARR_PUSH(t_node->val, col_new[j]);
-      }
+      ARR_INIT(o->q);
+      ARR_ALLOC(o->cnt, G_GRAPH->n_cnt);
+      memset(o->cnt, 0, G_GRAPH->n_cnt * sizeof(*o->cnt));
+      o->mem = G_GRAPH->n_cnt * sizeof(*o->cnt);
+      resbuf_mem_charge(o->mem);
     }
-    memcpy(prefix_prev, prefix, prefix_len * sizeof(*prefix));
+    if (x->plan->strategy == PLAN_BALL) o->pair_mem = (PAIR_TABLE *)xmalloc(sizeof(*o->pair_mem));
+    o->ft = (SUBISO_TREE *)xmalloc(sizeof(*o->ft));
+    rbtree_subiso_init(o->ft);
   }
-  /* Push results of the last prefix */
-  FOR_SUBISO(ft, node)
+  else
   {
-    clen_new = col_uniq(node->val);
-    if (clen_new)
-    {
-      memcpy(map_new + prefix_len, node->key, suffix_len * sizeof(*node->key));
-      resbuf_push(r_new, map_new, mlen_new, node->val, clen_new);
-    }
+    ARR_INIT(o->g_suf);
+    ARR_INIT(o->g_col);
+    ARR_ALLOC(o->g_coff, 1);
+    o->g_coff[0] = 0;
+    ARR_INIT(o->g_run);
+    ARR_INIT(o->heap);
+    ARR_INIT(o->cur);
+    ARR_INIT(o->acc);
+    ARR_INIT(o->tmp);
   }
-  FOR_SUBISO_END;
-  FREE_SUBISO_TREE(ft);
-  xfree(ft);
-  xfree(pair_mem);
-  ARR_FREE(q);
-  ARR_FREE(s);
-  ARR_FREE(map_new);
-  ARR_FREE(map_old);
-  ARR_FREE(col_new);
-  ARR_FREE(col_old);
-  ARR_FREE(prefix);
-  ARR_FREE(prefix_prev);
-  ARR_FREE(suffix);
+  return o;
 }
 
 /* -------------------------
- * Function: subiso_forget
+ * Function: subiso_op_free
  * -------------------------
- * Handles main algorithm mapping in forget nodes.
+ * Deallocates an operator.
  *
  * Params:
- *   x     - current leaf node being processed
- *   r_old - buffer storing ingoing information from child node
- *   r_new - buffer to store outgoing information to
+ *   o - operator to be freed
  */
-static void subiso_forget (NICE_TREE_DEC_NODE * x, RESBUF * r_old, RESBUF * r_new)
+static void subiso_op_free (SUBISO_OP * o)
 {
-#ifdef LOCAL_DEBUG
-  DBG("~~~~~~~~~ F ~~~~~~~~~");
-  ntd_print_node(x);
-#endif
+  if (o->ft)
+  {
+    FREE_SUBISO_TREE(o->ft);
+    xfree(o->ft);
+  }
+  xfree(o->pair_mem);
+  resbuf_mem_release(o->mem);
+  ARR_FREE(o->map_new);
+  ARR_FREE(o->last);
+  ARR_FREE(o->suffix);
+  ARR_FREE(o->col_new);
+  ARR_FREE(o->s);
+  ARR_FREE(o->q);
+  ARR_FREE(o->cnt);
+  ARR_FREE(o->g_suf);
+  ARR_FREE(o->g_col);
+  ARR_FREE(o->g_coff);
+  ARR_FREE(o->g_run);
+  ARR_FREE(o->heap);
+  ARR_FREE(o->cur);
+  ARR_FREE(o->acc);
+  ARR_FREE(o->tmp);
+  free(o);
+}
 
-  u32 * map_old, * map_new, * col_old, * prefix, * prefix_prev, * suffix;
-  u32 mlen_old, mlen_new, clen_old, clen_new, prefix_len, suffix_len;
-  SUBISO_TREE * ft;
-
-  mlen_new = ARR_LEN(x->bag_cont);
-  mlen_old = mlen_new + 1;
-  ARR_ALLOC(map_new, mlen_new);
-  ARR_ALLOC(map_old, mlen_old);
-  ARR_ALLOC(col_old, 1 << F_GRAPH->n_cnt);
-
-  prefix_len = x->chng_index;
-  ARR_ALLOC(prefix, prefix_len + 1);
-  ARR_ALLOC(prefix_prev, prefix_len + 1);
-  for (int i = 0; i < prefix_len + 1; i++) prefix[i] = prefix_prev[i] = INF;
-  suffix_len = mlen_new - prefix_len;
-  ARR_ALLOC(suffix, suffix_len + 1);
-  for (int i = 0; i < suffix_len + 1; i++) suffix[i] = INF;
-  ft = (SUBISO_TREE * )xmalloc(sizeof(*ft));
-  rbtree_subiso_init(ft);
-  while (resbuf_read(r_old, map_old, mlen_old, col_old, &clen_old) != RES_EOF)
-  {
-    if (prefix_len) memcpy(prefix, map_old, prefix_len * sizeof(*prefix));
-    if (map_compare(prefix, prefix_prev) != MAP_EQUAL) /* New prefix -> push results of the last one */
-    {
-      FOR_SUBISO(ft, node)
-      {
-        clen_new = col_uniq(node->val);
-        if (clen_new)
-        {
-          if (suffix_len) memcpy(map_new + prefix_len, node->key, suffix_len * sizeof(*map_new));
-          resbuf_push(r_new, map_new, mlen_new, node->val, clen_new);
-        }
-      }
-      FOR_SUBISO_END;
-      FREE_SUBISO_TREE(ft);
-      rbtree_subiso_init(ft);
-      if (prefix_len) memcpy(map_new, prefix, prefix_len * sizeof(*prefix));
-    }
-    if (suffix_len) memcpy(suffix, map_old + prefix_len + 1, suffix_len * sizeof(*suffix));
-    subiso_tree_node * node = rbtree_subiso_lookup(ft, suffix);
-    for (int i = 0; i < clen_old; i++) ARR_PUSH(node->val, col_old[i]);
-    memcpy(prefix_prev, prefix, prefix_len * sizeof(*prefix));
+static void subiso_op_push (SUBISO_OP * o, u32 * map_old, umask * col_old, u32 clen_old, u32 lcp);
+
+/* -------------------------
+ * Function: subiso_op_emit
+ * -------------------------
+ * Passes an outgoing record of an operator to the parent's operator,
+ * or stores it to the output buffer.
+ *
+ * Params:
+ *   o    - operator the record comes from
+ *   map  - mapping of the record
+ *   col  - list of colours of the record
+ *   clen - number of colours
+ */
+static void subiso_op_emit (SUBISO_OP * o, u32 * map, umask * col, u32 clen)
+{
+  if (!o->next)
+  {
+    resbuf_push(o->out, map, o->mlen_new, col, clen);
+    return;
   }
-  /* Push results of the last prefix */
-  FOR_SUBISO(ft, node)
+  u32 lcp = 0;
+  if (o->has_last) while (lcp < o->mlen_new && map[lcp] == o->last[lcp]) ++lcp;
+  memcpy(o->last, map, o->mlen_new * sizeof(*map));
+  o->has_last = 1;
+  subiso_op_push(o->next, map, col, clen, lcp);
+}
+
+/* -------------------------
+ * Function: col_merge
+ * -------------------------
+ * Merges two sorted lists of colour bitmasks (without duplicates).
+ *
+ * Params:
+ *   dst  - array to store the merged list to (of length at least alen + blen)
+ *   a    - first list
+ *   alen - length of the first list
+ *   b    - second list
+ *   blen - length of the second list
+ *
+ * Returns:
+ *   Length of the merged list
+ */
+static u32 col_merge (umask * dst, umask * a, u32 alen, umask * b, u32 blen)
+{
+  u32 i, j, k;
+  i = j = k = 0;
+  while (i < alen && j < blen)
   {
-    clen_new = col_uniq(node->val);
-    if (clen_new)
+    if (a[i] < b[j]) dst[k++] = a[i++];
+    else if (a[i] > b[j]) dst[k++] = b[j++];
+    else
     {
-      if (suffix_len) memcpy(map_new + prefix_len, node->key, suffix_len * sizeof(*map_new));
-      resbuf_push(r_new, map_new, mlen_new, node->val, clen_new);
+      dst[k++] = a[i++];
+      ++j;
     }
   }
-  FOR_SUBISO_END;
-  FREE_SUBISO_TREE(ft);
-  xfree(ft);
-  ARR_FREE(map_new);
-  ARR_FREE(map_old);
-  ARR_FREE(col_old);
-  ARR_FREE(prefix);
-  ARR_FREE(prefix_prev);
-  ARR_FREE(suffix);
+  while (i < alen) dst[k++] = a[i++];
+  while (j < blen) dst[k++] = b[j++];
+  return k;
 }
 
 /* -------------------------
- * Function: subiso_join
+ * Function: forget_run_less
  * -------------------------
- * Handles main algorithm mapping in join nodes.
+ * Compares suffixes of the current records of two runs of a forget node.
  *
  * Params:
- *   x       - current leaf node being processed
- *   r_old_1 - buffer storing ingoing information from child node #1
- *   r_old_2 - buffer storing ingoing information from child node #2
- *   r_new   - buffer to store outgoing information to
+ *   o   - operator of the forget node
+ *   r_1 - first run
+ *   r_2 - second run
+ *
+ * Returns:
+ *   Non-zero if the suffix of r_1 is lexicographically smaller
  */
-static void subiso_join (NICE_TREE_DEC_NODE * x, RESBUF * r_old_1, RESBUF * r_old_2, RESBUF * r_new)
+static inline int forget_run_less (SUBISO_OP * o, u32 r_1, u32 r_2)
 {
-#ifdef LOCAL_DEBUG
-  DBG("~~~~~~~~~ J ~~~~~~~~~");
-  ntd_print_node(x);
-#endif
+  u32 * s_1 = o->g_suf + o->cur[r_1] * o->suffix_len;
+  u32 * s_2 = o->g_suf + o->cur[r_2] * o->suffix_len;
+  for (int i = 0; i < o->suffix_len; i++)
+  {
+    if (s_1[i] != s_2[i]) return s_1[i] < s_2[i];
+  }
+  return 0;
+}
 
-  u32 * map_old_1, * map_old_2, * col_old_1, * col_old_2, * col_new, * col_tmp;
-  u32 mlen_new, mlen_old, clen_new, clen_old_1, clen_old_2;
+/* -------------------------
+ * Function: forget_heap_down
+ * -------------------------
+ * Restores the heap property of the heap of runs from a given position down.
+ *
+ * Params:
+ *   o  - operator of the forget node
+ *   i  - position in the heap
+ *   hn - number of runs in the heap
+ */
+static void forget_heap_down (SUBISO_OP * o, u32 i, u32 hn)
+{
+  u32 * h = o->heap;
+  while (2 * i + 1 < hn)
+  {
+    u32 c = 2 * i + 1;
+    if (c + 1 < hn && forget_run_less(o, h[c + 1], h[c])) ++c;
+    if (!forget_run_less(o, h[c], h[i])) break;
+    u32 t = h[c];
+    h[c] = h[i];
+    h[i] = t;
+    i = c;
+  }
+}
 
-  mlen_new = mlen_old = ARR_LEN(x->bag_cont);
-  ARR_ALLOC(map_old_1, mlen_old);
-  ARR_ALLOC(map_old_2, mlen_old);
-  ARR_ALLOC(col_old_1, 1 << F_GRAPH->n_cnt);
-  ARR_ALLOC(col_old_2, 1 << F_GRAPH->n_cnt);
+/* -------------------------
+ * Function: subiso_forget_flush
+ * -------------------------
+ * Emits records of the current prefix group of a forget node. Records with
+ * the same value of the forgotten element form sorted runs, so the runs are
+ * merged by a heap and colour lists of equal suffixes are merged linearly.
+ *
+ * Params:
+ *   o - operator of the forget node
+ */
+static void subiso_forget_flush (SUBISO_OP * o)
+{
+  u32 r_cnt, hn, acc_len;
+  int have = 0;
 
-  if (resbuf_read(r_old_1, map_old_1, mlen_old, col_old_1, &clen_old_1) == RES_EOF ||
-      resbuf_read(r_old_2, map_old_2, mlen_old, col_old_2, &clen_old_2) == RES_EOF)
+  r_cnt = ARR_LEN(o->g_run);
+  if (!r_cnt) return;
+  ARR_PUSH(o->g_run, ARR_LEN(o->g_coff) - 1); /* End of the last run */
+  GARY_RESIZE(o->heap, r_cnt);
+  GARY_RESIZE(o->cur, r_cnt);
+  for (u32 r = 0; r < r_cnt; r++)
   {
-    FREE_TRANS_ARR();
-    return;
+    o->heap[r] = r;
+    o->cur[r] = o->g_run[r];
   }
-  while (1)
+  hn = r_cnt;
+  for (u32 i = hn / 2; i--; ) forget_heap_down(o, i, hn);
+  acc_len = 0;
+  while (hn)
   {
-    int cmpr = map_compare(map_old_1, map_old_2);
-    if (cmpr == MAP_LESS)
-    {
-      if (resbuf_read(r_old_1, map_old_1, mlen_old, col_old_1, &clen_old_1) == RES_EOF) break;
-    }
-    else if (cmpr == MAP_GREATER)
+    u32 r = o->heap[0], rec = o->cur[r];
+    u32 * suf = o->g_suf + rec * o->suffix_len;
+    if (!have || memcmp(suf, o->map_new + o->prefix_len, o->suffix_len * sizeof(*suf)))
     {
-      if (resbuf_read(r_old_2, map_old_2, mlen_old, col_old_2, &clen_old_2) == RES_EOF) break;
+      if (acc_len) subiso_op_emit(o, o->map_new, o->acc, acc_len);
+      memcpy(o->map_new + o->prefix_len, suf, o->suffix_len * sizeof(*suf));
+      acc_len = 0;
+      have = 1;
     }
-    else
-    {
-      ARR_INIT(col_new);
-      umask map_col = EMPTY_MASK;
-      for (int i = 0; i < ARR_LEN(map_old_1); i++) map_col = SET_BIT(map_col, COLOUR[map_old_1[i]]);
-      for (int i = 0; i < clen_old_1; i++) for (int j = 0; j < clen_old_2; j++)
-      {
-        if (COL_OK(map_col, col_old_1[i], col_old_2[j])) ARR_PUSH(col_new, col_old_1[i] | col_old_2[j]);
-      }
-      clen_new = col_uniq(col_new);
-      if (clen_new)
-      {
-        resbuf_push(r_new, map_old_1, mlen_old, col_new, clen_new);
-      }
-      ARR_FREE(col_new);
+    u32 clen = o->g_coff[rec + 1] - o->g_coff[rec];
+    if (ARR_LEN(o->tmp) < acc_len + clen) GARY_RESIZE(o->tmp, acc_len + clen);
+    acc_len = col_merge(o->tmp, o->acc, acc_len, o->g_col + o->g_coff[rec], clen);
+    umask * t = o->acc;
+    o->acc = o->tmp;
+    o->tmp = t;
+    if (++o->cur[r] == o->g_run[r + 1]) o->heap[0] = o->heap[--hn];
+    forget_heap_down(o, 0, hn);
+  }
+  if (acc_len) subiso_op_emit(o, o->map_new, o->acc, acc_len);
+  GARY_RESIZE(o->g_suf, 0);
+  GARY_RESIZE(o->g_col, 0);
+  GARY_RESIZE(o->g_coff, 1);
+  GARY_RESIZE(o->g_run, 0);
+}
 
-      if (resbuf_read(r_old_1, map_old_1, mlen_old, col_old_1, &clen_old_1) == RES_EOF ||
-          resbuf_read(r_old_2, map_old_2, mlen_old, col_old_2, &clen_old_2) == RES_EOF) break;
+/* -------------------------
+ * Function: subiso_op_flush
+ * -------------------------
+ * Emits records collected for the current prefix group (in sorted order).
+ *
+ * Params:
+ *   o - corresponding operator
+ */
+static void subiso_op_flush (SUBISO_OP * o)
+{
+  u32 clen_new;
+  if (o->x->type == FORGET_NODE)
+  {
+    subiso_forget_flush(o);
+    return;
+  }
+  FOR_SUBISO(o->ft, node)
+  {
+    clen_new = col_uniq(node->val);
+    if (clen_new)
+    {
+      if (o->suffix_len) memcpy(o->map_new + o->prefix_len, node->key, o->suffix_len * sizeof(*node->key));
+      subiso_op_emit(o, o->map_new, node->val, clen_new);
     }
   }
-  FREE_TRANS_ARR();
+  FOR_SUBISO_END;
+  FREE_SUBISO_TREE(o->ft);
+  rbtree_subiso_init(o->ft);
 }
 
 /* -------------------------
- * Function: subiso_dp
+ * Function: cand_reserve
  * -------------------------
- * Main algorithm filling DP tables in recursive manner bottom->top.
+ * Makes an auxiliary array of an introduce node long enough (doubling it),
+ * the growth is charged to the memory budget.
  *
  * Params:
- *   x    - current node being processed
+ *   o   - operator of the introduce node
+ *   arr - the array (o->s or o->q)
+ *   len - needed length
  *
  * Returns:
- *   Buffer with outgoing information about valid assigments (DP table record) in this node.
+ *   The (possibly moved) array
  */
-static RESBUF * subiso_dp (NICE_TREE_DEC_NODE * x)
+static int * cand_reserve (SUBISO_OP * o, int ** arr, u32 len)
 {
-  RESBUF * r_old_1, * r_old_2;
-  r_old_1 = r_old_2 = NULL;
-  resbuf_free(x->rbuf); /* If dp record was already filled in previous iteration */
-  x->rbuf = resbuf_init();
-  resbuf_chng_state(x->rbuf, RES_WRITE);
-  switch (x->type)
-  {
-    case LEAF_NODE:
-      {
-        subiso_leaf(x, x->rbuf);
-        break;
-      }
-    case INTRODUCE_NODE:
-      {
-        r_old_1 = subiso_dp(x->child_1);
-        subiso_introduce(x, r_old_1, x->rbuf);
-        break;
-      }
-    case FORGET_NODE:
-      {
-        r_old_1 = subiso_dp(x->child_1);
-        subiso_forget(x, r_old_1, x->rbuf);
-        break;
-      }
-    case JOIN_NODE:
-      {
-        r_old_1 = subiso_dp(x->child_1);
-        r_old_2 = subiso_dp(x->child_2);
-        subiso_join(x, r_old_1, r_old_2, x->rbuf);
-        break;
-      }
-    default:
-        break;
-  }
-  resbuf_chng_state(x->rbuf, RES_READ);
-  return x->rbuf;
+  u32 old = ARR_LEN(*arr);
+  if (old >= len) return *arr;
+  len = MAX(len, 2 * old);
+  GARY_RESIZE(*arr, len);
+  resbuf_mem_charge((u64)(len - old) * sizeof(**arr));
+  o->mem += (u64)(len - old) * sizeof(**arr);
+  return *arr;
 }
 
 /* -------------------------
- * Function: can_add
+ * Function: cand_neigh_one
  * -------------------------
- * Checks, whether a partial assigment in the current node can be added to an existing result
+ * Finds candidates for the introduced vertex having a single neighbour
+ * in the bag (PLAN_NEIGH_ONE) -- all neighbours of its image.
  *
  * Params:
- *   x       - current node being processed
- *   pos     - position of bag element (from F_GRAPH) that is being assigned node in G_GRAPH
- *   map     - assigment to all elements of this node's bag
- *   res_old - current result that is to be updated
+ *   o   - operator of the introduce node
+ *   map - mapping of the ingoing record (at positions of the outgoing one)
  *
  * Returns:
- *   Graph result structure with assigment (possibly partial) if assigment is possible,
- *   or NULL otherwise
+ *   Number of candidates stored to o->s
  */
-static GRAPH_RESULT * can_add (NICE_TREE_DEC_NODE * x, int pos, u32 * map, GRAPH_RESULT * res_old)
+static int cand_neigh_one (SUBISO_OP * o, u32 * map)
 {
-  /* Check if the new mapping doesn't contradict used colours so far */
-  if (!NODE_CONSISTENT(map[pos], res_old->used_cols)) return NULL;
-  /* Check if the mapping that induces newly mapped node actually corresponds to the mapping retrieved so far */
-  for (int j = 0; j < ARR_LEN(map); j++)
+  ADJ_TABLE * adj = G_GRAPH->edges[map[o->x->plan->nb_pos[0]]];
+  int * s = cand_reserve(o, &o->s, adj->hash_count), s_cnt = 0;
+  FOR_ADJ(adj, neigh)
   {
-    int mn = res_old->mapping[x->bag_cont[j]];
-    if (j == pos)
-    {
-      if (mn != INF) return NULL;
-    }
-    else
-    {
-      if (mn != INF && mn != map[j]) return NULL;
-    }
+    s[s_cnt++] = neigh->key;
   }
-  GRAPH_RESULT * res_new = graph_result_init(res_old->g);
-  for (int i = 0; i < ARR_LEN(res_old->mapping); i++) res_new->mapping[i] = res_old->mapping[i];
-  res_new->mapping[x->bag_cont[pos]] = map[pos];
-  res_new->used_cols = SET_BIT(res_old->used_cols, COLOUR[map[pos]]);
-  return res_new;
+  FOR_ADJ_END;
+  return s_cnt;
 }
 
 /* -------------------------
- * Function: subiso_reconstruct
+ * Function: cand_neigh
  * -------------------------
- * Reconstructs all found subgraphs by recursively examining already filled DP tables
+ * Finds candidates for the introduced vertex having more neighbours in the bag
+ * (PLAN_NEIGH) -- common neighbours of their images. Vertices are counted
+ * in a dense array, which is cleared using the list of touched vertices.
  *
  * Params:
- *   x       - current node being processed
- *   results - partial results from parent in nice tree decomposition
+ *   o   - operator of the introduce node
+ *   map - mapping of the ingoing record (at positions of the outgoing one)
  *
  * Returns:
- *   Array of (possibly partial) results after considering all valid assigments in this node
+ *   Number of candidates stored to o->s
  */
-static GRAPH_RESULT ** subiso_reconstruct (NICE_TREE_DEC_NODE * x, GRAPH_RESULT ** results)
+static int cand_neigh (SUBISO_OP * o, u32 * map)
 {
-  GRAPH_RESULT ** child_results, ** tmp_results;
-  switch (x->type)
+  SUBISO_PLAN * p = o->x->plan;
+  ADJ_TABLE * adj = G_GRAPH->edges[map[p->nb_pos[0]]];
+  byte * cnt = o->cnt;
+  int * s = cand_reserve(o, &o->s, adj->hash_count), * q = cand_reserve(o, &o->q, adj->hash_count);
+  int t_cnt = 0, s_cnt = 0;
+  FOR_ADJ(adj, neigh)
   {
-    case LEAF_NODE:
-    {
+    cnt[neigh->key] = 1;
+    q[t_cnt++] = neigh->key;
+  }
+  FOR_ADJ_END;
+  for (int i = 1; i < p->nb_cnt; i++)
+  {
+    FOR_ADJ(G_GRAPH->edges[map[p->nb_pos[i]]], neigh)
+    {
+      if (cnt[neigh->key] == i) ++cnt[neigh->key]; /* Neighbour of all images so far */
+    }
+    FOR_ADJ_END;
+  }
+  for (int i = 0; i < t_cnt; i++)
+  {
+    if (cnt[q[i]] == p->nb_cnt) s[s_cnt++] = q[i];
+    cnt[q[i]] = 0;
+  }
+  return s_cnt;
+}
+
+/* -------------------------
+ * Function: ball_bucket
+ * -------------------------
+ * Returns the bucket of the ball cache for a ball.
+ *
+ * Params:
+ *   anchor - centre of the ball
+ *   radius - radius of the ball
+ *
+ * Returns:
+ *   Pointer to the head of the bucket
+ */
+static inline int * ball_bucket (u32 anchor, u32 radius)
+{
+  return &ball_head[((anchor * 0x9e3779b1U) ^ radius) & (BALL_CACHE_ENTS - 1)];
+}
+
+/* -------------------------
+ * Function: ball_evict
+ * -------------------------
+ * Advances the clock hand of the ball cache up to the first entry that is
+ * unused or not referenced since the last pass, and evicts the entry.
+ * Expects ball_lock to be held.
+ *
+ * Returns:
+ *   Index of the released entry
+ */
+static int ball_evict (void)
+{
+  for (;; ball_hand = (ball_hand + 1) & (BALL_CACHE_ENTS - 1))
+  {
+    BALL_ENTRY * e = &ball_ent[ball_hand];
+    if (e->verts && e->ref)
+    {
+      e->ref = 0;
+      continue;
+    }
+    int x = ball_hand;
+    ball_hand = (ball_hand + 1) & (BALL_CACHE_ENTS - 1);
+    if (!e->verts) return x;
+    int * b = ball_bucket(e->anchor, e->radius);
+    while (*b != x + 1) b = &ball_ent[*b - 1].next;
+    *b = e->next;
+    ball_vals -= ARR_LEN(e->verts);
+    ARR_FREE(e->verts);
+    e->verts = NULL;
+    return x;
+  }
+}
+
+/* -------------------------
+ * Function: ball_find
+ * -------------------------
+ * Looks up a ball in the ball cache and copies its vertices.
+ *
+ * Params:
+ *   anchor - centre of the ball
+ *   radius - radius of the ball
+ *   o      - operator of the introduce node to store vertices of the ball to (o->s)
+ *
+ * Returns:
+ *   Number of vertices of the ball, or -1 if the ball is not cached
+ */
+static int ball_find (u32 anchor, u32 radius, SUBISO_OP * o)
+{
+  int res = -1;
+  pthread_mutex_lock(&ball_lock);
+  for (int x = *ball_bucket(anchor, radius); x; x = ball_ent[x - 1].next)
+  {
+    BALL_ENTRY * e = &ball_ent[x - 1];
+    if (e->anchor != anchor || e->radius != radius) continue;
+    e->ref = 1;
+    res = ARR_LEN(e->verts);
+    memcpy(cand_reserve(o, &o->s, res), e->verts, res * sizeof(*o->s));
+    break;
+  }
+  pthread_mutex_unlock(&ball_lock);
+  return res;
+}
+
+/* -------------------------
+ * Function: ball_add
+ * -------------------------
+ * Stores a ball to the ball cache (unless it is already there, e.g. added
+ * by another thread), evicting other balls to stay within BALL_CACHE_VALS.
+ *
+ * Params:
+ *   anchor - centre of the ball
+ *   radius - radius of the ball
+ *   verts  - sorted vertices of the ball
+ *   cnt    - number of vertices of the ball
+ */
+static void ball_add (u32 anchor, u32 radius, int * verts, int cnt)
+{
+  if (cnt > BALL_CACHE_VALS) return;
+  pthread_mutex_lock(&ball_lock);
+  int * b = ball_bucket(anchor, radius);
+  for (int x = *b; x; x = ball_ent[x - 1].next)
+  {
+    if (ball_ent[x - 1].anchor == anchor && ball_ent[x - 1].radius == radius)
+    {
+      pthread_mutex_unlock(&ball_lock);
+      return;
+    }
+  }
+  while (ball_vals + cnt > BALL_CACHE_VALS) ball_evict();
+  int x = (ball_used < BALL_CACHE_ENTS ? ball_used++ : ball_evict());
+  BALL_ENTRY * e = &ball_ent[x];
+  e->anchor = anchor;
+  e->radius = radius;
+  e->ref = 0;
+  ARR_ALLOC(e->verts, cnt);
+  memcpy(e->verts, verts, cnt * sizeof(*verts));
+  ball_vals += cnt;
+  e->next = *b; /* The bucket may have changed by the eviction */
+  *b = x + 1;
+  pthread_mutex_unlock(&ball_lock);
+}
+
+/* -------------------------
+ * Function: ball_free
+ * -------------------------
+ * Releases all balls of the ball cache.
+ */
+static void ball_free (void)
+{
+  for (int i = 0; i < ball_used; i++)
+  {
+    ARR_FREE(ball_ent[i].verts);
+    ball_ent[i].verts = NULL;
+  }
+  memset(ball_head, 0, sizeof(ball_head));
+  ball_used = ball_hand = ball_vals = 0;
+}
+
+/* -------------------------
+ * Function: cand_ball
+ * -------------------------
+ * Finds candidates for the introduced vertex having no neighbour in the bag
+ * (PLAN_BALL) -- vertices within distance of the eccentricity of the anchor
+ * from its image. Balls do not depend on the colouring, so they are kept
+ * in the ball cache.
+ *
+ * Params:
+ *   o   - operator of the introduce node
+ *   map - mapping of the ingoing record (at positions of the outgoing one)
+ *
+ * Returns:
+ *   Number of candidates stored to o->s
+ */
+static int cand_ball (SUBISO_OP * o, u32 * map)
+{
+  SUBISO_PLAN * p = o->x->plan;
+  PAIR_TABLE * pair_mem = o->pair_mem;
+  pair_table_node * node;
+  int * s, qt, qh;
+
+  if ((qh = ball_find(map[p->anchor], p->radius, o)) >= 0) return qh;
+  /* Vertices of the ball are found by BFS, o->s is its queue */
+  table_pair_init(pair_mem);
+  qt = qh = 0;
+  s = cand_reserve(o, &o->s, 1);
+  s[qh++] = map[p->anchor];
+  node = table_pair_new(pair_mem, map[p->anchor]);
+  node->val = 0;
+  while (qt < qh)
+  {
+    int x = s[qt++];
+    node = table_pair_find(pair_mem, x);
+    int cd = node->val;
+    if (cd >= p->radius) continue;
+    s = cand_reserve(o, &o->s, qh + G_GRAPH->edges[x]->hash_count);
+    FOR_ADJ(G_GRAPH->edges[x], neigh)
+    {
+      int y = neigh->key;
+      node = table_pair_find(pair_mem, y);
+      if (!node)
+      {
+        node = table_pair_new(pair_mem, y);
+        node->val = cd + 1;
+        s[qh++] = y;
+      }
+    }
+    FOR_ADJ_END;
+  }
+  table_pair_cleanup(pair_mem);
+  intarr_sort(s, qh);
+  ball_add(map[p->anchor], p->radius, s, qh);
+  return qh;
+}
+
+/* -------------------------
+ * Function: subiso_introduce
+ * -------------------------
+ * Handles main algorithm mapping of a single record in introduce nodes.
+ *
+ * Params:
+ *   o        - operator of the introduce node
+ *   map_old  - mapping of the ingoing record
+ *   col_old  - colours of the ingoing record
+ *   clen_old - number of colours of the ingoing record
+ */
+static void subiso_introduce (SUBISO_OP * o, u32 * map_old, umask * col_old, u32 clen_old)
+{
+  SUBISO_PLAN * p = o->x->plan;
+  u32 * map_new = o->map_new, * suffix = o->suffix;
+  u32 suffix_len = o->suffix_len, clen_new;
+  umask * col_new;
+  int * s, s_cnt, lo = -1, hi = G_GRAPH->n_cnt;
+
+  if (suffix_len - 1) memcpy(suffix + 1, map_old + p->pos, (suffix_len - 1) * sizeof(*map_old)); /* suffix_len is always >= 1 */
+  /* Try all assigments */
+  memcpy(map_new + p->pos, suffix, suffix_len * sizeof(*suffix));
+  if (ARR_LEN(o->col_new) < clen_old) GARY_RESIZE(o->col_new, clen_old);
+  col_new = o->col_new;
+  switch (p->strategy)
+  {
+    case PLAN_NEIGH_ONE:
+      s_cnt = cand_neigh_one(o, map_new);
+      break;
+    case PLAN_NEIGH:
+      s_cnt = cand_neigh(o, map_new);
+      break;
+    case PLAN_ANY:
+      s_cnt = G_GRAPH->n_cnt; /* All vertices, o->s is not used */
+      break;
+    default:
+      s_cnt = cand_ball(o, map_new);
+      break;
+  }
+  /* Bounds of the image of u by symmetry-breaking constraints */
+  for (int j = 0; j < p->lo_cnt; j++) lo = MAX(lo, (int)map_new[p->lo_pos[j]]);
+  for (int j = 0; j < p->hi_cnt; j++) hi = MIN(hi, (int)map_new[p->hi_pos[j]]);
+  
+  s = o->s; /* Candidate arrays may have moved */
+  for (int i = (s ? 0 : lo + 1); i < s_cnt; i++) /* Vertices of PLAN_ANY start above lo */
+  {
+    int v = (s ? s[i] : i);
+    if (v <= lo || v >= hi || !IS_CAND(p->u, v)) continue;
+    *suffix = map_new[p->pos] = v;
+    clen_new = 0;
+    for (int j = 0; j < clen_old; j++)
+    {
+      if (NODE_CONSISTENT(v, col_old[j])) col_new[clen_new++] = SET_BIT(col_old[j], COLOUR[v]);
+    }
+    if (clen_new)
+    {
+      subiso_tree_node * t_node = rbtree_subiso_lookup(o->ft, suffix);
+      for (int j = 0; j < clen_new; j++) ARR_PUSH(t_node->val, col_new[j]);
+    }
+  }
+}
+
+/* -------------------------
+ * Function: subiso_forget
+ * -------------------------
+ * Handles main algorithm mapping of a single record in forget nodes -- the
+ * record is stored without the forgotten element until its prefix group
+ * is complete (see subiso_forget_flush).
+ *
+ * Params:
+ *   o        - operator of the forget node
+ *   map_old  - mapping of the ingoing record
+ *   col_old  - colours of the ingoing record
+ *   clen_old - number of colours of the ingoing record
+ *   lcp      - length of the common prefix with the previous ingoing record
+ */
+static void subiso_forget (SUBISO_OP * o, u32 * map_old, umask * col_old, u32 clen_old, u32 lcp)
+{
+  /* The forgotten element differs -> a new sorted run of suffixes */
+  if (lcp <= o->prefix_len || !ARR_LEN(o->g_run)) ARR_PUSH(o->g_run, ARR_LEN(o->g_coff) - 1);
+  if (o->suffix_len)
+  {
+    u32 * suf = GARY_PUSH_MULTI(o->g_suf, o->suffix_len);
+    memcpy(suf, map_old + o->prefix_len + 1, o->suffix_len * sizeof(*suf));
+  }
+  if (clen_old)
+  {
+    umask * col = GARY_PUSH_MULTI(o->g_col, clen_old);
+    memcpy(col, col_old, clen_old * sizeof(*col));
+  }
+  ARR_PUSH(o->g_coff, ARR_LEN(o->g_col));
+}
+
+/* -------------------------
+ * Function: subiso_op_push
+ * -------------------------
+ * Passes an ingoing record to an operator. Records have to come in sorted
+ * order, so results of a prefix group are complete once the prefix changes.
+ *
+ * Params:
+ *   o        - corresponding operator
+ *   map_old  - mapping of the ingoing record
+ *   col_old  - colours of the ingoing record
+ *   clen_old - number of colours of the ingoing record
+ *   lcp      - length of the common prefix with the previous ingoing record
+ */
+static void subiso_op_push (SUBISO_OP * o, u32 * map_old, umask * col_old, u32 clen_old, u32 lcp)
+{
+  if (lcp < o->prefix_len) /* New prefix -> push results of the last one */
+  {
+    subiso_op_flush(o);
+    memcpy(o->map_new, map_old, o->prefix_len * sizeof(*map_old));
+  }
+  if (o->x->type == INTRODUCE_NODE) subiso_introduce(o, map_old, col_old, clen_old);
+  else subiso_forget(o, map_old, col_old, clen_old, lcp);
+}
+
+/* -------------------------
+ * Function: subiso_op_finish
+ * -------------------------
+ * Emits results of the last prefix group and finishes operators of parents.
+ *
+ * Params:
+ *   o - corresponding operator
+ */
+static void subiso_op_finish (SUBISO_OP * o)
+{
+  for (; o; o = o->next) subiso_op_flush(o);
+}
+
+/* -------------------------
+ * Function: subiso_chain_init
+ * -------------------------
+ * Creates operators for a chain of introduce/forget nodes (from x down to b),
+ * where each node passes its records directly to its parent. The chain can
+ * be run repeatedly (see subiso_chain_run).
+ *
+ * Params:
+ *   x - top node of the chain
+ *   b - bottom node of the chain
+ *
+ * Returns:
+ *   Operator of b (following operators are linked by next)
+ */
+static SUBISO_OP * subiso_chain_init (NICE_TREE_DEC_NODE * x, NICE_TREE_DEC_NODE * b)
+{
+  SUBISO_OP * o = subiso_op_init(x, NULL);
+  while (x != b)
+  {
+    x = x->child_1;
+    o = subiso_op_init(x, o);
+  }
+  return o;
+}
+
+/* -------------------------
+ * Function: subiso_chain_run
+ * -------------------------
+ * Passes all records of a buffer through a chain of operators.
+ *
+ * Params:
+ *   o     - bottom operator of the chain
+ *   r_old - buffer storing ingoing information from child node of the chain
+ *   r_new - buffer to store outgoing records of the top node to
+ */
+static void subiso_chain_run (SUBISO_OP * o, RESBUF * r_old, RESBUF * r_new)
+{
+  u32 * map;
+  umask * col;
+  int clen;
+
+  for (SUBISO_OP * t = o; t; t = t->next) /* Operators are left empty by subiso_op_finish */
+  {
+    t->has_last = 0;
+    if (!t->next) t->out = r_new;
+  }
+  ARR_ALLOC(map, o->mlen_old);
+  ARR_INIT(col);
+  while (resbuf_read(r_old, map, o->mlen_old, &col, &clen) != RES_EOF)
+  {
+    subiso_op_push(o, map, col, clen, resbuf_lcp(r_old));
+  }
+  subiso_op_finish(o);
+  ARR_FREE(map);
+  ARR_FREE(col);
+}
+
+/* -------------------------
+ * Function: subiso_chain_free
+ * -------------------------
+ * Deallocates all operators of a chain.
+ *
+ * Params:
+ *   o - bottom operator of the chain
+ */
+static void subiso_chain_free (SUBISO_OP * o)
+{
+  while (o)
+  {
+    SUBISO_OP * next = o->next;
+    subiso_op_free(o);
+    o = next;
+  }
+}
+
+/* -------------------------
+ * Function: subiso_join_rec
+ * -------------------------
+ * Joins colour lists of two records with the same mapping and stores
+ * the resulting record.
+ *
+ * Params:
+ *   map     - mapping of both records
+ *   mlen    - length of the mapping
+ *   col_1   - colours of the first record
+ *   clen_1  - number of colours of the first record
+ *   col_2   - colours of the second record
+ *   clen_2  - number of colours of the second record
+ *   col_new - auxiliary array for the joined colours
+ *   r_new   - buffer to store the resulting record to
+ */
+static void subiso_join_rec (u32 * map, u32 mlen, umask * col_1, u32 clen_1, umask * col_2, u32 clen_2,
+                             umask ** col_new, RESBUF * r_new)
+{
+  umask map_col = EMPTY_MASK;
+  for (int i = 0; i < mlen; i++) map_col = SET_BIT(map_col, COLOUR[map[i]]);
+  GARY_RESIZE(*col_new, 0);
+  for (int i = 0; i < clen_1; i++) for (int j = 0; j < clen_2; j++)
+  {
+    if (COL_OK(map_col, col_1[i], col_2[j])) ARR_PUSH(*col_new, col_1[i] | col_2[j]);
+  }
+  u32 clen_new = col_uniq(*col_new);
+  if (clen_new) resbuf_push(r_new, map, mlen, *col_new, clen_new);
+}
+
+/* -------------------------
+ * Function: subiso_join
+ * -------------------------
+ * Handles main algorithm mapping in join nodes (merge join of sorted records).
+ *
+ * Params:
+ *   x       - current leaf node being processed
+ *   r_old_1 - buffer storing ingoing information from child node #1
+ *   r_old_2 - buffer storing ingoing information from child node #2
+ *   r_new   - buffer to store outgoing information to
+ */
+static void subiso_join (NICE_TREE_DEC_NODE * x, RESBUF * r_old_1, RESBUF * r_old_2, RESBUF * r_new)
+{
 #ifdef LOCAL_DEBUG
-      DBG("~~~~~~~~~ R(L) ~~~~~~~~~");
-      ntd_print_node(x);
+  DBG("~~~~~~~~~ J ~~~~~~~~~");
+  ntd_print_node(x);
 #endif
-      child_results = results;
-      break;
+
+  u32 * map_old_1, * map_old_2;
+  umask * col_old_1, * col_old_2, * col_new;
+  u32 mlen_old;
+  int clen_old_1, clen_old_2;
+
+  mlen_old = ARR_LEN(x->bag_cont);
+  ARR_ALLOC(map_old_1, mlen_old);
+  ARR_ALLOC(map_old_2, mlen_old);
+  ARR_INIT(col_old_1);
+  ARR_INIT(col_old_2);
+  ARR_INIT(col_new);
+
+  if (resbuf_read(r_old_1, map_old_1, mlen_old, &col_old_1, &clen_old_1) == RES_EOF ||
+      resbuf_read(r_old_2, map_old_2, mlen_old, &col_old_2, &clen_old_2) == RES_EOF)
+  {
+    FREE_TRANS_ARR();
+    ARR_FREE(col_new);
+    return;
+  }
+  while (1)
+  {
+    int cmpr = map_compare(map_old_1, map_old_2);
+    if (cmpr == MAP_LESS)
+    {
+      if (resbuf_read(r_old_1, map_old_1, mlen_old, &col_old_1, &clen_old_1) == RES_EOF) break;
+    }
+    else if (cmpr == MAP_GREATER)
+    {
+      if (resbuf_read(r_old_2, map_old_2, mlen_old, &col_old_2, &clen_old_2) == RES_EOF) break;
+    }
+    else
+    {
+      subiso_join_rec(map_old_1, mlen_old, col_old_1, clen_old_1, col_old_2, clen_old_2, &col_new, r_new);
+      if (resbuf_read(r_old_1, map_old_1, mlen_old, &col_old_1, &clen_old_1) == RES_EOF ||
+          resbuf_read(r_old_2, map_old_2, mlen_old, &col_old_2, &clen_old_2) == RES_EOF) break;
+    }
+  }
+  FREE_TRANS_ARR();
+  ARR_FREE(col_new);
+}
+
+/* -------------------------
+ * Function: join_hash_fn
+ * -------------------------
+ * Hash function of mappings.
+ *
+ * Params:
+ *   map  - mapping
+ *   mlen - length of the mapping
+ */
+static inline u32 join_hash_fn (u32 * map, u32 mlen)
+{
+  u32 h = 0;
+  for (int i = 0; i < mlen; i++) h = (h ^ map[i]) * 0x9e3779b1U;
+  return h ^ (h >> 16);
+}
+
+/* -------------------------
+ * Function: join_hash_build
+ * -------------------------
+ * Reads all records of a buffer to a hash table indexed by their mappings.
+ *
+ * Params:
+ *   rb   - buffer with the records
+ *   mlen - length of mappings
+ *
+ * Returns:
+ *   Pointer to the newly created hash table
+ */
+static JOIN_HASH * join_hash_build (RESBUF * rb, u32 mlen)
+{
+  JOIN_HASH * ht = (JOIN_HASH *)xmalloc(sizeof(*ht));
+  u32 * map, rec_cnt;
+  u64 size;
+  umask * col;
+  int clen;
+
+  ht->mlen = mlen;
+  ARR_INIT(ht->map);
+  ARR_INIT(ht->col);
+  ARR_ALLOC(ht->coff, 1);
+  ht->coff[0] = 0;
+  ARR_ALLOC(map, mlen);
+  ARR_INIT(col);
+  while (resbuf_read(rb, map, mlen, &col, &clen) != RES_EOF)
+  {
+    if (mlen) memcpy(GARY_PUSH_MULTI(ht->map, mlen), map, mlen * sizeof(*map));
+    if (clen) memcpy(GARY_PUSH_MULTI(ht->col, clen), col, clen * sizeof(*col));
+    ARR_PUSH(ht->coff, ARR_LEN(ht->col));
+  }
+  rec_cnt = ARR_LEN(ht->coff) - 1;
+  for (size = 2; size < 2 * (u64)rec_cnt; size *= 2);
+  if (size > ((u64)1 << 32)) die("Too many records for a hash join"); /* Slots are hashed by u32 */
+  ht->mask = size - 1;
+  ARR_ALLOC(ht->slot, size);
+  memset(ht->slot, 0, size * sizeof(*ht->slot));
+  for (u32 i = 0; i < rec_cnt; i++)
+  {
+    u32 h = join_hash_fn(ht->map + i * mlen, mlen) & ht->mask;
+    while (ht->slot[h]) h = (h + 1) & ht->mask;
+    ht->slot[h] = i + 1;
+  }
+  ht->mem = (ARR_LEN(ht->map) + rec_cnt + 1 + size) * sizeof(u32) + ARR_LEN(ht->col) * sizeof(umask);
+  resbuf_mem_charge(ht->mem);
+  ARR_FREE(map);
+  ARR_FREE(col);
+  return ht;
+}
+
+/* -------------------------
+ * Function: join_hash_find
+ * -------------------------
+ * Finds a record with given mapping in a hash table.
+ *
+ * Params:
+ *   ht  - hash table
+ *   map - mapping to be found
+ *
+ * Returns:
+ *   Index of the record, or -1 if there is none
+ */
+static int join_hash_find (JOIN_HASH * ht, u32 * map)
+{
+  u32 h = join_hash_fn(map, ht->mlen) & ht->mask;
+  for (; ht->slot[h]; h = (h + 1) & ht->mask)
+  {
+    u32 i = ht->slot[h] - 1;
+    if (!memcmp(ht->map + i * ht->mlen, map, ht->mlen * sizeof(*map))) return i;
+  }
+  return -1;
+}
+
+/* -------------------------
+ * Function: join_hash_free
+ * -------------------------
+ * Deallocates a hash table of records and releases its memory.
+ *
+ * Params:
+ *   ht - hash table to be freed
+ */
+static void join_hash_free (JOIN_HASH * ht)
+{
+  resbuf_mem_release(ht->mem);
+  ARR_FREE(ht->map);
+  ARR_FREE(ht->col);
+  ARR_FREE(ht->coff);
+  ARR_FREE(ht->slot);
+  free(ht);
+}
+
+/* -------------------------
+ * Function: subiso_hash_join
+ * -------------------------
+ * Handles main algorithm mapping in join nodes when records of one child
+ * are in a hash table -- records of the other child are looked up there,
+ * so the outgoing records keep their order.
+ *
+ * Params:
+ *   x     - current join node being processed
+ *   ht    - hash table with records of the smaller child
+ *   r_old - buffer storing ingoing information from the other child
+ *   r_new - buffer to store outgoing information to
+ */
+static void subiso_hash_join (NICE_TREE_DEC_NODE * x, JOIN_HASH * ht, RESBUF * r_old, RESBUF * r_new)
+{
+  u32 * map;
+  umask * col, * col_new;
+  int clen, i;
+
+  ARR_ALLOC(map, ht->mlen);
+  ARR_INIT(col);
+  ARR_INIT(col_new);
+  while (resbuf_read(r_old, map, ht->mlen, &col, &clen) != RES_EOF)
+  {
+    if ((i = join_hash_find(ht, map)) < 0) continue;
+    subiso_join_rec(map, ht->mlen, col, clen, ht->col + ht->coff[i], ht->coff[i + 1] - ht->coff[i], &col_new, r_new);
+  }
+  ARR_FREE(map);
+  ARR_FREE(col);
+  ARR_FREE(col_new);
+}
+
+/* -------------------------
+ * Function: subiso_chunk_run
+ * -------------------------
+ * Processes a single chunk of records (run by a worker thread).
+ *
+ * Params:
+ *   arg - pointer to the corresponding SUBISO_CHUNK structure
+ */
+static void subiso_chunk_run (void * arg)
+{
+  SUBISO_CHUNK * c = (SUBISO_CHUNK *)arg;
+  if (c->x->type == JOIN_NODE)
+  {
+    if (c->ht) subiso_hash_join(c->x, c->ht, c->r_old, c->r_new);
+    else subiso_join(c->x, c->r_old, c->r_old_2, c->r_new);
+    return;
+  }
+  SUBISO_CHAINS * ch = c->chains;
+  SUBISO_OP * o = NULL;
+  pthread_mutex_lock(&ch->lock);
+  if (ARR_LEN(ch->idle)) o = *ARR_POP(ch->idle);
+  pthread_mutex_unlock(&ch->lock);
+  if (!o) o = subiso_chain_init(c->x, c->b);
+  subiso_chain_run(o, c->r_old, c->r_new);
+  pthread_mutex_lock(&ch->lock);
+  ARR_PUSH(ch->idle, o);
+  pthread_mutex_unlock(&ch->lock);
+}
+
+/* -------------------------
+ * Function: subiso_chunk_start
+ * -------------------------
+ * Closes the input of a chunk and hands it over to the worker threads.
+ *
+ * Params:
+ *   c - chunk to be started
+ */
+static void subiso_chunk_start (SUBISO_CHUNK * c)
+{
+  resbuf_chng_state(c->r_old, RES_READ);
+  if (c->r_old_2) resbuf_chng_state(c->r_old_2, RES_READ);
+  c->r_new = resbuf_init();
+  c->task.run = subiso_chunk_run;
+  c->task.arg = c;
+  sched_spawn(&c->task);
+}
+
+/* -------------------------
+ * Function: subiso_chunk_finish
+ * -------------------------
+ * Waits for a chunk to be processed and appends its output to the node's buffer.
+ *
+ * Params:
+ *   c     - chunk to be finished
+ *   r_new - buffer of the node the output belongs to
+ */
+static void subiso_chunk_finish (SUBISO_CHUNK * c, RESBUF * r_new)
+{
+  sched_wait(&c->task);
+  resbuf_append(r_new, c->r_new);
+  resbuf_free(c->r_old);
+  resbuf_free(c->r_old_2);
+  resbuf_free(c->r_new);
+}
+
+/* -------------------------
+ * Function: subiso_chunk_next
+ * -------------------------
+ * Returns a free chunk of a ring of chunks in progress (finishing the oldest
+ * chunk if all of them are busy).
+ *
+ * Params:
+ *   chunks - ring of chunks
+ *   c_head - position of the oldest chunk
+ *   c_cnt  - number of chunks in progress
+ *   x      - (top) node processing the chunk
+ *   r_new  - buffer of the node outputs of chunks belong to
+ *
+ * Returns:
+ *   Pointer to the chunk without input buffers
+ */
+static SUBISO_CHUNK * subiso_chunk_next (SUBISO_CHUNK * chunks, int * c_head, int * c_cnt,
+                                         NICE_TREE_DEC_NODE * x, RESBUF * r_new)
+{
+  if (*c_cnt == ARR_LEN(chunks)) /* All chunks busy -> wait for the oldest one */
+  {
+    subiso_chunk_finish(&chunks[*c_head], r_new);
+    *c_head = (*c_head + 1) % ARR_LEN(chunks);
+    --*c_cnt;
+  }
+  SUBISO_CHUNK * c = &chunks[(*c_head + (*c_cnt)++) % ARR_LEN(chunks)];
+  c->x = c->b = x;
+  c->r_old = c->r_old_2 = NULL;
+  c->ht = NULL;
+  c->chains = NULL;
+  return c;
+}
+
+/* -------------------------
+ * Function: subiso_chunk_drain
+ * -------------------------
+ * Finishes all chunks in progress (in their order).
+ *
+ * Params:
+ *   chunks - ring of chunks
+ *   c_head - position of the oldest chunk
+ *   c_cnt  - number of chunks in progress
+ *   r_new  - buffer of the node outputs of chunks belong to
+ */
+static void subiso_chunk_drain (SUBISO_CHUNK * chunks, int c_head, int c_cnt, RESBUF * r_new)
+{
+  for (; c_cnt; --c_cnt)
+  {
+    subiso_chunk_finish(&chunks[c_head], r_new);
+    c_head = (c_head + 1) % ARR_LEN(chunks);
+  }
+}
+
+/* -------------------------
+ * Function: subiso_par
+ * -------------------------
+ * Runs a chain of introduce/forget nodes (x down to b) in parallel. Ingoing
+ * records are split into chunks at boundaries of prefix groups, so each chunk
+ * can be processed independently. The prefix is the shortest one used by the
+ * nodes of the chain (first chng_index elements of a mapping), which is left
+ * untouched by all the nodes. Chunks are cut only at blocks of r_old starting
+ * a prefix group, found from block headers, and workers decode their ranges
+ * of r_old themselves (see resbuf_range). Outputs of chunks are concatenated in their
+ * original order, which keeps the outgoing records sorted. Operators of the
+ * chain are created once per thread and reused by its following chunks.
+ *
+ * Params:
+ *   x     - top node of the chain
+ *   b     - bottom node of the chain
+ *   r_old - buffer storing ingoing information from child node of b
+ *   r_new - buffer to store outgoing information of x to
+ */
+static void subiso_par (NICE_TREE_DEC_NODE * x, NICE_TREE_DEC_NODE * b, RESBUF * r_old, RESBUF * r_new)
+{
+  int plen = x->chng_index;
+  for (NICE_TREE_DEC_NODE * y = x; y != b; y = y->child_1) plen = MIN(plen, y->child_1->chng_index);
+  if (THR_CNT <= 1 || !plen)
+  {
+    SUBISO_OP * o = subiso_chain_init(x, b);
+    subiso_chain_run(o, r_old, r_new);
+    subiso_chain_free(o);
+    return;
+  }
+
+  u64 beg, end, c_recs;
+  u32 nrec, plcp, first;
+  int c_head, c_cnt;
+  SUBISO_CHUNK * chunks, * cur;
+  SUBISO_CHAINS chains = { .lock = PTHREAD_MUTEX_INITIALIZER, .x = x, .b = b };
+
+  ARR_INIT(chains.idle);
+  ARR_ALLOC(chunks, 2 * THR_CNT); /* Ring of chunks in progress */
+  c_head = c_cnt = 0;
+  beg = end = c_recs = 0;
+  while (1)
+  {
+    u64 pos = end;
+    int more = resbuf_blk_next(r_old, &pos, &nrec, &plcp, &first);
+    if (c_recs && (!more || (c_recs >= PAR_CHUNK_RECS && plcp < plen)))
+    {
+      cur = subiso_chunk_next(chunks, &c_head, &c_cnt, x, r_new);
+      cur->b = b;
+      cur->chains = &chains;
+      cur->r_old = resbuf_range(r_old, beg, end, c_recs);
+      subiso_chunk_start(cur);
+      beg = end;
+      c_recs = 0;
+    }
+    if (!more) break;
+    end = pos;
+    c_recs += nrec;
+  }
+  subiso_chunk_drain(chunks, c_head, c_cnt, r_new);
+  for (int i = 0; i < ARR_LEN(chains.idle); i++) subiso_chain_free(chains.idle[i]);
+  ARR_FREE(chains.idle);
+  ARR_FREE(chunks);
+}
+
+/* -------------------------
+ * Function: subiso_join_par
+ * -------------------------
+ * Runs a join node, in parallel if possible. If one child has much fewer
+ * records than the other one (see PAR_HASH_RATIO), its records are put to
+ * a hash table and the other child's records are looked up in chunks.
+ * Otherwise both inputs are range-partitioned by the first element
+ * of mappings and the corresponding partitions are merge-joined
+ * independently. Chunks are ranges of blocks found from block headers, which
+ * workers decode themselves (see resbuf_range); a block of r_old_2 spanning
+ * two partitions is given to both of them. Outputs of chunks are concatenated
+ * in their original order.
+ *
+ * Params:
+ *   x       - current join node being processed
+ *   r_old_1 - buffer storing ingoing information from child node #1
+ *   r_old_2 - buffer storing ingoing information from child node #2
+ *   r_new   - buffer to store outgoing information to
+ */
+static void subiso_join_par (NICE_TREE_DEC_NODE * x, RESBUF * r_old_1, RESBUF * r_old_2, RESBUF * r_new)
+{
+  u64 cnt_1 = resbuf_cnt(r_old_1), cnt_2 = resbuf_cnt(r_old_2);
+  u32 mlen = ARR_LEN(x->bag_cont);
+  JOIN_HASH * ht = NULL;
+
+  if (!cnt_1 || !cnt_2) return; /* No record has a match */
+  if (MIN(cnt_1, cnt_2) * PAR_HASH_RATIO <= MAX(cnt_1, cnt_2))
+  {
+    if (cnt_1 < cnt_2) /* Records of r_old_1 are looked up */
+    {
+      RESBUF * t = r_old_1;
+      r_old_1 = r_old_2;
+      r_old_2 = t;
+    }
+    ht = join_hash_build(r_old_2, mlen);
+    if (THR_CNT <= 1)
+    {
+      subiso_hash_join(x, ht, r_old_1, r_new);
+      join_hash_free(ht);
+      return;
+    }
+  }
+  else if (THR_CNT <= 1 || !mlen)
+  {
+    subiso_join(x, r_old_1, r_old_2, r_new);
+    return;
+  }
+
+  u64 * off_2 = NULL, * sum_2 = NULL, beg, end, c_recs;
+  u32 * first_2 = NULL, nrec, plcp, first, lo = 0;
+  int c_head, c_cnt, b_2 = 0, e_2 = 0;
+  SUBISO_CHUNK * chunks, * cur;
+
+  if (!ht) /* Blocks of r_old_2 -- offsets and record counts before them (with the end), first elements */
+  {
+    u64 pos = 0;
+    ARR_ALLOC(off_2, 1);
+    ARR_ALLOC(sum_2, 1);
+    ARR_INIT(first_2);
+    off_2[0] = sum_2[0] = 0;
+    while (resbuf_blk_next(r_old_2, &pos, &nrec, &plcp, &first))
+    {
+      ARR_PUSH(sum_2, sum_2[ARR_LEN(off_2) - 1] + nrec);
+      ARR_PUSH(off_2, pos);
+      ARR_PUSH(first_2, first);
+    }
+  }
+  ARR_ALLOC(chunks, 2 * THR_CNT); /* Ring of chunks in progress */
+  c_head = c_cnt = 0;
+  beg = end = c_recs = 0;
+  while (1)
+  {
+    u64 pos = end;
+    int more = resbuf_blk_next(r_old_1, &pos, &nrec, &plcp, &first);
+    /* Partitions of a merge join end where the first element changes */
+    if (c_recs && (!more || (c_recs >= PAR_CHUNK_RECS && (ht || !plcp))))
+    {
+      if (!ht) /* Blocks of r_old_2 with first elements in [lo, first), a block may fall into two partitions */
+      {
+        while (b_2 + 1 < ARR_LEN(first_2) && first_2[b_2 + 1] < lo) ++b_2;
+        for (e_2 = b_2; e_2 < ARR_LEN(first_2) && (!more || first_2[e_2] < first); ) ++e_2;
+      }
+      if (ht || e_2 > b_2)
+      {
+        cur = subiso_chunk_next(chunks, &c_head, &c_cnt, x, r_new);
+        cur->ht = ht;
+        cur->r_old = resbuf_range(r_old_1, beg, end, c_recs);
+        if (!ht) cur->r_old_2 = resbuf_range(r_old_2, off_2[b_2], off_2[e_2], sum_2[e_2] - sum_2[b_2]);
+        subiso_chunk_start(cur);
+      }
+      beg = end;
+      c_recs = 0;
+    }
+    if (!more) break;
+    if (!c_recs) lo = first;
+    end = pos;
+    c_recs += nrec;
+  }
+  subiso_chunk_drain(chunks, c_head, c_cnt, r_new);
+  if (ht) join_hash_free(ht);
+  ARR_FREE(off_2);
+  ARR_FREE(sum_2);
+  ARR_FREE(first_2);
+  ARR_FREE(chunks);
+}
+
+/* -------------------------
+ * Function: share_run_less
+ * -------------------------
+ * Compares current records of two sorted runs of reordered records.
+ *
+ * Params:
+ *   run  - runs
+ *   mlen - length of mappings
+ *   r_1  - first run
+ *   r_2  - second run
+ *
+ * Returns:
+ *   Non-zero if the current record of r_1 goes first
+ */
+static inline int share_run_less (SHARE_RUN * run, u32 mlen, u32 r_1, u32 r_2)
+{
+  u32 * m_1 = run[r_1].map, * m_2 = run[r_2].map;
+  for (u32 i = 0; i < mlen; i++)
+  {
+    if (m_1[i] != m_2[i]) return m_1[i] < m_2[i];
+  }
+  return r_1 < r_2;
+}
+
+/* -------------------------
+ * Function: share_heap_down
+ * -------------------------
+ * Restores the heap property of a heap of runs from a given position down.
+ *
+ * Params:
+ *   run  - runs
+ *   mlen - length of mappings
+ *   h    - heap of indices of runs
+ *   i    - position in the heap
+ *   hn   - number of runs in the heap
+ */
+static void share_heap_down (SHARE_RUN * run, u32 mlen, u32 * h, u32 i, u32 hn)
+{
+  while (2 * i + 1 < hn)
+  {
+    u32 c = 2 * i + 1;
+    if (c + 1 < hn && share_run_less(run, mlen, h[c + 1], h[c])) ++c;
+    if (!share_run_less(run, mlen, h[c], h[i])) break;
+    u32 t = h[c];
+    h[c] = h[i];
+    h[i] = t;
+    i = c;
+  }
+}
+
+/* -------------------------
+ * Function: share_run_flush
+ * -------------------------
+ * Sorts records collected from a shared DP table and writes them as a new run.
+ *
+ * Params:
+ *   run  - runs (a new one is added)
+ *   rec  - records to be sorted
+ *   map  - their mappings
+ *   col  - their colours
+ *   coff - offsets of their colours (with the end)
+ *   mlen - length of mappings
+ */
+static void share_run_flush (SHARE_RUN ** run, SHARE_REC * rec, u32 * map, umask * col, u32 * coff, u32 mlen)
+{
+  u32 cnt = ARR_LEN(coff) - 1;
+  for (u32 i = 0; i < cnt; i++)
+  {
+    rec[i].map = map + i * mlen;
+    rec[i].mlen = mlen;
+    rec[i].rec = i;
+  }
+  sharerec_sort(rec, cnt);
+  SHARE_RUN * r = GARY_PUSH_MULTI(*run, 1);
+  r->rb = resbuf_init();
+  resbuf_chng_state(r->rb, RES_WRITE);
+  for (u32 i = 0; i < cnt; i++)
+  {
+    u32 j = rec[i].rec;
+    resbuf_push(r->rb, rec[i].map, mlen, col + coff[j], coff[j + 1] - coff[j]);
+  }
+  resbuf_chng_state(r->rb, RES_READ);
+}
+
+/* -------------------------
+ * Function: share_read
+ * -------------------------
+ * Reads the DP table of the node a node shares with columns reordered to the
+ * bag of the node (see share_perm). Records with images outside candidates of
+ * the node's pattern are dropped. Unless the order of columns is the same,
+ * the records are sorted by chunks of SHARE_SORT_RECS records to runs, which
+ * are merged by a heap.
+ *
+ * Params:
+ *   x - node reading a shared table
+ *
+ * Returns:
+ *   Buffer with the read records (ready to be read)
+ */
+static RESBUF * share_read (NICE_TREE_DEC_NODE * x)
+{
+  u32 mlen = ARR_LEN(x->bag_cont), * map, * c_map, * c_off, * heap, hn;
+  umask * col, * c_col;
+  int clen, end = 0, id = 1;
+  SHARE_REC * rec;
+  SHARE_RUN * run;
+  RESBUF * src = x->share->rbuf, * out = NULL;
+
+  for (u32 j = 0; j < mlen; j++) if (x->share_perm[j] != j) id = 0;
+  ARR_ALLOC(map, mlen);
+  ARR_INIT(col);
+  ARR_INIT(c_map);
+  ARR_INIT(c_col);
+  ARR_ALLOC(c_off, 1);
+  c_off[0] = 0;
+  ARR_INIT(run);
+  if (id) /* Records stay sorted */
+  {
+    out = resbuf_init();
+    resbuf_chng_state(out, RES_WRITE);
+  }
+  resbuf_chng_state(src, RES_READ);
+  while (!end)
+  {
+    end = (resbuf_read(src, map, mlen, &col, &clen) == RES_EOF);
+    if (!end)
+    {
+      u32 j = 0, * m = GARY_PUSH_MULTI(c_map, mlen);
+      for (; j < mlen && IS_CAND(x->bag_cont[j], map[x->share_perm[j]]); j++) m[j] = map[x->share_perm[j]];
+      if (j == mlen && id) resbuf_push(out, m, mlen, col, clen);
+      else if (j == mlen)
+      {
+        if (clen) memcpy(GARY_PUSH_MULTI(c_col, clen), col, clen * sizeof(*col));
+        ARR_PUSH(c_off, ARR_LEN(c_col));
+      }
+      if (j < mlen || id) GARY_RESIZE(c_map, ARR_LEN(c_map) - mlen); /* Dropped or already written */
+    }
+    if (ARR_LEN(c_off) - 1 == SHARE_SORT_RECS || (end && ARR_LEN(c_off) > 1))
+    {
+      ARR_ALLOC(rec, ARR_LEN(c_off) - 1);
+      share_run_flush(&run, rec, c_map, c_col, c_off, mlen);
+      ARR_FREE(rec);
+      GARY_RESIZE(c_map, 0);
+      GARY_RESIZE(c_col, 0);
+      GARY_RESIZE(c_off, 1);
+    }
+  }
+  ARR_FREE(c_map);
+  ARR_FREE(c_col);
+  ARR_FREE(c_off);
+
+  if (ARR_LEN(run) == 1) out = run[0].rb;
+  else if (!out)
+  {
+    out = resbuf_init();
+    resbuf_chng_state(out, RES_WRITE); /* Stays empty without runs */
+    ARR_ALLOC(heap, ARR_LEN(run));
+    hn = 0;
+    for (u32 r = 0; r < ARR_LEN(run); r++)
+    {
+      ARR_ALLOC(run[r].map, mlen);
+      ARR_INIT(run[r].col);
+      resbuf_read(run[r].rb, run[r].map, mlen, &run[r].col, &run[r].clen);
+      heap[hn++] = r;
+    }
+    for (u32 i = hn / 2; i--; ) share_heap_down(run, mlen, heap, i, hn);
+    while (hn)
+    {
+      SHARE_RUN * r = &run[heap[0]];
+      resbuf_push(out, r->map, mlen, r->col, r->clen);
+      if (resbuf_read(r->rb, r->map, mlen, &r->col, &r->clen) == RES_EOF) heap[0] = heap[--hn];
+      share_heap_down(run, mlen, heap, 0, hn);
+    }
+    for (u32 r = 0; r < ARR_LEN(run); r++)
+    {
+      resbuf_free(run[r].rb);
+      ARR_FREE(run[r].map);
+      ARR_FREE(run[r].col);
+    }
+    ARR_FREE(heap);
+  }
+  resbuf_chng_state(out, RES_READ);
+  ARR_FREE(run);
+  ARR_FREE(map);
+  ARR_FREE(col);
+  return out;
+}
+
+/* -------------------------
+ * Function: subiso_rbuf
+ * -------------------------
+ * Gets DP buffer of a node, which is the one of another pattern's node if
+ * the table is shared and read as it is (see subiso_share).
+ *
+ * Params:
+ *   x - node
+ *
+ * Returns:
+ *   Buffer with DP table records of x
+ */
+static inline RESBUF * subiso_rbuf (NICE_TREE_DEC_NODE * x)
+{
+  return (x->share && !x->share_perm ? x->share : x)->rbuf;
+}
+
+/* -------------------------
+ * Function: subiso_release
+ * -------------------------
+ * Releases DP buffer of a node after its parent consumed it, unless the buffer
+ * is needed later during reconstruction or by following patterns of a batch.
+ *
+ * Params:
+ *   x - node whose buffer has been consumed
+ */
+static void subiso_release (NICE_TREE_DEC_NODE * x)
+{
+  if (x->keep_rbuf || x->shared) return;
+  resbuf_free(x->rbuf);
+  x->rbuf = NULL;
+}
+
+static RESBUF * subiso_dp (NICE_TREE_DEC_NODE * x);
+
+/* -------------------------
+ * Function: subiso_dp_task
+ * -------------------------
+ * Evaluates a subtree of ntd (run by a worker thread).
+ *
+ * Params:
+ *   arg - root of the subtree to be evaluated
+ */
+static void subiso_dp_task (void * arg)
+{
+  subiso_dp((NICE_TREE_DEC_NODE *)arg);
+}
+
+/* -------------------------
+ * Function: subiso_dp
+ * -------------------------
+ * Main algorithm filling DP tables in recursive manner bottom->top.
+ *
+ * Params:
+ *   x    - current node being processed
+ *
+ * Returns:
+ *   Buffer with outgoing information about valid assigments (DP table record) in this node.
+ */
+static RESBUF * subiso_dp (NICE_TREE_DEC_NODE * x)
+{
+  RESBUF * r_old_1, * r_old_2;
+  r_old_1 = r_old_2 = NULL;
+  if (x->share) /* Already evaluated for a preceding pattern of a batch */
+  {
+    if (!x->share_perm)
+    {
+      resbuf_chng_state(x->share->rbuf, RES_READ);
+      return x->share->rbuf;
+    }
+    resbuf_free(x->rbuf);
+    return x->rbuf = share_read(x);
+  }
+  resbuf_free(x->rbuf); /* If dp record was already filled in previous iteration */
+  x->rbuf = resbuf_init();
+  resbuf_chng_state(x->rbuf, RES_WRITE);
+  switch (x->type)
+  {
+    case LEAF_NODE:
+      {
+        subiso_leaf(x, x->rbuf);
+        break;
+      }
+    case INTRODUCE_NODE:
+    case FORGET_NODE:
+      {
+        /* Fused children pass their records directly to x, so the whole chain is run at once */
+        NICE_TREE_DEC_NODE * b = x;
+        while (b->child_1->fused) b = b->child_1;
+        r_old_1 = subiso_dp(b->child_1);
+        subiso_par(x, b, r_old_1, x->rbuf);
+        subiso_release(b->child_1);
+        break;
+      }
+    case JOIN_NODE:
+      {
+        /* Subtrees are independent -> the second one is left to other threads if it is heavy enough;
+           the first one lowers the estimated peak memory or has more join nodes (see ntd_preprocess),
+           so it is kept by this thread */
+        if (THR_CNT > 1 && x->child_2->in_cnt >= PAR_SPAWN_INTR)
+        {
+          SCHED_TASK t;
+          t.run = subiso_dp_task;
+          t.arg = x->child_2;
+          sched_spawn(&t);
+          r_old_1 = subiso_dp(x->child_1);
+          sched_wait(&t);
+          r_old_2 = subiso_rbuf(x->child_2);
+        }
+        else
+        {
+          r_old_1 = subiso_dp(x->child_1);
+          r_old_2 = subiso_dp(x->child_2);
+        }
+        subiso_join_par(x, r_old_1, r_old_2, x->rbuf);
+        subiso_release(x->child_1);
+        subiso_release(x->child_2);
+        break;
+      }
+    default:
+        break;
+  }
+  resbuf_chng_state(x->rbuf, RES_READ);
+  return x->rbuf;
+}
+
+/* -------------------------
+ * Function: subiso_dp_shared
+ * -------------------------
+ * Evaluates only subtrees whose DP tables are read by following patterns
+ * of a batch (for a pattern whose results are already complete).
+ *
+ * Params:
+ *   x - root of the searched subtree
+ */
+static void subiso_dp_shared (NICE_TREE_DEC_NODE * x)
+{
+  if (x->shared) /* Shared tables below x are kept by its evaluation */
+  {
+    subiso_dp(x);
+    return;
+  }
+  if (x->child_1) subiso_dp_shared(x->child_1);
+  if (x->child_2) subiso_dp_shared(x->child_2);
+}
+
+/* -------------------------
+ * Function: recon_key_cmp
+ * -------------------------
+ * Compares keys lexicographically.
+ *
+ * Params:
+ *   a   - first key
+ *   b   - second key
+ *   len - length of keys
+ *
+ * Returns:
+ *   MAP_LESS/MAP_GREATER/MAP_EQUAL in corresponding situations
+ */
+static inline int recon_key_cmp (u32 * a, u32 * b, u32 len)
+{
+  for (u32 i = 0; i < len; i++)
+  {
+    if (a[i] != b[i]) return a[i] < b[i] ? MAP_LESS : MAP_GREATER;
+  }
+  return MAP_EQUAL;
+}
+
+/* -------------------------
+ * Function: recon_run_less
+ * -------------------------
+ * Compares keys of the current records of two runs of a prefix group. Runs
+ * are ordered by the forgotten vertex, which breaks ties.
+ *
+ * Params:
+ *   g   - prefix group
+ *   r_1 - first run
+ *   r_2 - second run
+ *
+ * Returns:
+ *   Non-zero if the current record of r_1 goes first
+ */
+static inline int recon_run_less (RECON_GROUP * g, u32 r_1, u32 r_2)
+{
+  u32 * m_1 = g->map + g->cur[r_1] * g->mlen, * m_2 = g->map + g->cur[r_2] * g->mlen;
+  int c = recon_key_cmp(m_1 + g->pos, m_2 + g->pos, g->mlen - 1 - g->pos);
+  return c == MAP_EQUAL ? r_1 < r_2 : c == MAP_LESS;
+}
+
+/* -------------------------
+ * Function: recon_heap_down
+ * -------------------------
+ * Restores the heap property of the heap of runs from a given position down.
+ *
+ * Params:
+ *   g  - prefix group
+ *   i  - position in the heap
+ *   hn - number of runs in the heap
+ */
+static void recon_heap_down (RECON_GROUP * g, u32 i, u32 hn)
+{
+  u32 * h = g->heap;
+  while (2 * i + 1 < hn)
+  {
+    u32 c = 2 * i + 1;
+    if (c + 1 < hn && recon_run_less(g, h[c + 1], h[c])) ++c;
+    if (!recon_run_less(g, h[c], h[i])) break;
+    u32 t = h[c];
+    h[c] = h[i];
+    h[i] = t;
+    i = c;
+  }
+}
+
+/* -------------------------
+ * Function: recon_group_flush
+ * -------------------------
+ * Writes records of a prefix group sorted by their keys. Records with the same
+ * forgotten vertex form sorted runs (as in subiso_forget_flush), so the runs
+ * are merged by a heap.
+ *
+ * Params:
+ *   g   - prefix group
+ *   out - buffer to write the records to
+ */
+static void recon_group_flush (RECON_GROUP * g, RESBUF * out)
+{
+  u32 r_cnt = ARR_LEN(g->run), hn;
+  if (!r_cnt) return;
+  ARR_PUSH(g->run, ARR_LEN(g->coff) - 1); /* End of the last run */
+  GARY_RESIZE(g->heap, r_cnt);
+  GARY_RESIZE(g->cur, r_cnt);
+  for (u32 r = 0; r < r_cnt; r++)
+  {
+    g->heap[r] = r;
+    g->cur[r] = g->run[r];
+  }
+  hn = r_cnt;
+  for (u32 i = hn / 2; i--; ) recon_heap_down(g, i, hn);
+  while (hn)
+  {
+    u32 r = g->heap[0], rec = g->cur[r];
+    resbuf_push(out, g->map + rec * g->mlen, g->mlen, g->col + g->coff[rec], g->coff[rec + 1] - g->coff[rec]);
+    if (++g->cur[r] == g->run[r + 1]) g->heap[0] = g->heap[--hn];
+    recon_heap_down(g, 0, hn);
+  }
+  GARY_RESIZE(g->map, 0);
+  GARY_RESIZE(g->col, 0);
+  GARY_RESIZE(g->coff, 1);
+  GARY_RESIZE(g->run, 0);
+}
+
+/* -------------------------
+ * Function: recon_table_init
+ * -------------------------
+ * Creates a table of records of the child of a forget node. The records are
+ * only sorted when the level is reached (see recon_table_index).
+ *
+ * Params:
+ *   x - forget node
+ *
+ * Returns:
+ *   Pointer to the newly created table
+ */
+static RECON_TABLE * recon_table_init (NICE_TREE_DEC_NODE * x)
+{
+  RECON_TABLE * t = (RECON_TABLE *)xmalloc(sizeof(*t));
+  t->x = x;
+  t->mlen = ARR_LEN(x->child_1->bag_cont);
+  t->pos = x->chng_index;
+  t->rb = NULL;
+  t->blk = -1;
+  t->q_head = t->q_len = 0;
+  t->map = t->coff = NULL;
+  t->col = NULL;
+  t->num = NULL;
+  t->mem = 0;
+  ARR_INIT(t->item);
+  ARR_INIT(t->ioff);
+  ARR_INIT(t->boff);
+  ARR_INIT(t->brec);
+  ARR_INIT(t->bcol);
+  ARR_INIT(t->bkey);
+  ARR_INIT(t->dec);
+  ARR_INIT(t->queue);
+  return t;
+}
+
+/* -------------------------
+ * Function: recon_table_index
+ * -------------------------
+ * Rewrites records of the child's buffer sorted by their keys, prefix group
+ * by prefix group (see recon_group_flush), and releases the child's buffer
+ * unless other patterns of a batch read it. Then blocks of the sorted records
+ * are indexed by their first keys, the index is accounted in the memory budget.
+ * Nothing is done if the index already exists.
+ *
+ * Params:
+ *   t - table of records
+ */
+static void recon_table_index (RECON_TABLE * t)
+{
+  RECON_GROUP g;
+  u32 * map, klen = t->mlen - 1;
+  u64 rec = 0, cols = 0;
+  umask * col;
+  int clen;
+
+  if (t->rb) return;
+  g.mlen = t->mlen;
+  g.pos = t->pos;
+  ARR_INIT(g.map);
+  ARR_INIT(g.col);
+  ARR_ALLOC(g.coff, 1);
+  g.coff[0] = 0;
+  ARR_INIT(g.run);
+  ARR_INIT(g.heap);
+  ARR_INIT(g.cur);
+  ARR_ALLOC(map, t->mlen);
+  ARR_INIT(col);
+  NICE_TREE_DEC_NODE * c = t->x->child_1;
+  if (c->share_perm && !c->rbuf) c->rbuf = share_read(c);
+  RESBUF * src = subiso_rbuf(c);
+  t->rb = resbuf_init();
+  resbuf_blk_recs(t->rb, RES_RAND_RECS);
+  resbuf_chng_state(src, RES_READ);
+  while (resbuf_read(src, map, t->mlen, &col, &clen) != RES_EOF)
+  {
+    u32 lcp = resbuf_lcp(src);
+    if (lcp < t->pos) recon_group_flush(&g, t->rb); /* New prefix */
+    /* The forgotten vertex differs -> a new sorted run of keys */
+    if (lcp <= t->pos || !ARR_LEN(g.run)) ARR_PUSH(g.run, ARR_LEN(g.coff) - 1);
+    u32 * m = GARY_PUSH_MULTI(g.map, t->mlen);
+    memcpy(m, map, t->pos * sizeof(*map));
+    memcpy(m + t->pos, map + t->pos + 1, (klen - t->pos) * sizeof(*map));
+    m[klen] = map[t->pos];
+    if (clen) memcpy(GARY_PUSH_MULTI(g.col, clen), col, clen * sizeof(*col));
+    ARR_PUSH(g.coff, ARR_LEN(g.col));
+  }
+  recon_group_flush(&g, t->rb);
+  resbuf_chng_state(t->rb, RES_READ);
+  if (!c->shared && (!c->share || c->share_perm))
+  {
+    resbuf_free(c->rbuf);
+    c->rbuf = NULL;
+  }
+  
+  while (resbuf_read(t->rb, map, t->mlen, &col, &clen) != RES_EOF)
+  {
+    u64 off = resbuf_tell(t->rb);
+    if (!ARR_LEN(t->boff) || t->boff[ARR_LEN(t->boff) - 1] != off)
+    {
+      ARR_PUSH(t->boff, off);
+      ARR_PUSH(t->brec, rec);
+      ARR_PUSH(t->bcol, cols);
+      if (klen) memcpy(GARY_PUSH_MULTI(t->bkey, klen), map, klen * sizeof(*map));
+    }
+    rec++;
+    cols += clen;
+  }
+  ARR_PUSH(t->brec, rec);
+  ARR_PUSH(t->bcol, cols);
+  GARY_RESIZE(t->dec, ARR_LEN(t->boff));
+  GARY_RESIZE(t->queue, ARR_LEN(t->boff));
+  memset(t->dec, 0, ARR_LEN(t->dec) * sizeof(*t->dec));
+  t->mem = ARR_LEN(t->boff) * (sizeof(*t->boff) + sizeof(*t->brec) + sizeof(*t->bcol) + sizeof(*t->dec) + sizeof(*t->queue)) + ARR_LEN(t->bkey) * sizeof(*t->bkey);
+  resbuf_mem_charge(t->mem);
+  ARR_FREE(g.map);
+  ARR_FREE(g.col);
+  ARR_FREE(g.coff);
+  ARR_FREE(g.run);
+  ARR_FREE(g.heap);
+  ARR_FREE(g.cur);
+  ARR_FREE(map);
+  ARR_FREE(col);
+}
+
+/* -------------------------
+ * Function: recon_block_free
+ * -------------------------
+ * Deallocates a decoded block of a table and releases its memory.
+ *
+ * Params:
+ *   t - table of records
+ *   b - index of the block
+ */
+static void recon_block_free (RECON_TABLE * t, u32 b)
+{
+  RECON_BLOCK * k = t->dec[b];
+  resbuf_mem_release(k->mem);
+  ARR_FREE(k->map);
+  ARR_FREE(k->col);
+  ARR_FREE(k->coff);
+  free(k);
+  t->dec[b] = NULL;
+}
+
+/* -------------------------
+ * Function: recon_table_load
+ * -------------------------
+ * Makes a block of sorted records the one being read. A block which is not
+ * decoded yet is decoded and cached if it fits into the memory budget, after
+ * blocks of the table decoded first are dropped if needed. Otherwise it is
+ * dropped once another block is read.
+ *
+ * Params:
+ *   t - table of records
+ *   b - index of the block
+ */
+static void recon_table_load (RECON_TABLE * t, u32 b)
+{
+  u32 n = t->brec[b + 1] - t->brec[b];
+  RECON_BLOCK * k;
+  umask * col;
+  int clen;
+
+  if (t->blk == b) return;
+  if (t->blk != -1U && t->dec[t->blk] && !t->dec[t->blk]->mem) recon_block_free(t, t->blk);
+  if (!(k = t->dec[b]))
+  {
+    k = t->dec[b] = (RECON_BLOCK *)xmalloc(sizeof(*k));
+    ARR_ALLOC(k->map, n * t->mlen);
+    ARR_INIT(k->col);
+    ARR_ALLOC(k->coff, n + 1);
+    ARR_INIT(col);
+    k->coff[0] = 0;
+    resbuf_seek(t->rb, t->boff[b]);
+    for (u32 i = 0; i < n; i++)
+    {
+      resbuf_read(t->rb, k->map + i * t->mlen, t->mlen, &col, &clen);
+      if (clen) memcpy(GARY_PUSH_MULTI(k->col, clen), col, clen * sizeof(*col));
+      k->coff[i + 1] = ARR_LEN(k->col);
+    }
+    ARR_FREE(col);
+    u64 mem = sizeof(*k) + (n * t->mlen + n + 1) * sizeof(u32) + ARR_LEN(k->col) * sizeof(umask);
+    while (!(k->mem = resbuf_mem_reserve(mem) ? mem : 0) && t->q_len)
+    {
+      recon_block_free(t, t->queue[t->q_head]);
+      t->q_head = (t->q_head + 1) % ARR_LEN(t->queue);
+      t->q_len--;
+    }
+    if (k->mem) t->queue[(t->q_head + t->q_len++) % ARR_LEN(t->queue)] = b;
+  }
+  t->blk = b;
+  t->map = k->map;
+  t->col = k->col;
+  t->coff = k->coff;
+}
+
+/* -------------------------
+ * Function: recon_table_next
+ * -------------------------
+ * Finds the next record of a table with given key. The first one is found by
+ * binary search over first keys of blocks and then within the decoded block.
+ *
+ * Params:
+ *   t   - table of records
+ *   key - key to be found
+ *   b   - block of the current record
+ *   r   - current record of the block + 1 (0 to find the first one)
+ *
+ * Returns:
+ *   Index of the record in the decoded block + 1, or 0 if there is none left
+ */
+static u32 recon_table_next (RECON_TABLE * t, u32 * key, u32 * b, u32 r)
+{
+  u32 klen = t->mlen - 1, lo = 0, hi, b_cnt;
+  recon_table_index(t);
+  b_cnt = ARR_LEN(t->boff);
+  if (!r)
+  {
+    if (!b_cnt) return 0;
+    /* The first block starting by a key not less than key, the key may begin in the preceding one */
+    hi = b_cnt;
+    while (lo < hi)
+    {
+      u32 mid = (lo + hi) / 2;
+      if (recon_key_cmp(t->bkey + mid * klen, key, klen) == MAP_LESS) lo = mid + 1;
+      else hi = mid;
+    }
+    *b = lo ? lo - 1 : 0;
+    recon_table_load(t, *b);
+    lo = 0;
+    hi = t->brec[*b + 1] - t->brec[*b];
+    while (lo < hi)
+    {
+      u32 mid = (lo + hi) / 2;
+      if (recon_key_cmp(t->map + mid * t->mlen, key, klen) == MAP_LESS) lo = mid + 1;
+      else hi = mid;
+    }
+    r = lo;
+  }
+  if (r == t->brec[*b + 1] - t->brec[*b])
+  {
+    /* Records with the key continue in the following block */
+    if (*b + 1 == b_cnt || recon_key_cmp(t->bkey + (*b + 1) * klen, key, klen) != MAP_EQUAL) return 0;
+    recon_table_load(t, ++*b);
+    return 1;
+  }
+  return recon_key_cmp(t->map + r * t->mlen, key, klen) == MAP_EQUAL ? r + 1 : 0;
+}
+
+/* -------------------------
+ * Function: recon_table_block
+ * -------------------------
+ * Finds the block containing a record or a colour set given by its index
+ * in the whole table and decodes it.
+ *
+ * Params:
+ *   t    - table of records
+ *   base - indices of the first records (t->brec) or colour sets (t->bcol) of blocks
+ *   i    - index of the record or colour set
+ *
+ * Returns:
+ *   Index of the block
+ */
+static u32 recon_table_block (RECON_TABLE * t, u64 * base, u64 i)
+{
+  u32 lo = 0, hi = ARR_LEN(t->boff) - 1;
+  while (lo < hi)
+  {
+    u32 mid = (lo + hi) / 2;
+    if (base[mid + 1] > i) hi = mid;
+    else lo = mid + 1;
+  }
+  recon_table_load(t, lo);
+  return lo;
+}
+
+/* -------------------------
+ * Function: recon_table_free
+ * -------------------------
+ * Deallocates a table of records and releases its memory.
+ *
+ * Params:
+ *   t - table to be freed
+ */
+static void recon_table_free (RECON_TABLE * t)
+{
+  for (u32 b = 0; b < ARR_LEN(t->dec); b++) if (t->dec[b]) recon_block_free(t, b);
+  resbuf_mem_release(t->mem);
+  resbuf_free(t->rb);
+  ARR_FREE(t->boff);
+  ARR_FREE(t->brec);
+  ARR_FREE(t->bcol);
+  ARR_FREE(t->bkey);
+  ARR_FREE(t->dec);
+  ARR_FREE(t->queue);
+  ARR_FREE(t->num);
+  ARR_FREE(t->item);
+  ARR_FREE(t->ioff);
+  free(t);
+}
+
+/* -------------------------
+ * Function: can_add
+ * -------------------------
+ * Checks, whether a record of the child of a forget node can extend the current
+ * assignment, whose mapping of the rest of the bag matches (see recon_table_next)
+ *
+ * Params:
+ *   t    - table of records
+ *   i    - index of the record in the decoded block
+ *   used - colours used by the current assignment
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int can_add (RECON_TABLE * t, u32 i, umask used)
+{
+  u32 * map = t->map + i * t->mlen;
+  /* Check if the new mapping doesn't contradict used colours so far */
+  if (!NODE_CONSISTENT(map[t->mlen - 1], used)) return 0;
+  /* Some colour set of the child's subtree has to avoid colours used outside of it */
+  umask bag_cols = EMPTY_MASK;
+  used = SET_BIT(used, COLOUR[map[t->mlen - 1]]);
+  for (u32 j = 0; j < t->mlen; j++) bag_cols = SET_BIT(bag_cols, COLOUR[map[j]]);
+  for (u32 j = t->coff[i]; j < t->coff[i + 1]; j++)
+  {
+    if ((t->col[j] & used) == bag_cols) return 1;
+  }
+  return 0;
+}
+
+/* -------------------------
+ * Function: subiso_iter_collect
+ * -------------------------
+ * Collects forget nodes of a subtree in order of reconstruction -- each node
+ * before its descendants, the first child's subtree of a join node before
+ * the second one's. All vertices of a child's bag except the forgotten one are
+ * then assigned by preceding forget nodes.
+ *
+ * Params:
+ *   it - iterator to store the nodes to
+ *   x  - root of the subtree
+ *   up - level of the nearest forget ancestor of x (-1 if there is none)
+ */
+static void subiso_iter_collect (SUBISO_ITER * it, NICE_TREE_DEC_NODE * x, int up)
+{
+  if (x->type == FORGET_NODE)
+  {
+    ARR_PUSH(it->up, up);
+    up = ARR_LEN(it->fn);
+    ARR_PUSH(it->fn, x);
+  }
+  if (x->child_1) subiso_iter_collect(it, x->child_1, up);
+  if (x->child_2) subiso_iter_collect(it, x->child_2, up);
+}
+
+/* -------------------------
+ * Function: subiso_iter_init
+ * -------------------------
+ * Creates a depth-first iterator over embeddings found by subiso_dp.
+ *
+ * Params:
+ *   ntd - nice tree decomposition with filled DP tables
+ *
+ * Returns:
+ *   Pointer to the newly created iterator
+ */
+static SUBISO_ITER * subiso_iter_init (NICE_TREE_DEC * ntd)
+{
+  SUBISO_ITER * it = (SUBISO_ITER *)xmalloc(sizeof(*it));
+  ARR_INIT(it->fn);
+  ARR_INIT(it->up);
+  subiso_iter_collect(it, &ntd->nodes[ntd->root], -1);
+  int f_cnt = ARR_LEN(it->fn);
+  ARR_ALLOC(it->tab, f_cnt);
+  for (int d = 0; d < f_cnt; d++) it->tab[d] = recon_table_init(it->fn[d]);
+  ARR_ALLOC(it->blk, f_cnt + 1);
+  ARR_ALLOC(it->cur, f_cnt + 1);
+  ARR_ALLOC(it->used, f_cnt + 1);
+  ARR_ALLOC(it->mapping, F_GRAPH->n_cnt);
+  ARR_ALLOC(it->key, MAX_F_VERTICES);
+  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  {
+    it->mapping[i] = INF;
+    it->less[i] = ntd->less[i];
+    it->more[i] = EMPTY_MASK;
+  }
+  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  {
+    for (umask L = it->less[i]; L; L &= L - 1) it->more[MASK_CTZ(L)] = SET_BIT(it->more[MASK_CTZ(L)], i);
+  }
+  it->cur[0] = 0;
+  it->used[0] = EMPTY_MASK;
+  it->depth = 0;
+  return it;
+}
+
+/* -------------------------
+ * Function: iter_less_ok
+ * -------------------------
+ * Checks symmetry-breaking constraints without a common bag (see NICE_TREE_DEC)
+ * of a vertex against already assigned vertices.
+ *
+ * Params:
+ *   it - iterator
+ *   u  - vertex of F_GRAPH
+ *   v  - image of u
+ *
+ * Returns:
+ *   1 if no constraint is violated, 0 otherwise
+ */
+static inline int iter_less_ok (SUBISO_ITER * it, int u, u32 v)
+{
+  for (umask L = it->less[u]; L; L &= L - 1) if (it->mapping[MASK_CTZ(L)] < (int)v) return 0;
+  for (umask M = it->more[u]; M; M &= M - 1)
+  {
+    int w = it->mapping[MASK_CTZ(M)];
+    if (w != INF && w > (int)v) return 0;
+  }
+  return 1;
+}
+
+/* -------------------------
+ * Function: subiso_iter_next
+ * -------------------------
+ * Finds the next embedding. Levels are advanced depth-first, so only the current
+ * record of each level is kept. A level's index is built when it is reached for
+ * the first time. Symmetry-breaking constraints without a common bag are checked
+ * when the later of their vertices is assigned.
+ *
+ * Params:
+ *   it - iterator
+ *
+ * Returns:
+ *   Mapping of the embedding (valid until the next call), or NULL if there is
+ *   none left
+ */
+static int * subiso_iter_next (SUBISO_ITER * it)
+{
+  int f_cnt = ARR_LEN(it->fn), d = it->depth;
+  while (d >= 0)
+  {
+    if (d == f_cnt)
+    {
+      it->depth = d - 1;
+      return it->mapping;
+    }
+    RECON_TABLE * t = it->tab[d];
+    int * bag = it->fn[d]->child_1->bag_cont;
+    int u = bag[t->pos];
+    u32 r = it->cur[d];
+    /* Key from the rest of the child's bag, which is already assigned */
+    for (u32 j = 0, k = 0; j < t->mlen; j++) if (j != t->pos) it->key[k++] = it->mapping[bag[j]];
+    if (r) it->mapping[u] = INF;
+    while ((r = recon_table_next(t, it->key, &it->blk[d], r)) &&
+           !(can_add(t, r - 1, it->used[d]) && iter_less_ok(it, u, t->map[r * t->mlen - 1])));
+    it->cur[d] = r;
+    if (!r)
+    {
+      --d;
+      continue;
+    }
+    u32 v = t->map[r * t->mlen - 1];
+    it->mapping[u] = v;
+    it->used[d + 1] = SET_BIT(it->used[d], COLOUR[v]);
+    it->cur[++d] = 0;
+  }
+  it->depth = -1;
+  return NULL;
+}
+
+/* -------------------------
+ * Function: subiso_iter_free
+ * -------------------------
+ * Deallocates an iterator over embeddings.
+ *
+ * Params:
+ *   it - iterator to be freed
+ */
+static void subiso_iter_free (SUBISO_ITER * it)
+{
+  for (int d = 0; d < ARR_LEN(it->fn); d++) recon_table_free(it->tab[d]);
+  ARR_FREE(it->fn);
+  ARR_FREE(it->up);
+  ARR_FREE(it->tab);
+  ARR_FREE(it->blk);
+  ARR_FREE(it->cur);
+  ARR_FREE(it->used);
+  ARR_FREE(it->mapping);
+  ARR_FREE(it->key);
+  free(it);
+}
+
+/* -------------------------
+ * Function: sample_assign
+ * -------------------------
+ * Assigns the child's bag of a level by a record and computes its colours.
+ * The record's block stays decoded.
+ *
+ * Params:
+ *   it - iterator
+ *   d  - level
+ *   i  - index of the record in the decoded block
+ *
+ * Returns:
+ *   Colours of images of the bag
+ */
+static umask sample_assign (SUBISO_ITER * it, int d, u32 i)
+{
+  RECON_TABLE * t = it->tab[d];
+  int * bag = it->fn[d]->child_1->bag_cont;
+  umask cols = EMPTY_MASK;
+  u32 * map = t->map + i * t->mlen;
+  /* The forgotten vertex is stored at the end */
+  for (u32 j = 0, k = 0; j < t->mlen; j++)
+  {
+    it->mapping[bag[j]] = (j == t->pos ? map[t->mlen - 1] : map[k++]);
+    cols = SET_BIT(cols, COLOUR[it->mapping[bag[j]]]);
+  }
+  return cols;
+}
+
+/* -------------------------
+ * Function: sample_children
+ * -------------------------
+ * Collects child levels of a level -- the nearest forget descendants.
+ *
+ * Params:
+ *   it - iterator
+ *   d  - level
+ *   ch - array to store the child levels to
+ */
+static void sample_children (SUBISO_ITER * it, int d, int ** ch)
+{
+  GARY_RESIZE(*ch, 0);
+  for (int e = d + 1; e < ARR_LEN(it->fn); e++) if (it->up[e] == d) ARR_PUSH(*ch, e);
+}
+
+/* -------------------------
+ * Function: sample_combine
+ * -------------------------
+ * Combines records (with colour sets) of child levels of a level matching
+ * the current assignment one child level at a time. A step extends unions of
+ * colours of the bag and of previous child levels by colour sets of the next
+ * child level, whose private colours (of vertices not in the bag of the parent
+ * level) are disjoint with the union. Weight of an extended union is the sum of
+ * products of weights of unions and numbers of embeddings of colour sets. Items
+ * of each step are added to the parent's table sorted by unions with cumulative
+ * weights, so a draw finds them by binary search.
+ *
+ * Params:
+ *   s    - state of sampling with the child levels of the level
+ *   pt   - table of the level
+ *   ch   - child levels
+ *   cols - colours of the parent's bag
+ */
+static void sample_combine (SUBISO_SAMPLER * s, RECON_TABLE * pt, int * ch, umask cols)
+{
+  SUBISO_ITER * it = s->it;
+  GARY_RESIZE(s->uni, 0);
+  GARY_RESIZE(s->w, 0);
+  ARR_PUSH(s->uni, cols);
+  ARR_PUSH(s->w, 1);
+  for (int k = 0; k < ARR_LEN(ch); k++)
+  {
+    RECON_TABLE * t = it->tab[ch[k]];
+    int * bag = it->fn[ch[k]]->child_1->bag_cont;
+    u32 key[MAX_F_VERTICES], e = 0, r = 0;
+    umask key_cols = EMPTY_MASK;
+    for (u32 j = 0, l = 0; j < t->mlen; j++)
+    {
+      if (j == t->pos) continue;
+      key[l++] = it->mapping[bag[j]];
+      key_cols = SET_BIT(key_cols, COLOUR[it->mapping[bag[j]]]);
+    }
+    GARY_RESIZE(s->step, 0);
+    while ((r = recon_table_next(t, key, &e, r)))
+    {
+      double * num = t->num + t->bcol[t->blk];
+      for (u32 j = t->coff[r - 1]; j < t->coff[r]; j++)
+      {
+        if (!num[j]) continue;
+        for (u32 a = 0; a < ARR_LEN(s->uni); a++)
+        {
+          if ((t->col[j] & s->uni[a]) != key_cols) continue;
+          SAMPLE_ITEM * m = GARY_PUSH_MULTI(s->step, 1);
+          m->uni = s->uni[a] | t->col[j];
+          m->prev = s->uni[a];
+          m->rec = t->brec[t->blk] + r - 1;
+          m->set = t->bcol[t->blk] + j;
+          m->cum = s->w[a] * num[j];
+        }
+      }
+    }
+    sampleitem_sort(s->step, ARR_LEN(s->step));
+    /* Totals of unions weigh them in the next step */
+    GARY_RESIZE(s->uni, 0);
+    GARY_RESIZE(s->w, 0);
+    for (u32 i = 0; i < ARR_LEN(s->step); i++)
+    {
+      if (i && s->step[i].uni == s->step[i - 1].uni) s->step[i].cum += s->step[i - 1].cum;
+      else
+      {
+        ARR_PUSH(s->uni, s->step[i].uni);
+        ARR_PUSH(s->w, 0);
+      }
+      s->w[ARR_LEN(s->w) - 1] = s->step[i].cum;
+    }
+    if (ARR_LEN(s->step)) memcpy(GARY_PUSH_MULTI(pt->item, ARR_LEN(s->step)), s->step, ARR_LEN(s->step) * sizeof(*s->step));
+    ARR_PUSH(pt->ioff, ARR_LEN(pt->item));
+  }
+}
+
+/* -------------------------
+ * Function: sample_count
+ * -------------------------
+ * Annotates colour sets of records of all levels with numbers of colourful
+ * embeddings of the child's subtree extending the record's mapping with exactly
+ * those colours -- weights of their unions combined by sample_combine. Levels
+ * are processed from the bottom, so numbers of child levels are already known.
+ * Blocks of a level are decoded one by one.
+ *
+ * Params:
+ *   it - iterator with tables of all levels
+ *   s  - state of sampling with child levels of all levels
+ */
+static void sample_count (SUBISO_ITER * it, SUBISO_SAMPLER * s)
+{
+  for (int d = ARR_LEN(it->fn) - 1; d >= 0; d--)
+  {
+    RECON_TABLE * t = it->tab[d];
+    recon_table_index(t);
+    u64 c_cnt = t->bcol[ARR_LEN(t->boff)];
+    ARR_ALLOC(t->num, MAX(c_cnt, 1));
+    ARR_PUSH(t->ioff, 0);
+    for (u32 b = 0; b < ARR_LEN(t->boff); b++)
+    {
+      recon_table_load(t, b);
+      double * num = t->num + t->bcol[b];
+      for (u32 i = 0; i < t->brec[b + 1] - t->brec[b]; i++)
+      {
+        sample_combine(s, t, s->ch[d], sample_assign(it, d, i));
+        /* Colour sets of the record are (some of) the final unions */
+        for (u32 j = t->coff[i]; j < t->coff[i + 1]; j++)
+        {
+          u32 lo = 0, hi = ARR_LEN(s->uni);
+          while (lo < hi)
+          {
+            u32 mid = (lo + hi) / 2;
+            if (s->uni[mid] < t->col[j]) lo = mid + 1;
+            else hi = mid;
+          }
+          num[j] = (lo < ARR_LEN(s->uni) && s->uni[lo] == t->col[j] ? s->w[lo] : 0);
+        }
+      }
     }
-    case INTRODUCE_NODE:
+    u64 mem = c_cnt * sizeof(*t->num) + ARR_LEN(t->item) * sizeof(*t->item) + ARR_LEN(t->ioff) * sizeof(*t->ioff);
+    resbuf_mem_charge(mem);
+    t->mem += mem;
+  }
+}
+
+/* -------------------------
+ * Function: sample_pick
+ * -------------------------
+ * Chooses an item of a step of sample_combine with the given union by its weight.
+ *
+ * Params:
+ *   item - items of the step (sorted by unions)
+ *   cnt  - number of items
+ *   uni  - union to be reached (some item has it)
+ *
+ * Returns:
+ *   Pointer to the chosen item
+ */
+static SAMPLE_ITEM * sample_pick (SAMPLE_ITEM * item, u64 cnt, umask uni)
+{
+  u64 lo = 0, hi = cnt;
+  /* Items of the union */
+  while (lo < hi)
+  {
+    u64 mid = (lo + hi) / 2;
+    if (item[mid].uni < uni) lo = mid + 1;
+    else hi = mid;
+  }
+  u64 end = lo;
+  for (hi = cnt; end < hi; )
+  {
+    u64 mid = (end + hi) / 2;
+    if (item[mid].uni <= uni) end = mid + 1;
+    else hi = mid;
+  }
+  /* The first item whose cumulative weight exceeds x (the last one against rounding errors) */
+  double x = rand() / (RAND_MAX + 1.0) * item[end - 1].cum;
+  for (hi = end - 1; lo < hi; )
+  {
+    u64 mid = (lo + hi) / 2;
+    if (item[mid].cum > x) hi = mid;
+    else lo = mid + 1;
+  }
+  return &item[lo];
+}
+
+/* -------------------------
+ * Function: sample_draw
+ * -------------------------
+ * Draws an embedding uniformly at random from colourful embeddings counted by
+ * sample_count. A record and colour set of the root level is chosen by the number
+ * of embeddings, then records and colour sets of child levels are chosen top-down
+ * by items of sample_combine -- from the last child level of a level, whose
+ * item reaches the chosen colour set, back to the first one.
+ *
+ * Params:
+ *   it    - iterator with counted tables
+ *   s     - state of sampling with child levels of all levels
+ *   cum   - cumulative numbers of embeddings of colour sets of the root level
+ *   stack - auxiliary array
+ *
+ * Returns:
+ *   Mapping of the embedding (valid until the next call)
+ */
+static int * sample_draw (SUBISO_ITER * it, SUBISO_SAMPLER * s, double * cum, u64 * stack)
+{
+  RECON_TABLE * t = it->tab[0];
+  u64 lo = 0, hi = ARR_LEN(cum) - 1;
+  u32 sp = 0;
+  double x = rand() / (RAND_MAX + 1.0) * cum[hi];
+  /* First colour set whose cumulative number exceeds x */
+  while (lo < hi)
+  {
+    u64 mid = (lo + hi) / 2;
+    if (cum[mid] > x) hi = mid;
+    else lo = mid + 1;
+  }
+  /* Record containing the colour set */
+  u32 b = recon_table_block(t, t->bcol, lo), i = 0, h = t->brec[b + 1] - t->brec[b] - 1;
+  while (i < h)
+  {
+    u32 mid = (i + h) / 2;
+    if (t->bcol[b] + t->coff[mid + 1] > lo) h = mid;
+    else i = mid + 1;
+  }
+  /* Stack of chosen levels with their records and colour sets */
+  stack[sp++] = 0;
+  stack[sp++] = t->brec[b] + i;
+  stack[sp++] = lo;
+  while (sp)
+  {
+    u64 j = stack[--sp], r = stack[--sp];
+    int d = stack[--sp], m = ARR_LEN(s->ch[d]);
+    t = it->tab[d];
+    b = recon_table_block(t, t->brec, r);
+    sample_assign(it, d, r - t->brec[b]);
+    umask uni = t->col[j - t->bcol[b]];
+    for (int k = m - 1; k >= 0; k--)
     {
-#ifdef LOCAL_DEBUG
-      DBG("~~~~~~~~~ R(I) ~~~~~~~~~");
-      ntd_print_node(x);
-#endif
-      child_results = subiso_reconstruct(x->child_1, results);
-      break;
+      u64 * off = t->ioff + r * m + k;
+      SAMPLE_ITEM * item = sample_pick(t->item + off[0], off[1] - off[0], uni);
+      stack[sp++] = s->ch[d][k];
+      stack[sp++] = item->rec;
+      stack[sp++] = item->set;
+      uni = item->prev;
     }
-    case FORGET_NODE:
+  }
+  return it->mapping;
+}
+
+/* -------------------------
+ * Function: subiso_sample
+ * -------------------------
+ * Draws embeddings of the current colouring uniformly at random (with repetition)
+ * and passes them to a sink.
+ *
+ * Params:
+ *   ntd  - nice tree decomposition with filled DP tables
+ *   cnt  - number of embeddings to be drawn
+ *   sink - receiver of embeddings
+ *   arg  - argument of the sink
+ */
+static void subiso_sample (NICE_TREE_DEC * ntd, int cnt, SUBISO_SINK sink, void * arg)
+{
+  SUBISO_ITER * it = subiso_iter_init(ntd);
+  SUBISO_SAMPLER s;
+  int f_cnt = ARR_LEN(it->fn);
+  double * cum;
+  u64 * stack;
+
+  s.it = it;
+  ARR_ALLOC(s.ch, f_cnt);
+  for (int d = 0; d < f_cnt; d++)
+  {
+    ARR_INIT(s.ch[d]);
+    sample_children(it, d, &s.ch[d]);
+  }
+  ARR_INIT(s.step);
+  ARR_INIT(s.uni);
+  ARR_INIT(s.w);
+  ARR_ALLOC(stack, 3 * f_cnt);
+  sample_count(it, &s);
+  RECON_TABLE * t = it->tab[0];
+  u64 c_cnt = t->bcol[ARR_LEN(t->boff)];
+  ARR_ALLOC(cum, MAX(c_cnt, 1));
+  cum[0] = 0;
+  for (u64 j = 0; j < c_cnt; j++) cum[j] = (j ? cum[j - 1] : 0) + t->num[j];
+  DBG("COLOURFUL EMBEDDINGS = %.0f", cum[ARR_LEN(cum) - 1]);
+  for (int k = 0; k < cnt && cum[ARR_LEN(cum) - 1] > 0; k++)
+  {
+    int * mapping, ok;
+    /* Embeddings violating constraints without a common bag are drawn again, so
+       the remaining ones stay uniform */
+    do
     {
-#ifdef LOCAL_DEBUG
-      DBG("~~~~~~~~~ R(F) ~~~~~~~~~");
-      ntd_print_node(x);
-#endif
-      u32 * map, * col;
-      u32 mlen, clen;
+      mapping = sample_draw(it, &s, cum, stack);
+      ok = 1;
+      for (int u = 0; u < F_GRAPH->n_cnt && ok; u++) ok = iter_less_ok(it, u, mapping[u]);
+    } while (!ok);
+    if (!sink(mapping, arg)) break;
+  }
+  for (int d = 0; d < f_cnt; d++) ARR_FREE(s.ch[d]);
+  ARR_FREE(s.ch);
+  ARR_FREE(s.step);
+  ARR_FREE(s.uni);
+  ARR_FREE(s.w);
+  ARR_FREE(stack);
+  ARR_FREE(cum);
+  subiso_iter_free(it);
+}
+
+/* -------------------------
+ * Function: subiso_collect
+ * -------------------------
+ * Passes embeddings found by subiso_dp (all of them or SAMPLE_CNT samples)
+ * to a sink one by one, until the sink stops the collection.
+ *
+ * Params:
+ *   ntd  - nice tree decomposition with filled DP tables
+ *   sink - receiver of embeddings
+ *   arg  - argument of the sink
+ */
+static void subiso_collect (NICE_TREE_DEC * ntd, SUBISO_SINK sink, void * arg)
+{
+  if (SAMPLE_CNT) subiso_sample(ntd, SAMPLE_CNT, sink, arg);
+  else
+  {
+    SUBISO_ITER * it = subiso_iter_init(ntd);
+    for (int * mapping; (mapping = subiso_iter_next(it)) && sink(mapping, arg); );
+    subiso_iter_free(it);
+  }
+}
+
+/* -------------------------
+ * Function: sink_glmemory
+ * -------------------------
+ * Passes an embedding to the global memory (a sink of subiso_collect).
+ *
+ * Params:
+ *   mapping - mapping of the embedding
+ *   arg     - unused
+ *
+ * Returns:
+ *   0 if RES_LIMIT subgraphs are found, 1 otherwise
+ */
+static int sink_glmemory (int * mapping, void * arg)
+{
+  GRAPH_RESULT * res = graph_result_init(F_GRAPH);
+  memcpy(res->mapping, mapping, F_GRAPH->n_cnt * sizeof(*mapping));
+  graph_result_glmemory_push(res);
+  return !RES_LIMIT || graph_result_glmemory_size() < RES_LIMIT;
+}
+
+/* -------------------------
+ * Function: sink_array
+ * -------------------------
+ * Appends an embedding to an array (a sink of subiso_collect).
+ *
+ * Params:
+ *   mapping - mapping of the embedding
+ *   arg     - array of embeddings (SINK_ARRAY)
+ *
+ * Returns:
+ *   0 if the array is full, 1 otherwise
+ */
+static int sink_array (int * mapping, void * arg)
+{
+  SINK_ARRAY * a = (SINK_ARRAY *)arg;
+  GRAPH_RESULT * res = graph_result_init(F_GRAPH);
+  memcpy(res->mapping, mapping, F_GRAPH->n_cnt * sizeof(*mapping));
+  ARR_PUSH(a->res, res);
+  return !a->cnt || ARR_LEN(a->res) < a->cnt;
+}
+
+/* -------------------------
+ * Function: subiso_clear
+ * -------------------------
+ * Returns remaining buffers of DP tables to the pool for the next iteration.
+ *
+ * Params:
+ *   ntd - nice tree decomposition
+ */
+static void subiso_clear (NICE_TREE_DEC * ntd)
+{
+  for (int j = 0; j < ntd->b_cnt; j++)
+  {
+    resbuf_free(ntd->nodes[j].rbuf);
+    ntd->nodes[j].rbuf = NULL;
+  }
+}
+
+/* -------------------------
+ * Function: share_mix
+ * -------------------------
+ * Adds a value to a hash of a DP table (see share_hash).
+ *
+ * Params:
+ *   h - hash so far
+ *   x - added value
+ *
+ * Returns:
+ *   Updated hash
+ */
+static inline u64 share_mix (u64 h, u64 x)
+{
+  return (h ^ x) * 0x100000001b3ULL + (h >> 29);
+}
+
+/* -------------------------
+ * Function: share_hash
+ * -------------------------
+ * Computes hashes of all nodes of a subtree -- nodes with equal DP tables up
+ * to the order of columns (see share_equal) have equal hashes, so positions
+ * in bags are not hashed.
+ *
+ * Params:
+ *   x - root of the subtree
+ *   h - hashes of nodes (indexed by idx)
+ *
+ * Returns:
+ *   Hash of x
+ */
+static u64 share_hash (NICE_TREE_DEC_NODE * x, u64 * h)
+{
+  u64 res = share_mix(x->type, ARR_LEN(x->bag_cont));
+  if (x->type == INTRODUCE_NODE)
+  {
+    SUBISO_PLAN * p = x->plan;
+    res = share_mix(share_mix(res, p->strategy), p->strategy == PLAN_BALL ? p->radius : 0);
+    res = share_mix(share_mix(share_mix(res, p->nb_cnt), p->lo_cnt), p->hi_cnt);
+  }
+  if (x->child_1) res = share_mix(res, share_hash(x->child_1, h));
+  if (x->child_2) res = share_mix(res, share_hash(x->child_2, h));
+  return h[x->idx] = res;
+}
 
-      mlen = ARR_LEN(x->child_1->bag_cont);
-      ARR_ALLOC(map, mlen);
-      ARR_ALLOC(col, 1 << F_GRAPH->n_cnt);
+/* -------------------------
+ * Function: share_pos_equal
+ * -------------------------
+ * Checks whether two sets of bag positions correspond under a permutation.
+ *
+ * Params:
+ *   a    - positions in the first bag
+ *   b    - positions in the second bag
+ *   cnt  - number of positions of each set
+ *   perm - permutation of positions of the second bag to those of the first one
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int share_pos_equal (int * a, int * b, int cnt, int * perm)
+{
+  umask in = 0;
+  for (int j = 0; j < cnt; j++) in = SET_BIT(in, a[j]);
+  for (int j = 0; j < cnt; j++) if (!GET_BIT(in, perm[b[j]])) return 0;
+  return 1;
+}
 
-      ARR_INIT(tmp_results);
-      resbuf_chng_state(x->child_1->rbuf, RES_READ);
-      while (resbuf_read(x->child_1->rbuf, map, mlen, col, &clen) != RES_EOF)
+/* -------------------------
+ * Function: share_equal
+ * -------------------------
+ * Checks whether DP tables of two subtrees (of different patterns) are equal
+ * up to the order of columns under the same colouring, provided that introduced
+ * vertices have the same candidates (see share_subtree). The vertices of the
+ * subtrees have to correspond bottom-up -- the introduced ones to each other
+ * with the same plans, the forgotten ones to each other and both children of
+ * a join node in the same way.
+ *
+ * Params:
+ *   x    - root of the first subtree
+ *   y    - root of the second subtree
+ *   perm - array to store positions in the bag of x of vertices of the bag of y to
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int share_equal (NICE_TREE_DEC_NODE * x, NICE_TREE_DEC_NODE * y, int * perm)
+{
+  int len = ARR_LEN(y->bag_cont), c_perm[MAX_F_VERTICES];
+  if (x->type != y->type || ARR_LEN(x->bag_cont) != len) return 0;
+  if (x->child_1 && !share_equal(x->child_1, y->child_1, c_perm)) return 0;
+  switch (y->type)
+  {
+    case LEAF_NODE:
+      perm[0] = 0;
+      break;
+    case INTRODUCE_NODE:
       {
-        for (int i = 0; i < ARR_LEN(results); i++)
+        SUBISO_PLAN * p = x->plan, * q = y->plan;
+        for (int j = 0; j < len; j++)
         {
-          GRAPH_RESULT * added_res = can_add(x->child_1, x->chng_index, map, results[i]);
-          if (added_res) ARR_PUSH(tmp_results, added_res);
+          int k = c_perm[j - (j > q->pos)];
+          perm[j] = (j == q->pos ? p->pos : k + (k >= p->pos));
         }
+        if (p->strategy != q->strategy || p->nb_cnt != q->nb_cnt || p->lo_cnt != q->lo_cnt || p->hi_cnt != q->hi_cnt ||
+            (p->strategy == PLAN_BALL && (p->radius != q->radius || perm[q->anchor] != p->anchor)) ||
+            !share_pos_equal(p->nb_pos, q->nb_pos, p->nb_cnt, perm) ||
+            !share_pos_equal(p->lo_pos, q->lo_pos, p->lo_cnt, perm) ||
+            !share_pos_equal(p->hi_pos, q->hi_pos, p->hi_cnt, perm)) return 0;
+        break;
+      }
+    case FORGET_NODE:
+      if (c_perm[y->chng_index] != x->chng_index) return 0;
+      for (int j = 0; j < len; j++)
+      {
+        int k = c_perm[j + (j >= y->chng_index)];
+        perm[j] = k - (k > x->chng_index);
       }
-      child_results = subiso_reconstruct(x->child_1, tmp_results);
-      graph_result_array_free(results);
-      ARR_FREE(map);
-      ARR_FREE(col);
       break;
-    }
     case JOIN_NODE:
-    {
-#ifdef LOCAL_DEBUG
-      DBG("~~~~~~~~~ R(J) ~~~~~~~~~");
-      ntd_print_node(x);
-#endif
-      tmp_results = subiso_reconstruct(x->child_1, results);
-      child_results = subiso_reconstruct(x->child_2, tmp_results);
+      if (!share_equal(x->child_2, y->child_2, perm) || memcmp(perm, c_perm, len * sizeof(*perm))) return 0;
       break;
+  }
+  return 1;
+}
+
+/* -------------------------
+ * Function: share_cand
+ * -------------------------
+ * Finds candidate bitmaps of the pattern a node belongs to.
+ *
+ * Params:
+ *   pat - patterns of the batch
+ *   cnt - number of patterns
+ *   x   - node of one of the patterns
+ *
+ * Returns:
+ *   Candidate bitmaps of the pattern
+ */
+static u64 ** share_cand (SUBISO_PATTERN ** pat, int cnt, NICE_TREE_DEC_NODE * x)
+{
+  for (int k = 0; k < cnt; k++)
+  {
+    if (x >= pat[k]->ntd->nodes && x < pat[k]->ntd->nodes + pat[k]->ntd->b_cnt) return pat[k]->cand;
+  }
+  return NULL;
+}
+
+/* -------------------------
+ * Function: share_cand_in
+ * -------------------------
+ * Checks whether candidates of leaf and introduced vertices of a subtree are
+ * candidates of the corresponding vertices of an equal subtree of a preceding
+ * pattern too. Candidates are only necessary conditions, so the table of the
+ * preceding pattern then contains all records of the subtree (and possibly
+ * more, which are dropped when read, see share_read).
+ *
+ * Params:
+ *   pat    - patterns of the batch
+ *   cnt    - number of patterns
+ *   y      - root of the subtree
+ *   x      - root of the equal subtree of the preceding pattern
+ *   strict - set if the subtree actually evaluated has more candidates
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int share_cand_in (SUBISO_PATTERN ** pat, int cnt, NICE_TREE_DEC_NODE * y, NICE_TREE_DEC_NODE * x, int * strict)
+{
+  if (y->type == LEAF_NODE || y->type == INTRODUCE_NODE)
+  {
+    NICE_TREE_DEC_NODE * t = (x->share ? x->share : x); /* The node actually evaluated */
+    u64 * cx = share_cand(pat, cnt, x)[x->type == LEAF_NODE ? x->bag_cont[0] : x->plan->u];
+    u64 * ct = share_cand(pat, cnt, t)[t->type == LEAF_NODE ? t->bag_cont[0] : t->plan->u];
+    u64 * cy = share_cand(pat, cnt, y)[y->type == LEAF_NODE ? y->bag_cont[0] : y->plan->u];
+    for (int i = 0; i < ARR_LEN(cy); i++)
+    {
+      if (cy[i] & ~cx[i]) return 0;
+      if (ct[i] & ~cy[i]) *strict = 1;
     }
-    default:
-      break;
   }
-  return child_results;
+  if (y->child_1 && !share_cand_in(pat, cnt, y->child_1, x->child_1, strict)) return 0;
+  if (y->child_2 && !share_cand_in(pat, cnt, y->child_2, x->child_2, strict)) return 0;
+  return 1;
+}
+
+/* -------------------------
+ * Function: share_subtree
+ * -------------------------
+ * Makes a subtree read DP tables of an equal subtree of a preceding pattern.
+ * Nodes whose tables are actually read (the root by the DP, children of forget
+ * nodes by reconstruction) are kept by the preceding pattern. Positions of bag
+ * vertices of nodes in bags of the evaluated ones are stored unless they are
+ * the same and the table is read as it is.
+ *
+ * Params:
+ *   y      - root of the subtree
+ *   x      - root of the equal subtree of the preceding pattern
+ *   root   - set if y is the root of the shared subtree
+ *   filter - set if records of the root have to be filtered by candidates of y's pattern
+ */
+static void share_subtree (NICE_TREE_DEC_NODE * y, NICE_TREE_DEC_NODE * x, int root, int filter)
+{
+  NICE_TREE_DEC_NODE * t = (x->share ? x->share : x); /* The node actually evaluated */
+  int perm[MAX_F_VERTICES], len = ARR_LEN(y->bag_cont), id = !filter;
+  share_equal(x, y, perm);
+  for (int j = 0; j < len; j++)
+  {
+    if (x->share_perm) perm[j] = x->share_perm[perm[j]];
+    if (perm[j] != j) id = 0;
+  }
+  if (!id)
+  {
+    ARR_ALLOC(y->share_perm, len);
+    memcpy(y->share_perm, perm, len * sizeof(*perm));
+  }
+  y->share = t;
+  if (root || y->keep_rbuf) t->shared = 1;
+  if (root) t->fused = y->fused = 0; /* The table of t is stored, y is not evaluated by a chain */
+  if (y->child_1) share_subtree(y->child_1, x->child_1, 0, 0);
+  if (y->child_2) share_subtree(y->child_2, x->child_2, 0, 0);
+}
+
+/* -------------------------
+ * Function: share_find
+ * -------------------------
+ * Finds maximal subtrees of a pattern equal to subtrees of preceding patterns
+ * (top-down), whose candidates contain those of the pattern (see share_cand_in),
+ * and makes them shared.
+ *
+ * Params:
+ *   y    - root of the subtree of the pattern
+ *   k    - index of the pattern
+ *   pat  - patterns of the batch
+ *   h    - hashes of nodes of the patterns (see share_hash)
+ *   ent  - nodes of all patterns sorted by hashes
+ *   used - roots of subtrees already shared by the pattern
+ */
+static void share_find (NICE_TREE_DEC_NODE * y, int k, SUBISO_PATTERN ** pat, u64 ** h, SHARE_ENT * ent, NICE_TREE_DEC_NODE *** used)
+{
+  u64 hy = h[k][y->idx];
+  int perm[MAX_F_VERTICES];
+  if (y->in_cnt >= BATCH_SHARE_INTR)
+  {
+    int lo = 0, hi = ARR_LEN(ent);
+    while (lo < hi) /* The first entry with hash hy */
+    {
+      int mid = (lo + hi) / 2;
+      if (ent[mid].h < hy) lo = mid + 1;
+      else hi = mid;
+    }
+    for (int i = lo; i < ARR_LEN(ent) && ent[i].h == hy && ent[i].pat < k; i++)
+    {
+      NICE_TREE_DEC_NODE * x = ent[i].x;
+      int taken = 0;
+      /* Subtrees of the pattern may be evaluated in parallel, so a buffer is read by one of them only */
+      for (int j = 0; j < ARR_LEN(*used); j++) if ((*used)[j] == x) taken = 1;
+      int strict = 0;
+      if (taken || x->share || !share_equal(x, y, perm) || !share_cand_in(pat, k + 1, y, x, &strict)) continue;
+      share_subtree(y, x, 1, strict);
+      ARR_PUSH(*used, x);
+      DBG("SHARED: subtree with %d introduce nodes of pattern %d from pattern %d", y->in_cnt, k, ent[i].pat);
+      return;
+    }
+  }
+  if (y->child_1) share_find(y->child_1, k, pat, h, ent, used);
+  if (y->child_2) share_find(y->child_2, k, pat, h, ent, used);
 }
 
 /****************************************************************************
  * INTERFACE FUNCTIONS
  ***************************************************************************/
 
+/*---------------------------------------------------------------------------
+ * Function: subiso_plan
+ *-------------------------------------------------------------------------*/
+void subiso_plan (NICE_TREE_DEC * ntd)
+{
+  for (int u = 0; u < F_GRAPH->n_cnt; u++) ntd->less[u] = F_LESS[u];
+  for (int i = 0; i < ntd->b_cnt; i++)
+  {
+    umask bag = ntd->nodes[i].bag;
+    for (umask B = bag; B; B &= B - 1) ntd->less[MASK_CTZ(B)] &= ~bag;
+  }
+  for (int i = 0; i < ntd->b_cnt; i++)
+  {
+    NICE_TREE_DEC_NODE * x = &ntd->nodes[i];
+    if (x->type != INTRODUCE_NODE) continue;
+    SUBISO_PLAN * p = x->plan = (SUBISO_PLAN *)xmalloc(sizeof(*p));
+    p->pos = x->chng_index;
+    p->u = x->bag_cont[p->pos];
+    p->mlen = ARR_LEN(x->bag_cont);
+    p->nb_cnt = p->lo_cnt = p->hi_cnt = 0;
+    p->anchor = 0;
+    p->radius = F_GRAPH->n_cnt;
+    for (int j = 0; j < p->mlen; j++)
+    {
+      if (j == p->pos) continue;
+      if (graph_is_adj(F_GRAPH, p->u, x->bag_cont[j])) p->nb_pos[p->nb_cnt++] = j;
+      if (GET_BIT(F_LESS[x->bag_cont[j]], p->u)) p->lo_pos[p->lo_cnt++] = j;
+      if (GET_BIT(F_LESS[p->u], x->bag_cont[j])) p->hi_pos[p->hi_cnt++] = j;
+      if (F_COMP[x->bag_cont[j]] == F_COMP[p->u] &&
+          F_ECC[x->bag_cont[j]] < p->radius) /* Bag vertex of u's component with minimal eccentricity */
+      {
+        p->radius = F_ECC[x->bag_cont[j]];
+        p->anchor = j;
+      }
+    }
+    if (p->nb_cnt > 1) p->strategy = PLAN_NEIGH;
+    else if (p->nb_cnt) p->strategy = PLAN_NEIGH_ONE;
+    else if (p->radius < F_GRAPH->n_cnt) p->strategy = PLAN_BALL;
+    else p->strategy = PLAN_ANY;
+  }
+}
+
  /*---------------------------------------------------------------------------
  * Function: subiso_run
  *-------------------------------------------------------------------------*/
-GRAPH_RESULT ** subiso_run (NICE_TREE_DEC * ntd, int rep_cnt)
+GRAPH_RESULT ** subiso_run (NICE_TREE_DEC * ntd, int * rep_cnt)
 {
-  GRAPH_RESULT ** run_result, ** tmp_result;
   ARR_ALLOC(COLOUR, G_GRAPH->n_cnt);
   graph_result_glmemory_init(F_GRAPH);
-  for (int i = 0; i < rep_cnt; i++)
+  for (int i = 0; i < *rep_cnt; i++)
   {
     clock_t start = clock();
     subiso_colouring();
     subiso_dp(&(ntd->nodes[ntd->root]));
-    ARR_INIT(tmp_result);
-    GRAPH_RESULT * dummy = graph_result_init(F_GRAPH);
-    ARR_PUSH(tmp_result, dummy);
-    run_result = subiso_reconstruct(&(ntd->nodes[ntd->root]), tmp_result);
-    graph_result_glmemory_add(run_result);
+    subiso_collect(ntd, sink_glmemory, NULL);
+    subiso_clear(ntd);
     clock_t end = clock();
     A_TIME += end - start;
     if (i % 1000); else printf(">>> UNIQUE subgraphs so far after run #%d = %d <<<\n", i + 1, graph_result_glmemory_size());
+    if (RES_LIMIT && graph_result_glmemory_size() >= RES_LIMIT) *rep_cnt = i + 1;
   }
   printf("~~~~~~END~~~~~~\n");
   ARR_FREE(COLOUR);
+  ball_free();
   return graph_result_glmemory_reconstruct();
 }
+
+/*---------------------------------------------------------------------------
+ * Function: subiso_embed
+ *-------------------------------------------------------------------------*/
+GRAPH_RESULT ** subiso_embed (NICE_TREE_DEC * ntd, int cnt)
+{
+  SINK_ARRAY a;
+  ARR_INIT(a.res);
+  a.cnt = cnt;
+  subiso_dp(&(ntd->nodes[ntd->root]));
+  subiso_collect(ntd, sink_array, &a);
+  subiso_clear(ntd);
+  ball_free();
+  return a.res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: subiso_share
+ *-------------------------------------------------------------------------*/
+void subiso_share (SUBISO_PATTERN ** pat, int cnt)
+{
+  u64 ** h;
+  SHARE_ENT * ent;
+  NICE_TREE_DEC_NODE ** used;
+  ARR_ALLOC(h, cnt);
+  ARR_INIT(ent);
+  ARR_INIT(used);
+  for (int k = 0; k < cnt; k++)
+  {
+    NICE_TREE_DEC * ntd = pat[k]->ntd;
+    ARR_ALLOC(h[k], ntd->b_cnt);
+    share_hash(&ntd->nodes[ntd->root], h[k]);
+    for (int i = 0; i < ntd->b_cnt; i++)
+    {
+      SHARE_ENT * e = GARY_PUSH_MULTI(ent, 1);
+      e->h = h[k][i];
+      e->pat = k;
+      e->x = &ntd->nodes[i];
+    }
+  }
+  sharearr_sort(ent, ARR_LEN(ent));
+  for (int k = 1; k < cnt; k++)
+  {
+    GARY_RESIZE(used, 0);
+    share_find(&pat[k]->ntd->nodes[pat[k]->ntd->root], k, pat, h, ent, &used);
+  }
+  for (int k = 0; k < cnt; k++) ARR_FREE(h[k]);
+  ARR_FREE(h);
+  ARR_FREE(ent);
+  ARR_FREE(used);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: subiso_run_batch
+ *
+ * Description:
+ *   Patterns that found RES_LIMIT subgraphs still evaluate subtrees whose
+ *   tables are read by following patterns, as long as any of them goes on
+ *-------------------------------------------------------------------------*/
+void subiso_run_batch (SUBISO_PATTERN ** pat, int cnt, int rep_cnt)
+{
+  GRAPH_RESULT_MEM ** mem;
+  int * src, left = cnt;
+  ARR_ALLOC(mem, cnt);
+  ARR_ALLOC(src, cnt);
+  for (int k = 0; k < cnt; k++)
+  {
+    F_GRAPH = pat[k]->f;
+    graph_result_glmemory_init(F_GRAPH);
+    mem[k] = graph_result_glmemory_save();
+    pat[k]->rep_cnt = rep_cnt;
+    src[k] = 0;
+    for (int i = 0; i < pat[k]->ntd->b_cnt; i++) src[k] |= pat[k]->ntd->nodes[i].shared;
+  }
+  ARR_ALLOC(COLOUR, G_GRAPH->n_cnt);
+  for (int i = 0; i < rep_cnt && left; i++)
+  {
+    clock_t start = clock();
+    subiso_colouring(); /* All patterns have the same number of vertices */
+    for (int k = 0; k < cnt; k++)
+    {
+      int done = (pat[k]->rep_cnt <= i), read = 0;
+      for (int j = k + 1; j < cnt && src[k] && !read; j++) read = (pat[j]->rep_cnt > i);
+      if (done && !read) continue;
+      F_GRAPH = pat[k]->f;
+      F_CAND = pat[k]->cand;
+      if (done)
+      {
+        subiso_dp_shared(&(pat[k]->ntd->nodes[pat[k]->ntd->root]));
+        continue;
+      }
+      subiso_dp(&(pat[k]->ntd->nodes[pat[k]->ntd->root]));
+      graph_result_glmemory_restore(mem[k]);
+      subiso_collect(pat[k]->ntd, sink_glmemory, NULL);
+      if (RES_LIMIT && graph_result_glmemory_size() >= RES_LIMIT)
+      {
+        pat[k]->rep_cnt = i + 1;
+        --left;
+      }
+      mem[k] = graph_result_glmemory_save();
+    }
+    /* Shared tables are kept until all patterns are evaluated */
+    for (int k = 0; k < cnt; k++) subiso_clear(pat[k]->ntd);
+    clock_t end = clock();
+    A_TIME += end - start;
+  }
+  for (int k = 0; k < cnt; k++)
+  {
+    graph_result_glmemory_restore(mem[k]);
+    pat[k]->result = graph_result_glmemory_reconstruct();
+  }
+  ARR_FREE(COLOUR);
+  ARR_FREE(mem);
+  ARR_FREE(src);
+  ball_free();
+}
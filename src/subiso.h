@@ -12,10 +12,67 @@
 
 #include "common.h"
 
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+/* Strategies of finding candidates for the introduced vertex */
+#define PLAN_NEIGH_ONE 0 /* single neighbour in the bag -> its neighbours in G_GRAPH */
+#define PLAN_NEIGH     1 /* common neighbours of images of all neighbours in the bag */
+#define PLAN_BALL      2 /* no neighbour in the bag -> vertices close to an image of a bag vertex */
+#define PLAN_ANY       3 /* no vertex of its component in the bag -> all vertices of G_GRAPH */
+
+/* Precompiled per-node facts for processing records of an introduce node */
+struct subiso_plan_struct
+{
+  /* Introduced vertex of F_GRAPH and its position in the bag */
+  int u, pos;
+  /* Length of mappings of the node */
+  int mlen;
+  /* Strategy of finding candidates (PLAN_*) */
+  int strategy;
+  /* Number of neighbours of u in the bag and their positions */
+  int nb_cnt;
+  int nb_pos[MAX_F_VERTICES];
+  /* Positions of bag vertices whose images have to be lower (lo_pos) or higher
+     (hi_pos) than the image of u by symmetry-breaking constraints (see F_LESS) */
+  int lo_cnt, hi_cnt;
+  int lo_pos[MAX_F_VERTICES], hi_pos[MAX_F_VERTICES];
+  /* Position of the bag vertex of u's component with minimal eccentricity and
+     the eccentricity (PLAN_BALL) */
+  int anchor, radius;
+};
+
+/* Pattern of a batch searched under shared colourings (see subiso_run_batch) */
+struct subiso_pattern_struct
+{
+  /* Name of the file of the pattern */
+  char            * name;
+  /* Pattern, its candidate bitmaps (see F_CAND) and its nice tree decomposition with plans */
+  GRAPH           * f;
+  u64            ** cand;
+  NICE_TREE_DEC   * ntd;
+  /* Number of repetitions done (lower than requested if RES_LIMIT subgraphs were found earlier) */
+  int               rep_cnt;
+  /* Found subgraphs */
+  GRAPH_RESULT   ** result;
+};
+
 /****************************************************************************
  * FUNCTIONS
  ***************************************************************************/
 
+/* -------------------------
+ * Function: subiso_plan
+ * -------------------------
+ * Compiles plans (see SUBISO_PLAN) of all introduce nodes of a nice tree
+ * decomposition.
+ * 
+ * Params:
+ *   ntd - nice tree decomposition of F_GRAPH
+ */
+void            subiso_plan (NICE_TREE_DEC * ntd);
+
 /* -------------------------
  * Function: subiso_run
  * -------------------------
@@ -25,11 +82,65 @@
  * 
  * Params:
  *   ntd     - nice tree decomposition of F_GRAPH
- *   rep_cnt - number of algorithm repetitions
+ *   rep_cnt - number of algorithm repetitions (lowered to the number of
+ *             repetitions done, if RES_LIMIT subgraphs are found earlier,
+ *             the last one then stops collecting embeddings at the limit)
  *
  * Returns:
  *   Array with found results
  */
-GRAPH_RESULT ** subiso_run (NICE_TREE_DEC * ntd, int rep_cnt);
+GRAPH_RESULT ** subiso_run  (NICE_TREE_DEC * ntd, int * rep_cnt);
+
+/* -------------------------
+ * Function: subiso_embed
+ * -------------------------
+ * Runs a single repetition of the algorithm under the colouring in COLOUR and
+ * returns embeddings found by it in order of the iterator (or SAMPLE_CNT
+ * samples), without removing those of the same subgraph. Cached BFS balls
+ * are released afterwards.
+ * 
+ * Params:
+ *   ntd - nice tree decomposition of F_GRAPH
+ *   cnt - maximal number of embeddings (0 for all of them)
+ *
+ * Returns:
+ *   Array with found embeddings
+ */
+GRAPH_RESULT ** subiso_embed (NICE_TREE_DEC * ntd, int cnt);
+
+/* -------------------------
+ * Function: subiso_share
+ * -------------------------
+ * Finds subtrees of nice tree decompositions of a batch of patterns, whose DP
+ * tables are equal to tables of subtrees of preceding patterns under the same
+ * colouring up to the order of columns. Such subtrees have the same shape and
+ * node types, and their vertices correspond bottom-up, so that plans (SUBISO_PLAN)
+ * are the same up to the permutation of bag positions. Candidates of vertices
+ * of the reading subtree have to be candidates of the evaluated one too, its
+ * records outside candidates of the reading pattern are dropped when read.
+ * Tables whose columns are permuted are reordered and sorted again when read
+ * (see share_perm). Subtrees are searched top-down, so each shared one is
+ * maximal. Subtrees with less than BATCH_SHARE_INTR introduce nodes are not
+ * shared.
+ *
+ * Params:
+ *   pat - patterns of the batch (with the same number of vertices)
+ *   cnt - number of patterns
+ */
+void            subiso_share (SUBISO_PATTERN ** pat, int cnt);
+
+/* -------------------------
+ * Function: subiso_run_batch
+ * -------------------------
+ * Runs the main algorithm for a batch of patterns. All patterns are evaluated
+ * under the same colouring in each repetition, so a DP table shared by several
+ * patterns (see subiso_share) is computed once and kept until all of them read it.
+ *
+ * Params:
+ *   pat     - patterns of the batch (with the same number of vertices)
+ *   cnt     - number of patterns
+ *   rep_cnt - number of algorithm repetitions
+ */
+void            subiso_run_batch (SUBISO_PATTERN ** pat, int cnt, int rep_cnt);
 
 #endif /* __SUBISO_H__ */
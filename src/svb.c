@@ -0,0 +1,152 @@
+/*
+ *	Subgraph Isomorphism - Stream VByte codec
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#include "svb.h"
+#include <string.h>
+#include <pthread.h>
+/* SSSE3 decoding is compiled for x86 regardless of the target CPU and chosen at run time */
+#if defined(__x86_64__) || defined(__i386__)
+  #define SVB_SSSE3
+  #include <tmmintrin.h>
+#endif
+
+/* Total data length of 4 numbers described by a control byte */
+static byte           svb_len[256];
+/* Shuffle masks expanding 4 numbers described by a control byte to 4 x 32 bits */
+static byte           svb_shuf[256][16];
+static pthread_once_t svb_once = PTHREAD_ONCE_INIT;
+/* Set if the CPU supports SSSE3 */
+static int            svb_ssse3;
+
+/****************************************************************************
+ * STATIC FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: svb_init_tables
+ * -------------------------
+ * Precomputes lengths and shuffle masks for all control bytes.
+ */
+static void svb_init_tables (void)
+{
+  for (int c = 0; c < 256; c++)
+  {
+    int pos = 0;
+    for (int i = 0; i < 4; i++)
+    {
+      int len = ((c >> (2 * i)) & 3) + 1;
+      for (int j = 0; j < 4; j++) svb_shuf[c][4 * i + j] = (j < len ? pos + j : 0xff);
+      pos += len;
+    }
+    svb_len[c] = pos;
+  }
+#ifdef SVB_SSSE3
+  svb_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+#ifdef SVB_SSSE3
+/* -------------------------
+ * Function: svb_decode_ssse3
+ * -------------------------
+ * Decodes whole quadruples of numbers by SSSE3 shuffles (only called if the CPU
+ * supports them).
+ *
+ * Params:
+ *   ctrl - control stream
+ *   data - data stream (moved after the decoded numbers)
+ *   cnt  - count of numbers
+ *   out  - output array for decoded numbers
+ *
+ * Returns:
+ *   Number of decoded numbers (a multiple of 4)
+ */
+__attribute__((target("ssse3")))
+static u32 svb_decode_ssse3 (const byte * ctrl, const byte ** data, u32 cnt, u32 * out)
+{
+  const byte * d = *data;
+  u32 i = 0;
+  for (; i + 4 <= cnt; i += 4)
+  {
+    byte c = ctrl[i / 4];
+    __m128i v = _mm_loadu_si128((const __m128i *)d);
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *)svb_shuf[c]));
+    _mm_storeu_si128((__m128i *)(out + i), v);
+    d += svb_len[c];
+  }
+  *data = d;
+  return i;
+}
+#endif
+
+/* -------------------------
+ * Function: svb_num_len
+ * -------------------------
+ * Returns number of bytes needed for a single number.
+ *
+ * Params:
+ *   x - the number
+ */
+static inline u32 svb_num_len (u32 x)
+{
+  return (x < (1U << 8)) ? 1 : (x < (1U << 16)) ? 2 : (x < (1U << 24)) ? 3 : 4;
+}
+
+/****************************************************************************
+ * INTERFACE FUNCTIONS
+ ***************************************************************************/
+
+/*---------------------------------------------------------------------------
+ * Function: svb_max_len
+ *-------------------------------------------------------------------------*/
+u32 svb_max_len (u32 cnt)
+{
+  return (cnt + 3) / 4 + 4 * cnt + SVB_PAD;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: svb_encode
+ *-------------------------------------------------------------------------*/
+u32 svb_encode (const u32 * in, u32 cnt, byte * out)
+{
+  byte * ctrl = out;
+  byte * data = out + (cnt + 3) / 4;
+  memset(ctrl, 0, (cnt + 3) / 4);
+  for (u32 i = 0; i < cnt; i++)
+  {
+    u32 x = in[i], len = svb_num_len(x);
+    ctrl[i / 4] |= (len - 1) << (2 * (i % 4));
+    for (u32 j = 0; j < len; j++) *data++ = x >> (8 * j);
+  }
+  memset(data, 0, SVB_PAD);
+  return data + SVB_PAD - out;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: svb_decode
+ *-------------------------------------------------------------------------*/
+const byte * svb_decode (const byte * in, u32 cnt, u32 * out)
+{
+  const byte * ctrl = in;
+  const byte * data = in + (cnt + 3) / 4;
+  u32 i = 0;
+  
+  pthread_once(&svb_once, svb_init_tables);
+#ifdef SVB_SSSE3
+  if (svb_ssse3) i = svb_decode_ssse3(ctrl, &data, cnt, out);
+#endif
+  for (; i < cnt; i++)
+  {
+    u32 len = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1, x = 0;
+    for (u32 j = 0; j < len; j++) x |= (u32)data[j] << (8 * j);
+    out[i] = x;
+    data += len;
+  }
+  return data + SVB_PAD;
+}
@@ -0,0 +1,67 @@
+/*
+ *	Subgraph Isomorphism - Stream VByte codec
+ *
+ *	(c) 2016 Josef Malik <josef.malik@fit.cvut.cz>
+ *
+ *	This software may be freely distributed and used according to the terms
+ *	of the GNU Lesser General Public License.
+ */
+
+#ifndef __SVB_H__
+#define __SVB_H__
+
+#include "common.h"
+
+/* Number of zero bytes appended after encoded data (allows 16B loads while decoding) */
+#define SVB_PAD 16
+
+/****************************************************************************
+ * FUNCTIONS
+ ***************************************************************************/
+
+/* -------------------------
+ * Function: svb_max_len
+ * -------------------------
+ * Returns maximal number of bytes needed to encode given count of numbers.
+ * 
+ * Params:
+ *   cnt - count of numbers
+ *
+ * Returns:
+ *   Upper bound of the length of encoded data (including padding)
+ */
+u32          svb_max_len (u32 cnt);
+
+/* -------------------------
+ * Function: svb_encode
+ * -------------------------
+ * Encodes an array of numbers -- 2-bit lengths of all numbers are stored
+ * in a control stream, followed by a data stream of 1-4 bytes per number.
+ * 
+ * Params:
+ *   in  - numbers to be encoded
+ *   cnt - count of numbers
+ *   out - output buffer (at least svb_max_len(cnt) bytes)
+ *
+ * Returns:
+ *   Number of bytes written to out
+ */
+u32          svb_encode  (const u32 * in, u32 cnt, byte * out);
+
+/* -------------------------
+ * Function: svb_decode
+ * -------------------------
+ * Decodes an array of numbers encoded by svb_encode (by SSSE3 shuffles if
+ * the CPU supports them, byte by byte otherwise).
+ * 
+ * Params:
+ *   in  - encoded data
+ *   cnt - count of numbers
+ *   out - output array for decoded numbers
+ *
+ * Returns:
+ *   Pointer to the first byte after the encoded data
+ */
+const byte * svb_decode  (const byte * in, u32 cnt, u32 * out);
+
+#endif /* __SVB_H__ */
@@ -14,11 +14,54 @@
 #include "util.h"
 #include "tree_dec.h"
 #include "nice_tree_dec.h"
+#include "resbuf.h"
+#include "subiso.h"
+#include "aut.h"
+#include "cost.h"
+#include "filter.h"
+#include <stdlib.h>
+
+/****************************************************************************
+ * DECLARATIONS
+ ***************************************************************************/
+
+#define TEST_G_VERTICES 48 /* number of vertices of graphs searched by tests */
+#define TEST_G_DEG      6  /* mean degree of graphs searched by tests */
+#define TEST_REPS       12 /* number of repetitions of searches of tests */
+#define TEST_RES_LIMIT  32 /* result limit of searches of tests stopped early */
+#define TEST_SAMPLES    400 /* mean number of samples of each embedding */
+#define TEST_SAMPLE_DEV 120 /* allowed deviation of numbers of samples (6 standard deviations) */
+
+/* Globals of the query kept while a test searches its own graphs (see test_enter) */
+typedef struct test_state_struct
+{
+  GRAPH  * g, * f;
+  u64   ** cand;
+  umask  * less;
+  int    * ecc, * comp;
+  int      res_limit, sample_cnt;
+} TEST_STATE;
 
 /****************************************************************************
  * STATIC FUNCTIONS
  ***************************************************************************/
 
+/*---------------------------------------------------------------------------
+ * Function: test_col
+ *---------------------------------------------------------------------------
+ * Color set of a record stored by test_resbuf
+ *
+ * Params:
+ *   r     - index of the record
+ *   i     - index of the color set
+ *   fixed - whether all color sets have the same size
+ */ 
+static umask test_col (int r, int i, int fixed)
+{
+  if (fixed) return (umask)0xF << (r + 3 * i) % (UMASK_BITS - 3);
+  return ~EMPTY_MASK >> (r + i) % UMASK_BITS;
+}
+
 /*---------------------------------------------------------------------------
  * Function: dfs_trv_td
  *---------------------------------------------------------------------------
@@ -27,7 +70,7 @@ void dfs_trv_td (TREE_DEC * td, int x, int v_i, int * vis_dfs)
 {
   if (vis_dfs[x] || !GET_BIT(td->nodes[x].bag, v_i)) return;
   vis_dfs[x] = 1;
-  for (int i = 0; i < F_GRAPH->n_cnt; i++) 
+  for (int i = 0; i < td->b_cnt; i++) 
   {
     if (GET_BIT(td->nodes[x].adj, i)) dfs_trv_td(td, i, v_i, vis_dfs);
   }
@@ -45,6 +88,355 @@ void dfs_trv_ntd (NICE_TREE_DEC_NODE * x, int v_i, int * vis_dfs, NICE_TREE_DEC_
   if (x->child_2 != prev) dfs_trv_ntd(x->child_2, v_i, vis_dfs, x);
 }
  
+/*---------------------------------------------------------------------------
+ * Function: test_enter
+ *---------------------------------------------------------------------------
+ * Keeps globals of the query and makes a test graph the searched one (all
+ * embeddings are collected, without a result limit)
+ *
+ * Params:
+ *   s - state to keep the globals in
+ *   g - graph to be searched
+ */
+static void test_enter (TEST_STATE * s, GRAPH * g)
+{
+  s->g = G_GRAPH;
+  s->f = F_GRAPH;
+  s->cand = F_CAND;
+  s->less = F_LESS;
+  s->ecc = F_ECC;
+  s->comp = F_COMP;
+  s->res_limit = RES_LIMIT;
+  s->sample_cnt = SAMPLE_CNT;
+  RES_LIMIT = SAMPLE_CNT = 0;
+  G_GRAPH = g;
+  F_GRAPH = NULL;
+  F_CAND = NULL;
+  F_LESS = NULL;
+  F_ECC = F_COMP = NULL;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_leave
+ *---------------------------------------------------------------------------
+ * Restores globals of the query kept by test_enter
+ *
+ * Params:
+ *   s - state with the globals
+ */
+static void test_leave (TEST_STATE * s)
+{
+  aut_free();
+  G_GRAPH = s->g;
+  F_GRAPH = s->f;
+  F_CAND = s->cand;
+  F_LESS = s->less;
+  F_ECC = s->ecc;
+  F_COMP = s->comp;
+  RES_LIMIT = s->res_limit;
+  SAMPLE_CNT = s->sample_cnt;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_graph
+ *---------------------------------------------------------------------------
+ * Creates a random graph searched by tests (with TEST_G_VERTICES vertices)
+ *
+ * Params:
+ *   deg - mean degree
+ *
+ * Returns:
+ *   Pointer to the new graph
+ */
+static GRAPH * test_graph (int deg)
+{
+  GRAPH * g = graph_init(TEST_G_VERTICES);
+  for (int v = 0; v < g->n_cnt; v++) for (int w = v + 1; w < g->n_cnt; w++)
+  {
+    if (rand() % (g->n_cnt - 1) >= deg) continue;
+    graph_add_edge(g, v, w);
+    graph_add_edge(g, w, v);
+  }
+  return g;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_f
+ *---------------------------------------------------------------------------
+ * Creates a pattern from a list of its edges
+ *
+ * Params:
+ *   n     - number of vertices
+ *   edges - pairs of vertices of edges
+ *   e_cnt - number of edges
+ *
+ * Returns:
+ *   Pointer to the new graph
+ */
+static GRAPH * test_f (int n, int (* edges)[2], int e_cnt)
+{
+  GRAPH * f = graph_init(n);
+  for (int e = 0; e < e_cnt; e++)
+  {
+    graph_add_edge(f, edges[e][0], edges[e][1]);
+    graph_add_edge(f, edges[e][1], edges[e][0]);
+  }
+  return f;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_pattern
+ *---------------------------------------------------------------------------
+ * Prepares the search of a pattern in G_GRAPH (as in main) -- all vertices of
+ * G_GRAPH lower than cand_cnt are its candidates, symmetries are broken only
+ * if asked to. F_LESS of the pattern is kept until the next one is prepared.
+ *
+ * Params:
+ *   p        - pattern to be filled (its graph is taken)
+ *   f        - graph of the pattern
+ *   td       - tree decomposition of f (NULL to compute one)
+ *   cand_cnt - number of candidates of each vertex
+ *   sym      - whether symmetry-breaking constraints (see F_LESS) are used
+ *
+ * Returns:
+ *   Copy of the tree decomposition of the pattern
+ */
+static TREE_DEC * test_pattern (SUBISO_PATTERN * p, GRAPH * f, TREE_DEC * td, int cand_cnt, int sym)
+{
+  F_GRAPH = f;
+  ARR_ALLOC(F_CAND, f->n_cnt);
+  for (int u = 0; u < f->n_cnt; u++)
+  {
+    ARR_ALLOC(F_CAND[u], (G_GRAPH->n_cnt + 63) >> 6);
+    memset(F_CAND[u], 0, ARR_LEN(F_CAND[u]) * sizeof(**F_CAND));
+    for (int v = 0; v < cand_cnt; v++) F_CAND[u][v >> 6] |= 1ULL << (v & 63);
+  }
+  graph_pre_f_ecc();
+  cost_init();
+  aut_free();
+  if (sym) aut_init();
+  else
+  {
+    ARR_ALLOC(F_LESS, f->n_cnt);
+    memset(F_LESS, 0, f->n_cnt * sizeof(*F_LESS));
+  }
+  TREE_DEC * ftd;
+  if (td)
+  {
+    ftd = (TREE_DEC *)xmalloc(sizeof(*ftd));
+    memcpy(ftd, td, sizeof(*ftd));
+  }
+  else
+  {
+    GRAPH * tmp_f = graph_clone(f);
+    ftd = td_get(tmp_f);
+    graph_free(tmp_f);
+  }
+  p->name = NULL;
+  p->f = f;
+  p->cand = F_CAND;
+  p->ntd = ntd_get(ftd);
+  p->result = NULL;
+  subiso_plan(p->ntd);
+  ARR_FREE(F_ECC);
+  ARR_FREE(F_COMP);
+  F_ECC = F_COMP = NULL;
+  F_CAND = NULL;
+  return ftd;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_pattern_free
+ *---------------------------------------------------------------------------
+ * Frees a pattern prepared by test_pattern
+ *
+ * Params:
+ *   p - pattern to be freed
+ */
+static void test_pattern_free (SUBISO_PATTERN * p)
+{
+  ntd_free(p->ntd);
+  for (int u = 0; u < ARR_LEN(p->cand); u++) ARR_FREE(p->cand[u]);
+  ARR_FREE(p->cand);
+  graph_free(p->f);
+  graph_result_array_free(p->result);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_brute
+ *---------------------------------------------------------------------------
+ * Enumerates all colourful embeddings of F_GRAPH to candidates in G_GRAPH under
+ * the colouring in COLOUR and symmetry-breaking constraints F_LESS, vertices
+ * of F_GRAPH are assigned in their order
+ *
+ * Params:
+ *   map  - images of vertices lower than u
+ *   u    - vertex to be assigned
+ *   used - colours of images of vertices lower than u
+ *   out  - array to append the embeddings to
+ */
+static void test_brute (int * map, int u, umask used, GRAPH_RESULT *** out)
+{
+  if (u == F_GRAPH->n_cnt)
+  {
+    GRAPH_RESULT * res = graph_result_init(F_GRAPH);
+    memcpy(res->mapping, map, u * sizeof(*map));
+    ARR_PUSH(*out, res);
+    return;
+  }
+  for (int v = 0; v < G_GRAPH->n_cnt; v++)
+  {
+    int ok = IS_CAND(u, v) && !GET_BIT(used, COLOUR[v]);
+    for (int w = 0; w < u && ok; w++)
+    {
+      if (graph_is_adj(F_GRAPH, u, w) && !graph_is_adj(G_GRAPH, v, map[w])) ok = 0;
+      if ((GET_BIT(F_LESS[u], w) && v > map[w]) || (GET_BIT(F_LESS[w], u) && map[w] > v)) ok = 0;
+    }
+    if (!ok) continue;
+    map[u] = v;
+    test_brute(map, u + 1, SET_BIT(used, COLOUR[v]), out);
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_colouring
+ *---------------------------------------------------------------------------
+ * Randomly colours G_GRAPH by |V(F_GRAPH)| colours (as subiso_run does)
+ */
+static void test_colouring (void)
+{
+  GARY_RESIZE(COLOUR, G_GRAPH->n_cnt);
+  for (int i = 0; i < G_GRAPH->n_cnt; i++) COLOUR[i] = rand() % F_GRAPH->n_cnt;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_aut_cnt
+ *---------------------------------------------------------------------------
+ * Counts automorphisms of F_GRAPH extending a partial one by brute force
+ *
+ * Params:
+ *   perm - images of vertices lower than u
+ *   u    - vertex to be mapped
+ *   used - images of vertices lower than u
+ *
+ * Returns:
+ *   Number of automorphisms
+ */
+static int test_aut_cnt (int * perm, int u, umask used)
+{
+  int cnt = 0;
+  if (u == F_GRAPH->n_cnt) return 1;
+  for (int v = 0; v < F_GRAPH->n_cnt; v++)
+  {
+    int ok = !GET_BIT(used, v);
+    for (int w = 0; w < u && ok; w++) ok = (graph_is_adj(F_GRAPH, u, w) == graph_is_adj(F_GRAPH, v, perm[w]));
+    if (!ok) continue;
+    perm[u] = v;
+    cnt += test_aut_cnt(perm, u + 1, SET_BIT(used, v));
+  }
+  return cnt;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_key_cmp
+ *---------------------------------------------------------------------------
+ * Compares sorted vertex sets of two results (for qsort)
+ */
+static int test_key_len;
+static int test_key_cmp (const void * a, const void * b)
+{
+  return memcmp(a, b, test_key_len * sizeof(int));
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_keys
+ *---------------------------------------------------------------------------
+ * Mappings or sorted vertex sets of results (results are unique by the latter,
+ * see graph_result_glmemory_push) in sorted order
+ *
+ * Params:
+ *   results - array of results
+ *   n       - number of vertices of the pattern
+ *   sets    - whether vertex sets are taken instead of mappings
+ *
+ * Returns:
+ *   Array of mappings or vertex sets (n vertices each)
+ */
+static int * test_keys (GRAPH_RESULT ** results, int n, int sets)
+{
+  int * keys;
+  ARR_ALLOC(keys, MAX(ARR_LEN(results) * n, 1));
+  for (int i = 0; i < ARR_LEN(results); i++)
+  {
+    int * k = keys + i * n;
+    memcpy(k, results[i]->mapping, n * sizeof(*k));
+    for (int j = 1; j < n && sets; j++) for (int l = j; l && k[l - 1] > k[l]; l--)
+    {
+      int t = k[l];
+      k[l] = k[l - 1];
+      k[l - 1] = t;
+    }
+  }
+  test_key_len = n;
+  qsort(keys, ARR_LEN(results), n * sizeof(*keys), test_key_cmp);
+  return keys;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_same_results
+ *---------------------------------------------------------------------------
+ * Checks, whether two arrays of results contain the same embeddings or
+ * subgraphs (in any order)
+ *
+ * Params:
+ *   a    - first array of results
+ *   b    - second array of results
+ *   n    - number of vertices of the pattern
+ *   sets - whether only vertex sets of results are compared
+ *
+ * Returns:
+ *   1 if so, 0 otherwise
+ */
+static int test_same_results (GRAPH_RESULT ** a, GRAPH_RESULT ** b, int n, int sets)
+{
+  if (ARR_LEN(a) != ARR_LEN(b)) return 0;
+  int * k_a = test_keys(a, n, sets), * k_b = test_keys(b, n, sets);
+  int same = !memcmp(k_a, k_b, ARR_LEN(a) * n * sizeof(*k_a));
+  ARR_FREE(k_a);
+  ARR_FREE(k_b);
+  return same;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_td_score
+ *---------------------------------------------------------------------------
+ * Counts vertices introduced without a neighbour in the bag in the nice tree
+ * decomposition built from a subtree of a tree decomposition (as the score
+ * td_get minimises after the width)
+ *
+ * Params:
+ *   td   - tree decomposition
+ *   x    - root of the subtree
+ *   prev - parent of x (initially -1)
+ *
+ * Returns:
+ *   Number of such vertices
+ */
+static int test_td_score (TREE_DEC * td, int x, int prev)
+{
+  int order[MAX_F_VERTICES], res = 0, leaf = 1;
+  umask bag = td->nodes[x].bag;
+  for (int i = 0; i < td->b_cnt; i++)
+  {
+    if (!GET_BIT(td->nodes[x].adj, i) || i == prev) continue;
+    leaf = 0;
+    res += td_intro_order(td, bag & td->nodes[i].bag, bag & ~td->nodes[i].bag, order);
+    res += test_td_score(td, i, x);
+  }
+  if (leaf) res += td_intro_order(td, EMPTY_MASK, bag, order);
+  return res;
+}
+
 /****************************************************************************
  * INTERFACE FUNCTIONS
  ***************************************************************************/
@@ -57,7 +449,7 @@ int test_tree_dec      (TREE_DEC * td)
   /* Test vertex coverage */
   int vis_ver[MAX_F_VERTICES];
   memset(vis_ver, 0, sizeof(vis_ver));
-  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  for (int i = 0; i < td->b_cnt; i++)
   {
     for (int j = 0; j < F_GRAPH->n_cnt; j++) if (GET_BIT(td->nodes[i].bag, j)) vis_ver[j] = 1; 
   }
@@ -65,7 +457,7 @@ int test_tree_dec      (TREE_DEC * td)
   /* Test edge coverage */
   int vis_edg[MAX_F_VERTICES][MAX_F_VERTICES];
   memset(vis_edg, 0, sizeof(vis_edg));
-  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  for (int i = 0; i < td->b_cnt; i++)
   {
     for (int j = 0; j < F_GRAPH->n_cnt; j++) for (int k = j + 1; k < F_GRAPH->n_cnt; k++) 
     {
@@ -89,7 +481,7 @@ int test_tree_dec      (TREE_DEC * td)
     int cc, vis_dfs[MAX_F_VERTICES];
     cc = 0;
     memset(vis_dfs, 0, sizeof(vis_dfs));
-    for (int i = 0; i < F_GRAPH->n_cnt; i++) if (GET_BIT(td->nodes[i].bag, v_i) && !vis_dfs[i])
+    for (int i = 0; i < td->b_cnt; i++) if (GET_BIT(td->nodes[i].bag, v_i) && !vis_dfs[i])
     {
       dfs_trv_td(td, i, v_i, vis_dfs);
       if (++cc > 1) return TEST_NOK;
@@ -97,7 +489,7 @@ int test_tree_dec      (TREE_DEC * td)
   }
   /* Test treewidth optimality */
   int ms = 0;
-  for (int i = 0; i < F_GRAPH->n_cnt; i++)
+  for (int i = 0; i < td->b_cnt; i++)
   {
     int cs = 0;
     for (int j = 0; j < F_GRAPH->n_cnt; j++) if (GET_BIT(td->nodes[i].bag, j)) ++cs;
@@ -216,4 +608,464 @@ int test_results       (GRAPH_RESULT ** results)
     }
   }
   return TEST_OK; 
-}
\ No newline at end of file
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_resbuf
+ *-------------------------------------------------------------------------*/ 
+int test_resbuf        (void)
+{
+  RESBUF * rb = resbuf_init();
+  int rec_cnt = 3 * RES_BLK_RECS, clen, res = TEST_OK, first = -1;
+  u32 map[2], got_map[2];
+  u64 pos, prev = 0, off = 0;
+  umask col[5], * got;
+
+  ARR_INIT(got);
+  /* Color sets of the first half have the same size, the rest have all sizes */
+  for (int r = 0; r < rec_cnt; r++)
+  {
+    map[0] = r / 7;
+    map[1] = r;
+    for (int i = 0; i < r % 5 + 1; i++) col[i] = test_col(r, i, r < rec_cnt / 2);
+    resbuf_push(rb, map, 2, col, r % 5 + 1);
+  }
+  resbuf_chng_state(rb, RES_READ);
+  for (int r = 0; r < rec_cnt && res == TEST_OK; r++)
+  {
+    if (resbuf_read(rb, got_map, 2, &got, &clen) == RES_EOF || got_map[0] != r / 7 || got_map[1] != r ||
+        clen != r % 5 + 1) res = TEST_NOK;
+    for (int i = 0; i < clen && res == TEST_OK; i++)
+    {
+      if (got[i] != test_col(r, i, r < rec_cnt / 2)) res = TEST_NOK;
+    }
+    /* The first record of the second block */
+    pos = resbuf_tell(rb);
+    if (r && first < 0 && pos != prev)
+    {
+      first = r;
+      off = pos;
+    }
+    prev = pos;
+  }
+  if (res == TEST_OK && resbuf_read(rb, got_map, 2, &got, &clen) != RES_EOF) res = TEST_NOK;
+  /* Reading restarts at the block */
+  resbuf_seek(rb, off);
+  if (res == TEST_OK && (first < 0 || resbuf_read(rb, got_map, 2, &got, &clen) == RES_EOF ||
+      got_map[1] != first || resbuf_lcp(rb))) res = TEST_NOK;
+  ARR_FREE(got);
+  resbuf_free(rb);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_batch
+ *-------------------------------------------------------------------------*/
+int test_batch         (SUBISO_PATTERN ** pat, int cnt, int rep_cnt)
+{
+  GRAPH_RESULT ** keep[cnt];
+  int keep_rc[cnt], res = TEST_OK;
+  /* Samples depend on the order of draws */
+  if (SAMPLE_CNT) return TEST_OK;
+  for (int k = 0; k < cnt; k++)
+  {
+    keep[k] = pat[k]->result;
+    keep_rc[k] = pat[k]->rep_cnt;
+  }
+  srand(SEED);
+  subiso_run_batch(pat, cnt, rep_cnt);
+  for (int k = 0; k < cnt; k++)
+  {
+    NICE_TREE_DEC * ntd = pat[k]->ntd;
+    NICE_TREE_DEC_NODE * share[ntd->b_cnt];
+    int * share_perm[ntd->b_cnt], shared[ntd->b_cnt], rc = rep_cnt;
+    /* The pattern is searched alone under the same colourings */
+    for (int i = 0; i < ntd->b_cnt; i++)
+    {
+      share[i] = ntd->nodes[i].share;
+      share_perm[i] = ntd->nodes[i].share_perm;
+      shared[i] = ntd->nodes[i].shared;
+      ntd->nodes[i].share = NULL;
+      ntd->nodes[i].share_perm = NULL;
+      ntd->nodes[i].shared = 0;
+    }
+    F_GRAPH = pat[k]->f;
+    F_CAND = pat[k]->cand;
+    srand(SEED);
+    GRAPH_RESULT ** single = subiso_run(ntd, &rc);
+  if (rc != pat[k]->rep_cnt || !test_same_results(pat[k]->result, single, F_GRAPH->n_cnt, 1)) res = TEST_NOK;
+    for (int i = 0; i < ntd->b_cnt; i++)
+    {
+      ntd->nodes[i].share = share[i];
+      ntd->nodes[i].share_perm = share_perm[i];
+      ntd->nodes[i].shared = shared[i];
+    }
+    graph_result_array_free(single);
+    graph_result_array_free(pat[k]->result);
+    pat[k]->result = keep[k];
+    pat[k]->rep_cnt = keep_rc[k];
+  }
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_batch_perm
+ *-------------------------------------------------------------------------*/
+int test_batch_perm    (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN pat[2], * grp[2] = { &pat[0], &pat[1] };
+  TREE_DEC td, * ftd;
+  int lab[5], res = TEST_OK, perm = 0;
+  /* Triangle with a pendant path, the second pattern is its reversed copy */
+  int edges[][2] = { { 0, 1 }, { 1, 2 }, { 2, 0 }, { 2, 3 }, { 3, 4 } };
+  GRAPH * f = test_f(5, edges, 5), * g;
+  for (int v = 0; v < 5; v++) lab[v] = 4 - v;
+  srand(SEED);
+  g = test_graph(TEST_G_DEG);
+  test_enter(&s, g);
+  ftd = test_pattern(&pat[0], f, NULL, g->n_cnt, 0);
+  /* The same decomposition relabeled, so all tables of the second pattern are read from
+     the first one with permuted columns, the second one has fewer candidates and goes
+     on after the first one stops at the result limit */
+  td = *ftd;
+  for (int i = 0; i < td.b_cnt; i++)
+  {
+    td.nodes[i].bag = EMPTY_MASK;
+    for (int v = 0; v < 5; v++) if (GET_BIT(ftd->nodes[i].bag, v)) td.nodes[i].bag = SET_BIT(td.nodes[i].bag, lab[v]);
+  }
+  for (int v = 0; v < 5; v++)
+  {
+    td.g_adj[lab[v]] = EMPTY_MASK;
+    for (int w = 0; w < 5; w++) if (GET_BIT(ftd->g_adj[v], w)) td.g_adj[lab[v]] = SET_BIT(td.g_adj[lab[v]], lab[w]);
+  }
+  td_free(ftd);
+  td_free(test_pattern(&pat[1], graph_relabel(f, lab), &td, g->n_cnt / 2, 0));
+  subiso_share(grp, 2);
+  for (int i = 0; i < pat[1].ntd->b_cnt; i++) if (pat[1].ntd->nodes[i].share_perm) perm = 1;
+  if (!perm) res = TEST_NOK;
+  for (int limit = 0; limit <= TEST_RES_LIMIT && res == TEST_OK; limit += TEST_RES_LIMIT)
+  {
+    RES_LIMIT = limit;
+    res = test_batch(grp, 2, TEST_REPS);
+  }
+  test_pattern_free(&pat[0]);
+  test_pattern_free(&pat[1]);
+  test_leave(&s);
+  graph_free(g);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_iter
+ *-------------------------------------------------------------------------*/
+int test_iter          (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN p;
+  int res = TEST_OK, map[MAX_F_VERTICES];
+  /* House (a cycle with a chord and symmetries) and a tree (with join nodes) */
+  int house[][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 0 }, { 1, 4 } };
+  int tree[][2] = { { 0, 1 }, { 1, 2 }, { 1, 3 }, { 3, 4 }, { 3, 5 } };
+  srand(SEED);
+  GRAPH * g = test_graph(TEST_G_DEG);
+  test_enter(&s, g);
+  ARR_INIT(COLOUR);
+  for (int t = 0; t < 4 && res == TEST_OK; t++)
+  {
+    GRAPH * f = (t < 2 ? test_f(5, house, 6) : test_f(6, tree, 5));
+    td_free(test_pattern(&p, f, NULL, g->n_cnt, t % 2));
+    F_CAND = p.cand;
+    for (int r = 0; r < TEST_REPS && res == TEST_OK; r++)
+    {
+      GRAPH_RESULT ** brute, ** all, ** part;
+      ARR_INIT(brute);
+      test_colouring();
+      test_brute(map, 0, EMPTY_MASK, &brute);
+      all = subiso_embed(p.ntd, 0);
+      if (!test_same_results(all, brute, f->n_cnt, 0)) res = TEST_NOK;
+      /* The iterator stopped at a limit yields the first embeddings */
+      for (int limit = 1; limit <= TEST_RES_LIMIT && res == TEST_OK; limit *= 2)
+      {
+        part = subiso_embed(p.ntd, limit);
+        if (ARR_LEN(part) != MIN(limit, ARR_LEN(all))) res = TEST_NOK;
+        for (int i = 0; i < ARR_LEN(part) && res == TEST_OK; i++)
+        {
+          if (memcmp(part[i]->mapping, all[i]->mapping, f->n_cnt * sizeof(*map))) res = TEST_NOK;
+        }
+        graph_result_array_free(part);
+      }
+      graph_result_array_free(brute);
+      graph_result_array_free(all);
+    }
+    /* The last repetition of a search stops collecting at the result limit */
+    int rc = TEST_REPS;
+    ARR_FREE(COLOUR);
+    RES_LIMIT = TEST_RES_LIMIT;
+    srand(SEED);
+    GRAPH_RESULT ** found = subiso_run(p.ntd, &rc);
+    if (ARR_LEN(found) > RES_LIMIT || (rc < TEST_REPS && ARR_LEN(found) != RES_LIMIT) ||
+        test_results(found) != TEST_OK) res = TEST_NOK;
+    graph_result_array_free(found);
+    RES_LIMIT = 0;
+    ARR_INIT(COLOUR);
+    test_pattern_free(&p);
+  }
+  ARR_FREE(COLOUR);
+  test_leave(&s);
+  graph_free(g);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_aut
+ *-------------------------------------------------------------------------*/
+int test_aut           (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN p_with, p_without;
+  int res = TEST_OK, perm[MAX_F_VERTICES];
+  int k4[][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+  int c6[][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 5 }, { 5, 0 } };
+  srand(SEED);
+  test_enter(&s, NULL);
+  ARR_INIT(COLOUR);
+  for (int t = 0; t < 2 && res == TEST_OK; t++)
+  {
+    /* The graph is dense enough for many copies of K4 */
+    GRAPH * f = (t ? test_f(6, c6, 6) : test_f(4, k4, 6)), * g;
+    G_GRAPH = g = test_graph(t ? TEST_G_DEG : TEST_G_VERTICES / 3);
+    td_free(test_pattern(&p_without, graph_clone(f), NULL, g->n_cnt, 0));
+    td_free(test_pattern(&p_with, f, NULL, g->n_cnt, 1));
+    int aut = test_aut_cnt(perm, 0, EMPTY_MASK), found = 0;
+    for (int r = 0; r < TEST_REPS && res == TEST_OK; r++)
+    {
+      test_colouring();
+      F_CAND = p_with.cand;
+      GRAPH_RESULT ** with = subiso_embed(p_with.ntd, 0);
+      F_GRAPH = p_without.f;
+      F_CAND = p_without.cand;
+      GRAPH_RESULT ** without = subiso_embed(p_without.ntd, 0);
+      F_GRAPH = f;
+      /* Embeddings with constraints are some of those without them */
+      int * k_with = test_keys(with, f->n_cnt, 0), * k_without = test_keys(without, f->n_cnt, 0);
+      if (ARR_LEN(with) * aut != ARR_LEN(without)) res = TEST_NOK;
+      for (int i = 0; i < ARR_LEN(with) && res == TEST_OK; i++)
+      {
+        if (!bsearch(k_with + i * f->n_cnt, k_without, ARR_LEN(without), f->n_cnt * sizeof(int), test_key_cmp)) res = TEST_NOK;
+      }
+      found += ARR_LEN(with);
+      ARR_FREE(k_with);
+      ARR_FREE(k_without);
+      graph_result_array_free(with);
+      graph_result_array_free(without);
+    }
+    test_pattern_free(&p_with);
+    test_pattern_free(&p_without);
+    graph_free(g);
+    if (!found) res = TEST_NOK;
+  }
+  ARR_FREE(COLOUR);
+  test_leave(&s);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_fuse
+ *-------------------------------------------------------------------------*/
+int test_fuse          (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN p;
+  int res = TEST_OK;
+  /* House, a tree (with join nodes) and a triangle with a pendant path */
+  int house[][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 0 }, { 1, 4 } };
+  int tree[][2] = { { 0, 1 }, { 1, 2 }, { 1, 3 }, { 3, 4 }, { 3, 5 } };
+  int tail[][2] = { { 0, 1 }, { 1, 2 }, { 2, 0 }, { 2, 3 }, { 3, 4 } };
+  srand(SEED);
+  GRAPH * g = test_graph(TEST_G_DEG);
+  test_enter(&s, g);
+  ARR_INIT(COLOUR);
+  for (int t = 0; t < 3 && res == TEST_OK; t++)
+  {
+    GRAPH * f = (t == 0 ? test_f(5, house, 6) : t == 1 ? test_f(6, tree, 5) : test_f(5, tail, 5));
+    td_free(test_pattern(&p, f, NULL, g->n_cnt, 1));
+    NICE_TREE_DEC * ntd = p.ntd;
+    int fused[ntd->b_cnt], fused_cnt = 0;
+    for (int i = 0; i < ntd->b_cnt; i++) fused_cnt += (fused[i] = ntd->nodes[i].fused);
+    if (!fused_cnt) res = TEST_NOK;
+    F_CAND = p.cand;
+    for (int r = 0; r < TEST_REPS && res == TEST_OK; r++)
+    {
+      test_colouring();
+      GRAPH_RESULT ** with = subiso_embed(ntd, 0);
+      /* Each node is evaluated to its own table */
+      for (int i = 0; i < ntd->b_cnt; i++) ntd->nodes[i].fused = 0;
+      GRAPH_RESULT ** without = subiso_embed(ntd, 0);
+      for (int i = 0; i < ntd->b_cnt; i++) ntd->nodes[i].fused = fused[i];
+      if (!test_same_results(with, without, f->n_cnt, 0)) res = TEST_NOK;
+      graph_result_array_free(with);
+      graph_result_array_free(without);
+    }
+    test_pattern_free(&p);
+  }
+  ARR_FREE(COLOUR);
+  test_leave(&s);
+  graph_free(g);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_tree_width
+ *-------------------------------------------------------------------------*/
+int test_tree_width    (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN p;
+  int res = TEST_OK, budget = TD_BUDGET;
+  int edges[4 * MAX_F_VERTICES][2];
+  /* A graph of treewidth 5 the heuristic el. orderings often miss */
+  int hard[][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 0, 4 }, { 0, 6 }, { 0, 9 }, { 0, 10 }, { 1, 3 }, { 1, 4 }, { 1, 6 },
+                    { 1, 7 }, { 2, 6 }, { 2, 7 }, { 2, 8 }, { 2, 9 }, { 2, 10 }, { 3, 4 }, { 3, 6 }, { 3, 7 }, { 3, 10 },
+                    { 4, 9 }, { 4, 10 }, { 5, 6 }, { 5, 8 }, { 5, 10 }, { 7, 8 }, { 7, 10 }, { 8, 9 } };
+  srand(SEED);
+  GRAPH * g = test_graph(TEST_G_DEG);
+  test_enter(&s, g);
+  /* A random tree, a cycle, a clique (with more optimal el. orderings than
+   * TD_MAX_PERMS), two grids and the graph above */
+  for (int t = 0; t < 6 && res == TEST_OK; t++)
+  {
+    int n, e_cnt = 0, tw;
+    if (t == 0)
+    {
+      n = 14;
+      tw = 1;
+      for (int v = 1; v < n; v++)
+      {
+        edges[e_cnt][0] = rand() % v;
+        edges[e_cnt++][1] = v;
+      }
+    }
+    else if (t == 1)
+    {
+      n = 12;
+      tw = 2;
+      for (int v = 0; v < n; v++)
+      {
+        edges[e_cnt][0] = v;
+        edges[e_cnt++][1] = (v + 1) % n;
+      }
+    }
+    else if (t == 2)
+    {
+      n = 7;
+      tw = n - 1;
+      for (int v = 0; v < n; v++) for (int w = v + 1; w < n; w++)
+      {
+        edges[e_cnt][0] = v;
+        edges[e_cnt++][1] = w;
+      }
+    }
+    else if (t == 5)
+    {
+      n = 11;
+      tw = 5;
+      e_cnt = sizeof(hard) / sizeof(*hard);
+      memcpy(edges, hard, sizeof(hard));
+    }
+    else
+    {
+      int h = t, w = 4; /* h x w grid */
+      n = h * w;
+      tw = MIN(h, w);
+      for (int v = 0; v < n; v++)
+      {
+        if (v % w < w - 1)
+        {
+          edges[e_cnt][0] = v;
+          edges[e_cnt++][1] = v + 1;
+        }
+        if (v + w < n)
+        {
+          edges[e_cnt][0] = v;
+          edges[e_cnt++][1] = v + w;
+        }
+      }
+    }
+    GRAPH * f = test_f(n, edges, e_cnt);
+    /* Optimal el. orderings, then only the heuristic ones (no time for the DP) */
+    TREE_DEC * opt = test_pattern(&p, f, NULL, g->n_cnt, 0);
+    TD_BUDGET = -1;
+    GRAPH * tmp_f = graph_clone(f);
+    TREE_DEC * heur = td_get(tmp_f);
+    graph_free(tmp_f);
+    TD_BUDGET = budget;
+    int opt_score = test_td_score(opt, opt->root, -1), heur_score = test_td_score(heur, heur->root, -1);
+    if (opt->tw != tw || heur->tw < tw) res = TEST_NOK;
+    if (test_tree_dec(opt) != TEST_OK || test_tree_dec(heur) != TEST_OK) res = TEST_NOK;
+    if (test_nice_tree_dec(p.ntd) != TEST_OK) res = TEST_NOK;
+    /* The chosen root has the lowest score, the DP keeps the best ordering */
+    for (int r = 0; r < opt->b_cnt; r++) if (test_td_score(opt, r, -1) < opt_score) res = TEST_NOK;
+    if (heur->tw == opt->tw && heur_score < opt_score) res = TEST_NOK;
+    /* Trees, cycles and cliques have bags connected along the decomposition */
+    if (t < 3 && opt_score) res = TEST_NOK;
+    td_free(heur);
+    td_free(opt);
+    test_pattern_free(&p);
+  }
+  test_leave(&s);
+  graph_free(g);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: test_sample
+ *-------------------------------------------------------------------------*/
+int test_sample        (void)
+{
+  TEST_STATE s;
+  SUBISO_PATTERN p;
+  int res = TEST_OK;
+  /* A tree (with join nodes) and house, both with symmetry breaking */
+  int tree[][2] = { { 0, 1 }, { 1, 2 }, { 1, 3 }, { 3, 4 }, { 3, 5 } };
+  int house[][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 0 }, { 1, 4 } };
+  srand(SEED);
+  GRAPH * g = test_graph(TEST_G_DEG);
+  test_enter(&s, g);
+  ARR_INIT(COLOUR);
+  for (int t = 0; t < 2 && res == TEST_OK; t++)
+  {
+    GRAPH * f = (t == 0 ? test_f(6, tree, 5) : test_f(5, house, 6));
+    int n = f->n_cnt;
+    /* Fewer candidates keep the number of embeddings of the tree small */
+    td_free(test_pattern(&p, f, NULL, t ? g->n_cnt : g->n_cnt / 2, 1));
+    F_CAND = p.cand;
+    test_colouring();
+    GRAPH_RESULT ** exact = subiso_embed(p.ntd, 0);
+    int e_cnt = ARR_LEN(exact), cnt[MAX(e_cnt, 1)];
+    if (!e_cnt) res = TEST_NOK;
+    SAMPLE_CNT = e_cnt * TEST_SAMPLES;
+    GRAPH_RESULT ** sampled = subiso_embed(p.ntd, 0);
+    SAMPLE_CNT = 0;
+    if (ARR_LEN(sampled) != e_cnt * TEST_SAMPLES) res = TEST_NOK;
+    /* Sampled embeddings are found among the exact ones and counted */
+    int * k_e = test_keys(exact, n, 0), * k_s = test_keys(sampled, n, 0);
+    memset(cnt, 0, sizeof(cnt));
+    for (int i = 0, j = 0; i < ARR_LEN(sampled) && res == TEST_OK; i++)
+    {
+      while (j < e_cnt && memcmp(k_e + j * n, k_s + i * n, n * sizeof(*k_e)) < 0) j++;
+      if (j == e_cnt || memcmp(k_e + j * n, k_s + i * n, n * sizeof(*k_e))) res = TEST_NOK;
+      else cnt[j]++;
+    }
+    for (int j = 0; j < e_cnt; j++) if (ABS(cnt[j] - TEST_SAMPLES) > TEST_SAMPLE_DEV) res = TEST_NOK;
+    ARR_FREE(k_e);
+    ARR_FREE(k_s);
+    graph_result_array_free(exact);
+    graph_result_array_free(sampled);
+    test_pattern_free(&p);
+  }
+  ARR_FREE(COLOUR);
+  test_leave(&s);
+  graph_free(g);
+  return res;
+}
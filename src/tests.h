@@ -56,5 +56,104 @@ int test_nice_tree_dec (NICE_TREE_DEC * ntd);
 *   TEST_OK if all results are OK
 */
 int test_results       (GRAPH_RESULT ** results);
+
+/* -------------------------
+* Function: test_resbuf
+* -------------------------
+* Checks, whether records with color sets using all bits of umask are read
+* back from a result buffer unchanged (both when stored as ranks and as masks)
+*
+* Returns:
+*   TEST_OK if all records are OK
+*/
+int test_resbuf        (void);
+
+/* -------------------------
+* Function: test_batch
+* -------------------------
+* Checks, whether a batch of patterns finds the same subgraphs (after the same
+* number of repetitions) as searches of the patterns one by one under the same
+* colourings
+* 
+* Params:
+*   pat     - patterns of the batch (with shared DP tables, see subiso_share)
+*   cnt     - number of patterns
+*   rep_cnt - number of algorithm repetitions
+*
+* Returns:
+*   TEST_OK if all patterns find the same subgraphs
+*/
+int test_batch         (SUBISO_PATTERN ** pat, int cnt, int rep_cnt);
+
+/* -------------------------
+* Function: test_batch_perm
+* -------------------------
+* Checks test_batch on a random graph for a pattern and its relabeled copy
+* with fewer candidates, which reads DP tables of the first one with permuted
+* columns (also when the first one stops at a result limit)
+*
+* Returns:
+*   TEST_OK if both patterns find the same subgraphs as alone
+*/
+int test_batch_perm    (void);
+
+/* -------------------------
+* Function: test_iter
+* -------------------------
+* Checks on a random graph, whether the iterator yields the same embeddings
+* as all colourful embeddings enumerated by brute force (with and without
+* symmetry breaking), whether the iterator stopped at a limit yields the first
+* of them, and whether a search stops collecting at the result limit
+*
+* Returns:
+*   TEST_OK if all embeddings are OK
+*/
+int test_iter          (void);
+
+/* -------------------------
+* Function: test_aut
+* -------------------------
+* Checks on a random graph for K4 and C6, whether a colouring has |Aut(F)| times
+* fewer embeddings with symmetry-breaking constraints than without them
+*
+* Returns:
+*   TEST_OK if the numbers of embeddings are OK
+*/
+int test_aut           (void);
+
+/* -------------------------
+* Function: test_fuse
+* -------------------------
+* Checks on a random graph, whether fused chains of nodes (with forget nodes
+* merging sorted runs) yield the same embeddings as nodes evaluated one by one
+*
+* Returns:
+*   TEST_OK if all embeddings are the same
+*/
+int test_fuse          (void);
+
+/* -------------------------
+* Function: test_tree_width
+* -------------------------
+* Checks decompositions of a tree, a cycle, a clique and grids of known
+* treewidth, and whether td_get keeps the best of the el. orderings examined
+* (up to TD_MAX_PERMS optimal ones) together with its best root
+*
+* Returns:
+*   TEST_OK if all decompositions are OK
+*/
+int test_tree_width    (void);
+
+/* -------------------------
+* Function: test_sample
+* -------------------------
+* Checks on a random graph for a tree and house, whether embeddings drawn by
+* sampling (see SAMPLE_CNT) are found by the search and have about the same
+* frequencies
+*
+* Returns:
+*   TEST_OK if the samples are OK
+*/
+int test_sample        (void);
  
 #endif /* __TESTS_H__ */
\ No newline at end of file
@@ -11,37 +11,107 @@
 #include "util.h"
 #include "graph.h"
 #include "array.h"
+#include "sched.h"
+#include "cost.h"
+#include "resbuf.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* Heuristics of el. orderings */
+#define HEUR_MIN_DEGREE 0 /* vertex of minimal degree in the graph with fill edges */
+#define HEUR_MIN_FILL   1 /* vertex adding fewest fill edges */
+#define HEUR_MIN_WIDTH  2 /* vertex of minimal degree in the graph without fill edges */
+#define HEUR_CNT        3
+
+/* Subsets of a layer of the treewidth DP between two checks of the deadline */
+#define TW_CLOCK_STEP 4096
+
+/* Part of a layer of the treewidth DP (subsets of the same size) computed by a single task */
+typedef struct
+{
+  SCHED_TASK task;
+  /* Number of vertices, size of subsets, index of the part and number of parts */
+  int        n, k, part, parts;
+  /* Time (see td_now) at which the part is abandoned, set if that happened */
+  double     deadline;
+  int        expired;
+} TW_LAYER;
 
 static int * tw_dp;
+/* Adjacency of the decomposed graph in form of bitmasks */
+static umask td_adj[MAX_F_VERTICES];
+static TREE_DEC * td_best;
+static double td_best_cost;
+static int td_best_score, td_perms_left;
+static int td_best_perm[MAX_F_VERTICES];
 
 /****************************************************************************
  * STATIC FUNCTIONS
  ***************************************************************************/
 
+/*---------------------------------------------------------------------------
+ * Function: td_now
+ *---------------------------------------------------------------------------
+ * Returns current (monotonic) time in milliseconds
+ */
+static double td_now (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: td_adj_init
+ *---------------------------------------------------------------------------
+ * Fills adjacency bitmasks td_adj of the decomposed graph
+ *
+ * Params:
+ *   g - used graph
+ */
+static void td_adj_init (GRAPH * g)
+{
+  for (int i = 0; i < g->n_cnt; i++)
+  {
+    td_adj[i] = EMPTY_MASK;
+    FOR_ADJ(g->edges[i], node)
+    {
+      td_adj[i] = SET_BIT(td_adj[i], node->key);
+    }
+    FOR_ADJ_END;
+  }
+}
+
 /*---------------------------------------------------------------------------
  * Function: get_q_component
  *---------------------------------------------------------------------------
- * Finds all vertices in the connected component of G[S union x]
+ * Finds the connected component of G[S] containing x. The component is grown
+ * by whole frontiers of bitmasks (see td_adj).
  *
  * Params:
- *   g           - used graph G
- *   S           - mask representing current subset of vertices
- *   x           - node whose component is being searched in G[S union x]
- *   q_component - array to save information about component to (initially zeroed)
+ *   S   - mask representing current subset of vertices (containing x)
+ *   x   - node whose component is being searched
+ *   nbr - bitmask to store the component together with its neighbours to
+ *
+ * Returns:
+ *   Bitmask of the component
  */
-static void get_q_component(GRAPH * g, umask S, int x, int * q_component)
+static umask get_q_component (umask S, int x, umask * nbr)
 {
-  if (q_component[x]) return;
-  q_component[x] = 1;
-  FOR_ADJ(g->edges[x], node)
+  umask comp = SET_BIT(EMPTY_MASK, x), front = comp;
+  *nbr = EMPTY_MASK;
+  while (front)
   {
-    int y = node->key;
-    if (GET_BIT(S, y)) get_q_component(g, S, y, q_component);
+    umask grow = EMPTY_MASK;
+    for (umask f = front; f; f &= f - 1) grow |= td_adj[MASK_CTZ(f)];
+    *nbr |= grow;
+    front = grow & S & ~comp;
+    comp |= front;
   }
-  FOR_ADJ_END;
+  return comp;
 }
 
 /*---------------------------------------------------------------------------
@@ -51,95 +121,111 @@ static void get_q_component(GRAPH * g, umask S, int x, int * q_component)
  * on page 12:4.
  *
  * Params:
- *   g - used graph
  *   S - mask representing current subset of vertices
  *   v - node for which this function is calculated
  *
  * Returns:
  *   Result of described computation
  */
-static int q_function (GRAPH * g, umask S, int v)
+static int q_function (umask S, int v)
 {
-  int res = 0;
-  int q_component[MAX_F_VERTICES];
-  memset(q_component, 0, sizeof(q_component));
-  get_q_component(g, S, v, q_component);
-  for (int i = 0; i < g->n_cnt; i++)
-  {
-    int has = 0;
-    if (!GET_BIT(S, i) && i != v)
-    {
-      FOR_ADJ(g->edges[i], node)
-      {
-        int y = node->key;
-        if (q_component[y]) has = 1;
-      }
-      FOR_ADJ_END;
-    }
-    if (has) ++res;
-  }
-  return res;
+  umask nbr, T = SET_BIT(S, v);
+  get_q_component(T, v, &nbr);
+  return MASK_POP(nbr & ~T);
 }
 
 /*---------------------------------------------------------------------------
- * Function: get_perm_dp
+ * Function: tw_layer_run
  *---------------------------------------------------------------------------
- * Returns treewidth of subgraph of g induced by vertices in S
+ * Computes treewidth of subgraphs induced by subsets of a given size (a part
+ * of them), smaller subsets are already done. Subsets are enumerated in
+ * increasing order (by Gosper's hack) and every parts-th of them is taken.
+ * Q(S \ v, v) is the same for all vertices v of a component of G[S], so it is
+ * computed once per component. The deadline is checked every TW_CLOCK_STEP
+ * subsets, the part is abandoned (and marked expired) once it passes.
  *
  * Params:
- *   g - used graph
- *   S - mask representing current subset of vertices
- *
- * Returns:
- *   Result of computation - corresponding treewidth
+ *   arg - corresponding part of a layer (TW_LAYER)
  */
-static int get_perm_dp (GRAPH * g, umask S)
+static void tw_layer_run (void * arg)
 {
-  if (!S) return -INF;
-  if (tw_dp[S] != NOT_USED) return tw_dp[S];
-  int res = NOT_USED;
-  for (int i = 0; i < g->n_cnt; i++)
+  TW_LAYER * l = (TW_LAYER *)arg;
+  umask end = 1U << l->n;
+  int idx = 0;
+  l->expired = 0;
+  for (umask S = (1U << l->k) - 1; S < end; )
   {
-    if (GET_BIT(S, i))
+    if (!(idx % TW_CLOCK_STEP) && td_now() > l->deadline)
+    {
+      l->expired = 1;
+      return;
+    }
+    if (idx++ % l->parts == l->part)
     {
-      int tww = get_perm_dp(g, UNSET_BIT(S, i));
-      int qw  = q_function(g, UNSET_BIT(S, i), i);
-      int t_res = MAX(tww, qw);
-      if (res == NOT_USED || t_res < res) res = t_res;
+      int res = NOT_USED;
+      for (umask T = S; T; )
+      {
+        umask nbr, comp = get_q_component(S, MASK_CTZ(T), &nbr);
+        int q = MASK_POP(nbr & ~S);
+        T &= ~comp;
+        for (; comp; comp &= comp - 1)
+        {
+          umask R = UNSET_BIT(S, MASK_CTZ(comp));
+          int t_res = MAX(R ? tw_dp[R] : -INF, q);
+          if (res == NOT_USED || t_res < res) res = t_res;
+        }
+      }
+      tw_dp[S] = res;
     }
+    umask c = S & -S, r = S + c;
+    if (!r) break;
+    S = (((r ^ S) >> 2) / c) | r;
   }
-  return tw_dp[S] = res;
 }
 
 /*---------------------------------------------------------------------------
- * Function: get_best_perm
+ * Function: get_perm_dp
  *---------------------------------------------------------------------------
- * Retrieves elimination ordering with minimal treewidth from DP tables
- * previously filled by function 'get_perm_dp'
+ * Computes treewidth of subgraphs of g induced by all subsets of vertices,
+ * layer by layer by size of subsets. Large layers are split among threads.
  *
  * Params:
- *   g - used graph
- *   S - mask representing current subset of vertices
- *   depth - current position in el. ordering
- *   perm - array to store resulting el. ordering
+ *   g        - used graph
+ *   deadline - time (see td_now) after which the computation is abandoned
+ *
+ * Returns:
+ *   Treewidth of g, or NOT_USED if the deadline was exceeded
  */
-static void get_best_perm (GRAPH * g, umask S, int depth, int * perm)
+static int get_perm_dp (GRAPH * g, double deadline)
 {
-  if (!S) return;
-  int res = INF, r_n;
-  for (int i = 0; i < g->n_cnt; i++)
+  int n = g->n_cnt;
+  TW_LAYER parts[MAX_F_VERTICES];
+  u64 layer = 1; /* Binomial coefficient (n choose k) */
+  for (int k = 1; k <= n; k++)
   {
-    if (GET_BIT(S, i))
+    layer = layer * (n - k + 1) / k;
+    int p_cnt = (layer >= TD_PAR_LAYER ? MIN(THR_CNT, MAX_F_VERTICES) : 1);
+    for (int p = 0; p < p_cnt; p++)
     {
-      if (tw_dp[UNSET_BIT(S, i)] < res)
-      {
-        res = tw_dp[UNSET_BIT(S, i)];
-        r_n = i;
-      }
+      parts[p].n = n;
+      parts[p].k = k;
+      parts[p].part = p;
+      parts[p].parts = p_cnt;
+      parts[p].deadline = deadline;
+      parts[p].task.run = tw_layer_run;
+      parts[p].task.arg = &parts[p];
+      if (p) sched_spawn(&parts[p].task);
     }
+    tw_layer_run(&parts[0]);
+    int expired = parts[0].expired;
+    for (int p = 1; p < p_cnt; p++)
+    {
+      sched_wait(&parts[p].task);
+      expired |= parts[p].expired;
+    }
+    if (expired) return NOT_USED;
   }
-  perm[depth] = r_n;
-  get_best_perm(g, UNSET_BIT(S, r_n), depth - 1, perm);
+  return tw_dp[(1U << n) - 1];
 }
 
 /*---------------------------------------------------------------------------
@@ -237,6 +323,8 @@ static void td_perm_rec (TREE_DEC * td, GRAPH * g, int * perm, int * inv_perm, i
     }
   }
   FOR_ADJ_END;
+  /* Components of a disconnected graph are chained */
+  if (low_nbr_pos == INF) low_nbr_pos = cp + 1;
   eliminate(g, inv_perm, perm[cp]);
   td_perm_rec(td, g, perm, inv_perm, cp + 1);
   set_tree_dec_node(td, perm[cp], vbag, SET_BIT(EMPTY_MASK, perm[low_nbr_pos]));
@@ -259,13 +347,262 @@ static TREE_DEC * td_from_perm (GRAPH * g, int * perm)
 {
   TREE_DEC * tmp = (TREE_DEC *)xmalloc(sizeof(*tmp));
   tmp->b_cnt = g->n_cnt;
-  for (int i = 0; i < tmp->b_cnt; ++i) tmp->nodes[i].bag = tmp->nodes[i].adj = EMPTY_MASK;
+  tmp->root = 0;
+  for (int i = 0; i < tmp->b_cnt; ++i) 
+  {
+    tmp->nodes[i].bag = tmp->nodes[i].adj = EMPTY_MASK;
+    tmp->g_adj[i] = EMPTY_MASK;
+    FOR_ADJ(g->edges[i], node)
+    {
+      tmp->g_adj[i] = SET_BIT(tmp->g_adj[i], node->key);
+    }
+    FOR_ADJ_END;
+  }
   int inv_perm[MAX_F_VERTICES];
   get_inv_perm(g, perm, inv_perm);
   td_perm_rec(tmp, g, perm, inv_perm, 0);
   return tmp;
 }
 
+/*---------------------------------------------------------------------------
+ * Function: td_score
+ *---------------------------------------------------------------------------
+ * Counts vertices introduced without a neighbour in the bag in the nice
+ * tree decomposition built from the given subtree of a tree decomposition
+ *
+ * Params:
+ *   td   - corresponding tree decomposition
+ *   x    - root of the subtree
+ *   prev - parent of x (initially -1)
+ *
+ * Returns:
+ *   Number of such vertices
+ */
+static int td_score (TREE_DEC * td, int x, int prev)
+{
+  int order[MAX_F_VERTICES], res = 0, leaf = 1;
+  umask bag = td->nodes[x].bag;
+  for (int i = 0; i < td->b_cnt; i++)
+  {
+    if (!GET_BIT(td->nodes[x].adj, i) || i == prev) continue;
+    leaf = 0;
+    res += td_intro_order(td, bag & td->nodes[i].bag, bag & ~td->nodes[i].bag, order);
+    res += td_score(td, i, x);
+  }
+  if (leaf) res += td_intro_order(td, EMPTY_MASK, bag, order);
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: td_cost
+ *---------------------------------------------------------------------------
+ * Estimates the total number of records of DP tables (see 'cost_bag') of
+ * the nice tree decomposition built from the given subtree of a tree
+ * decomposition -- of its nodes, of introduce and forget nodes connecting them
+ * (see 'ntd_connect') and of join nodes
+ *
+ * Params:
+ *   td   - corresponding tree decomposition
+ *   x    - root of the subtree
+ *   prev - parent of x (initially -1)
+ *
+ * Returns:
+ *   Estimated number of records
+ */
+static double td_cost (TREE_DEC * td, int x, int prev)
+{
+  int order[MAX_F_VERTICES], ch_cnt = 0;
+  umask bag = td->nodes[x].bag, b;
+  double res = cost_bag(bag);
+  if (prev < 0)
+  {
+    /* Forget nodes above the root */
+    b = EMPTY_MASK;
+    for (umask T = bag; T & (T - 1); T &= T - 1) res += cost_bag(b = SET_BIT(b, MASK_CTZ(T)));
+  }
+  for (int i = 0; i < td->b_cnt; i++)
+  {
+    if (!GET_BIT(td->nodes[x].adj, i) || i == prev) continue;
+    umask base = bag & td->nodes[i].bag;
+    if (ch_cnt++) res += cost_bag(bag);
+    /* Introduce nodes below x, then forget nodes above its child */
+    td_intro_order(td, base, bag & ~base, order);
+    b = base;
+    for (int j = 0; j < MASK_POP(bag & ~base) - 1; j++) res += cost_bag(b = SET_BIT(b, order[j]));
+    b = base;
+    for (umask T = td->nodes[i].bag & ~bag; T; T &= T - 1)
+    {
+      if (b) res += cost_bag(b);
+      b = SET_BIT(b, MASK_CTZ(T));
+    }
+    res += td_cost(td, i, x);
+  }
+  if (!ch_cnt)
+  {
+    /* Introduce nodes above the leaf */
+    td_intro_order(td, EMPTY_MASK, bag, order);
+    b = EMPTY_MASK;
+    for (int j = 0; j < MASK_POP(bag) - 1; j++) res += cost_bag(b = SET_BIT(b, order[j]));
+  }
+  return res;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: td_consider
+ *---------------------------------------------------------------------------
+ * Builds a tree decomposition from an el. ordering and keeps it (together
+ * with its root) if it is better than the best one so far -- of lower width,
+ * then with fewer vertices introduced without a neighbour in the bag (see
+ * 'td_score', such introductions search balls of G), then of lower estimated
+ * cost (see 'td_cost')
+ *
+ * Params:
+ *   g    - used graph
+ *   perm - el. ordering
+ */
+static void td_consider (GRAPH * g, int * perm)
+{
+  GRAPH * tmp_g = graph_clone(g); /* Elimination adds fill edges */
+  TREE_DEC * tmp = td_from_perm(tmp_g, perm);
+  graph_free(tmp_g);
+  tmp->tw = 0;
+  for (int i = 0; i < tmp->b_cnt; i++) tmp->tw = MAX(tmp->tw, MASK_POP(tmp->nodes[i].bag) - 1);
+  if (td_best && tmp->tw != td_best->tw)
+  {
+    if (tmp->tw > td_best->tw)
+    {
+      td_free(tmp);
+      return;
+    }
+    td_free(td_best);
+    td_best = NULL;
+    td_best_cost = HUGE_VAL;
+    td_best_score = INF;
+  }
+  for (int r = 0; r < tmp->b_cnt; r++)
+  {
+    int score = td_score(tmp, r, -1);
+    if (score > td_best_score) continue;
+    double cost = td_cost(tmp, r, -1);
+    if (score < td_best_score || cost < td_best_cost)
+    {
+      td_best_score = score;
+      td_best_cost = cost;
+      tmp->root = r;
+      if (td_best != tmp)
+      {
+        td_free(td_best);
+        td_best = tmp;
+        memcpy(td_best_perm, perm, g->n_cnt * sizeof(*perm));
+      }
+    }
+  }
+  if (td_best != tmp) td_free(tmp);
+}
+
+/*---------------------------------------------------------------------------
+ * Function: heur_cost
+ *---------------------------------------------------------------------------
+ * Evaluates a vertex by a heuristic of el. orderings (lower is better)
+ *
+ * Params:
+ *   heur - heuristic (HEUR_*)
+ *   adj  - adjacency bitmasks with fill edges of eliminated vertices
+ *   R    - bitmask of vertices not eliminated yet
+ *   v    - evaluated vertex
+ *
+ * Returns:
+ *   Cost of eliminating v
+ */
+static int heur_cost (int heur, umask * adj, umask R, int v)
+{
+  umask N = adj[v] & R;
+  int fill = 0;
+  switch (heur)
+  {
+    case HEUR_MIN_DEGREE:
+      return MASK_POP(N);
+    case HEUR_MIN_FILL:
+      for (umask T = N; T; T &= T - 1)
+      {
+        int u = MASK_CTZ(T);
+        fill += MASK_POP(N & ~adj[u] & ~SET_BIT(EMPTY_MASK, u));
+      }
+      return fill / 2;
+    default:
+      return MASK_POP(td_adj[v] & R);
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: heur_perm
+ *---------------------------------------------------------------------------
+ * Creates an el. ordering greedily by a heuristic, ties are broken randomly
+ *
+ * Params:
+ *   n    - number of vertices
+ *   heur - heuristic (HEUR_*)
+ *   perm - array to store el. ordering to
+ */
+static void heur_perm (int n, int heur, int * perm)
+{
+  umask adj[MAX_F_VERTICES], R = FULL_MASK(n);
+  memcpy(adj, td_adj, n * sizeof(*adj));
+  for (int i = 0; i < n; i++)
+  {
+    int best = -1, best_cost = INF, ties = 0;
+    for (umask T = R; T; T &= T - 1)
+    {
+      int v = MASK_CTZ(T), cost = heur_cost(heur, adj, R, v);
+      if (cost < best_cost)
+      {
+        best = v;
+        best_cost = cost;
+        ties = 1;
+      }
+      else if (cost == best_cost && !(rand() % ++ties)) best = v;
+    }
+    perm[i] = best;
+    R = UNSET_BIT(R, best);
+    umask N = adj[best] & R;
+    for (umask T = N; T; T &= T - 1) adj[MASK_CTZ(T)] |= UNSET_BIT(N, MASK_CTZ(T));
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Function: get_opt_perms
+ *---------------------------------------------------------------------------
+ * Enumerates el. orderings with minimal treewidth from DP tables previously
+ * filled by function 'get_perm_dp' and keeps the decomposition (and its root)
+ * with the lowest estimated cost (see 'td_cost'), until TD_MAX_PERMS
+ * orderings are examined
+ *
+ * Params:
+ *   g     - used graph
+ *   S     - mask representing current subset of vertices
+ *   depth - current position in el. ordering
+ *   tw    - treewidth of g
+ *   perm  - array to store el. ordering being constructed
+ */
+static void get_opt_perms (GRAPH * g, umask S, int depth, int tw, int * perm)
+{
+  if (!td_perms_left) return;
+  if (!S)
+  {
+    --td_perms_left;
+    td_consider(g, perm);
+    return;
+  }
+  for (int i = 0; i < g->n_cnt; i++)
+  {
+    if (!GET_BIT(S, i)) continue;
+    umask R = UNSET_BIT(S, i);
+    if (MAX(R ? tw_dp[R] : -INF, q_function(R, i)) > tw) continue;
+    perm[depth] = i;
+    get_opt_perms(g, R, depth - 1, tw, perm);
+  }
+}
+
 /****************************************************************************
  * INTERFACE FUNCTIONS
  ***************************************************************************/
@@ -279,20 +616,72 @@ static TREE_DEC * td_from_perm (GRAPH * g, int * perm)
  *-------------------------------------------------------------------------*/
 TREE_DEC * td_get (GRAPH * g)
 {
-  ARR_ALLOC(tw_dp, 1U << g->n_cnt);
-  memset(tw_dp, -1, ARR_LEN(tw_dp) * sizeof(*tw_dp));
-  int tw = get_perm_dp(g, (1U << g->n_cnt) - 1);
-  int best_perm[MAX_F_VERTICES];
-  get_best_perm(g, (1U << g->n_cnt) - 1, g->n_cnt - 1, best_perm);
+  double deadline = td_now() + TD_BUDGET;
+  int perm[MAX_F_VERTICES], tw = NOT_USED;
+  td_adj_init(g);
+  td_best = NULL;
+  td_best_cost = HUGE_VAL;
+  td_best_score = INF;
+  /* Heuristic orderings with restarts give an upper bound (and a fallback) */
+  for (int i = 0; i < TD_HEUR_RESTARTS; i++)
+  {
+    heur_perm(g->n_cnt, i % HEUR_CNT, perm);
+    td_consider(g, perm);
+  }
+  DBG("HEURISTIC TW = %d", td_best->tw);
+  /* Optimal orderings, if their DP fits into the time and memory budget */
+  u64 dp_mem = ((u64)1 << g->n_cnt) * sizeof(*tw_dp);
+  if (g->n_cnt <= TD_EXACT_VERTICES && resbuf_mem_reserve(dp_mem))
+  {
+    ARR_ALLOC(tw_dp, 1U << g->n_cnt);
+    tw = get_perm_dp(g, deadline);
+    if (tw != NOT_USED)
+    {
+      td_perms_left = TD_MAX_PERMS;
+      get_opt_perms(g, (1U << g->n_cnt) - 1, g->n_cnt - 1, tw, perm);
+    }
+    else DBG("EXACT TW ABANDONED AT DEADLINE");
+    ARR_FREE(tw_dp);
+    resbuf_mem_release(dp_mem);
+  }
+  else if (g->n_cnt <= TD_EXACT_VERTICES) DBG("EXACT TW SKIPPED (MEMORY LIMIT)");
+  tw = td_best->tw;
 
   DBG("TW = %d", tw);
   DBG("ES:");
-  for (int i = 0; i < g->n_cnt; i++) DBG("%d", best_perm[i]);
+  for (int i = 0; i < g->n_cnt; i++) DBG("%d", td_best_perm[i]);
+  DBG("DISCONNECTED INTRODUCTIONS = %d", td_best_score);
+  DBG("ESTIMATED COST = %.0f", td_best_cost);
 
-  TREE_DEC * tmp = td_from_perm(g, best_perm);
-  tmp->tw = tw;
-  ARR_FREE(tw_dp);
-  return tmp;
+  return td_best;
+}
+
+/*---------------------------------------------------------------------------
+ * Function: td_intro_order
+ *-------------------------------------------------------------------------*/
+int td_intro_order (TREE_DEC * td, umask base, umask add, int * order)
+{
+  int o_cnt = 0, res = 0;
+  while (add)
+  {
+    /* The first vertex of a leaf is the one with most neighbours to follow */
+    umask nbs = (base ? base : add);
+    int v = -1, v_nb = -1;
+    for (umask T = add; T; T &= T - 1) /* Vertices, not bags of td */
+    {
+      int i = MASK_CTZ(T), nb = MASK_POP(td->g_adj[i] & nbs);
+      if (nb > v_nb)
+      {
+        v = i;
+        v_nb = nb;
+      }
+    }
+    if (base && !v_nb) ++res;
+    order[o_cnt++] = v;
+    base = SET_BIT(base, v);
+    add = UNSET_BIT(add, v);
+  }
+  return res;
 }
 
 /*---------------------------------------------------------------------------
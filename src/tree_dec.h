@@ -21,7 +21,7 @@ struct tree_dec_node_struct
 {
   /* Bag content in form of bitmask */
   umask bag;
-  /* Adjacency array in form of bitmask (fits, since MAX_F_VERTICES <= 32)*/
+  /* Adjacency array in form of bitmask (fits, since MAX_F_VERTICES <= UMASK_BITS)*/
   umask adj;
 };
 
@@ -32,6 +32,10 @@ struct tree_dec_struct
   int           tw;
   /* Number of nodes */
   int           b_cnt;
+  /* Node the nice tree decomposition is rooted at */
+  int           root;
+  /* Adjacency of the decomposed graph in form of bitmasks (without fill edges) */
+  umask         g_adj[MAX_F_VERTICES];
   /* Array of td nodes */
   TREE_DEC_NODE nodes[MAX_F_VERTICES];
 };
@@ -43,7 +47,15 @@ struct tree_dec_struct
 /* -------------------------
  * Function: td_get
  * -------------------------
- * Creates a tree decomposition from the given graph.
+ * Creates a tree decomposition from the given graph. El. orderings are first
+ * created by heuristics (min-degree, min-fill, min-width) with random
+ * tie-breaking, then optimal ones are enumerated, unless the graph is too large
+ * (TD_EXACT_VERTICES) or the exact DP does not fit into TD_BUDGET or MEM_LIMIT
+ * (the heuristic decomposition is used then). Among
+ * decompositions of the lowest width found, the one (together with its root)
+ * is preferred, whose nice tree decomposition introduces fewest vertices
+ * without a neighbour in the bag. Remaining ties are broken by the estimated
+ * size of DP tables (see cost_bag).
  * 
  * Params:
  *   g - graph to be processed
@@ -53,6 +65,24 @@ struct tree_dec_struct
  */
 TREE_DEC * td_get   (GRAPH * g);
 
+/* -------------------------
+ * Function: td_intro_order
+ * -------------------------
+ * Orders vertices introduced on top of a bag, so that each of them has
+ * a neighbour among already present vertices whenever possible (vertices
+ * with more such neighbours are preferred).
+ * 
+ * Params:
+ *   td    - corresponding tree decomposition
+ *   base  - bitmask of vertices already present in the bag
+ *   add   - bitmask of vertices to be introduced
+ *   order - array to store the order of introduction to
+ *
+ * Returns:
+ *   Number of vertices introduced into a nonempty bag without a neighbour in it
+ */
+int        td_intro_order (TREE_DEC * td, umask base, umask add, int * order);
+
 /* -------------------------
  * Function: td_free
  * -------------------------
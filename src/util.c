@@ -10,6 +10,10 @@
 #include "util.h"
 #include "graph.h"
 #include "array.h"
+#include "sched.h"
+#include "resbuf.h"
+#include "filter.h"
+#include "aut.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -25,6 +29,11 @@ void free_all (void)
   graph_free(G_GRAPH);
   graph_free(F_GRAPH);
   ARR_FREE(F_ECC);
+  ARR_FREE(F_COMP);
+  filter_free();
+  aut_free();
+  sched_free();
+  resbuf_pool_free();
 }
 
 /*---------------------------------------------------------------------------
@@ -12,10 +12,36 @@
 
 #include "common.h"
 
-#define GET_BIT(x, pos)   ((x) & (1U << (pos)))
-#define SET_BIT(x, pos)   ((x) | (1U << (pos)))
-#define UNSET_BIT(x, pos) ((x) - (1U << (pos)))
-#define BIT_COMPL(x, g)   ((1U << ((g)->n_cnt)) - 1 - (x))
+#define GET_BIT(x, pos)   ((x) & ((umask)1 << (pos)))
+#define SET_BIT(x, pos)   ((x) | ((umask)1 << (pos)))
+#define UNSET_BIT(x, pos) ((x) - ((umask)1 << (pos)))
+#define BIT_COMPL(x, g)   (FULL_MASK((g)->n_cnt) - (x))
+#define FULL_MASK(n)      ((n) >= UMASK_BITS ? ~EMPTY_MASK : ((umask)1 << (n)) - 1)
+
+/* -------------------------
+ * Macros: MASK_POP(x), MASK_CTZ(x)
+ * -------------------------
+ * Number of set bits of umask x, and index of its lowest set bit (x has to be
+ * nonempty)
+ */
+#if UMASK_BITS == 32
+  #define MASK_POP(x) __builtin_popcount(x)
+  #define MASK_CTZ(x) __builtin_ctz(x)
+#elif UMASK_BITS == 64
+  #define MASK_POP(x) __builtin_popcountll(x)
+  #define MASK_CTZ(x) __builtin_ctzll(x)
+#else
+  #define MASK_POP(x) mask_pop_wide(x)
+  #define MASK_CTZ(x) mask_ctz_wide(x)
+static inline int mask_pop_wide (umask x)
+{
+  return __builtin_popcountll((u64)x) + __builtin_popcountll((u64)(x >> 64));
+}
+static inline int mask_ctz_wide (umask x)
+{
+  return (u64)x ? __builtin_ctzll((u64)x) : 64 + __builtin_ctzll((u64)(x >> 64));
+}
+#endif
 
 /* -------------------------
  * Macros: BTB_PATT, BTB(byte), PRINT_BINARY(x)